@@ -0,0 +1,379 @@
+/*
+
+  benchLattice: spring force kernels on large cubes
+
+  Builds cubes of n^3 particles with the springs of the jello cube (see lattice in springs.h and stencil.h),
+  deforms them randomly, and times one force evaluation of every spring with each kernel variant. Prints, per size and
+  variant, the time per evaluation and per spring, the bandwidth the compulsory memory traffic alone would need
+  at that speed, and the largest difference from the first variant's forces (double precision), absolute and
+  relative to the largest force component. A variant whose relative difference exceeds the tolerance of its
+  precision (BENCH_*_TOLERANCE) is marked FAILED, and the program then exits with 1, so a broken kernel cannot pass
+  as a fast one.
+
+  Usage: benchLattice [n ...] [options]
+    n              cube sizes, particles per edge (default 32 64)
+    -seconds s     time each variant for at least this long (default 0.5)
+    -seed n        seed of the deformation (default 1)
+    -threads t     worker threads of the parallel variants (default: all cores)
+    -tile t        edge of the stencil blocks (default STENCIL_DEFAULT_TILE)
+    -scaling       then time the parallel variants again on 1, 2, 4, ... up to the -threads count and print the
+                   speedup over one thread
+
+  Variants:
+    row-major      spring list over particles stored (i * n + j) * n + k, as in struct world
+    Morton         the same springs over particles stored along a Z-order curve
+    stencil        fixed-offset stencil over row-major particles in tile^3 blocks, parallel (stencil.h)
+    stencil n^3    the stencil in one block the size of the cube
+    coloured       row-major spring list, edge-coloured, parallel one colour at a time with plain stores
+    reduce         row-major spring list, parallel into per-thread accumulators that are summed afterwards
+    ... float      the same kernel with state and arithmetic in single precision
+    ... mixed      the same kernel with double state and single-precision spring forces
+
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "parallel.h"
+#include "random.h"
+#include "springs.h"
+#include "stencil.h"
+
+#define BENCH_K_ELASTIC 1000.0
+#define BENCH_D_ELASTIC 0.5
+
+// largest allowed difference from the double-precision row-major forces, relative to the largest force component:
+// double kernels only sum in a different order, single-precision springs round at about 6e-8 per operation
+#define BENCH_DOUBLE_TOLERANCE 1e-12
+#define BENCH_FLOAT_TOLERANCE 1e-4
+#define BENCH_MIXED_TOLERANCE 1e-6
+
+static void usage()
+{
+    printf("usage: benchLattice [n ...] [-seconds s] [-seed n] [-threads t] [-tile t] [-scaling]\n");
+    exit(1);
+}
+
+enum benchKernel
+{
+    BENCH_SPRING_LIST,
+    BENCH_STENCIL,
+    BENCH_STENCIL_UNTILED,
+    BENCH_COLOURED,
+    BENCH_REDUCED
+};
+
+enum benchPrecision
+{
+    BENCH_DOUBLE,
+    BENCH_FLOAT,
+    BENCH_MIXED
+};
+
+// a deformed cube in the layout of its lattice
+struct benchCube
+{
+    struct lattice cube;
+    benchKernel kernel;
+    benchPrecision precision;
+    int tile;
+    std::vector<int> colourStart;                        // BENCH_COLOURED
+    std::vector<std::vector<struct point>> accumulators; // BENCH_REDUCED
+    std::vector<struct point> p, v, force;
+    std::vector<struct pointf> pf, vf, forcef; // BENCH_FLOAT
+};
+
+static void buildBenchCube(struct benchCube* bench, int n, latticeOrder order, benchKernel kernel,
+                           benchPrecision precision, int tile, unsigned long long seed)
+{
+    buildLattice(&bench->cube, n, order);
+    bench->kernel = kernel;
+    bench->precision = precision;
+    bench->tile = kernel == BENCH_STENCIL_UNTILED ? (n < STENCIL_MAX_TILE ? n : STENCIL_MAX_TILE) : tile;
+    if (kernel == BENCH_COLOURED)
+    {
+        colourSpringList(&bench->cube.springs, &bench->colourStart);
+    }
+
+    const int count = n * n * n;
+    const double spacing = 1.0 / (n - 1);
+    bench->p.resize(count);
+    bench->v.resize(count);
+    bench->force.assign(count, point{0.0, 0.0, 0.0});
+
+    // the random values belong to the particle, not the slot, so every layout gets the same cube
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++)
+            for (int k = 0; k < n; k++)
+            {
+                int particle = (i * n + j) * n + k;
+                int s = bench->cube.slot[particle];
+                philoxBlock r = philox4x32(seed, 2 * (unsigned long long)particle);
+                philoxBlock w = philox4x32(seed, 2 * (unsigned long long)particle + 1);
+                bench->p[s].x = (i + 0.2 * randomSigned(r.v[0])) * spacing;
+                bench->p[s].y = (j + 0.2 * randomSigned(r.v[1])) * spacing;
+                bench->p[s].z = (k + 0.2 * randomSigned(r.v[2])) * spacing;
+                bench->v[s].x = 0.1 * randomSigned(w.v[0]);
+                bench->v[s].y = 0.1 * randomSigned(w.v[1]);
+                bench->v[s].z = 0.1 * randomSigned(w.v[2]);
+            }
+
+    if (precision == BENCH_FLOAT)
+    {
+        bench->pf.resize(count);
+        bench->vf.resize(count);
+        bench->forcef.resize(count);
+        for (int s = 0; s < count; s++)
+        {
+            bench->pf[s] = pointf{(float)bench->p[s].x, (float)bench->p[s].y, (float)bench->p[s].z};
+            bench->vf[s] = pointf{(float)bench->v[s].x, (float)bench->v[s].y, (float)bench->v[s].z};
+        }
+    }
+}
+
+static void evaluate(struct benchCube* bench)
+{
+    const int n = bench->cube.n;
+    const bool stencil = bench->kernel == BENCH_STENCIL || bench->kernel == BENCH_STENCIL_UNTILED;
+
+    if (bench->precision == BENCH_FLOAT)
+    {
+        if (stencil)
+        {
+            computeStencilForces<float>(n, 1.0 / (n - 1), bench->pf.data(), bench->vf.data(), BENCH_K_ELASTIC,
+                                        BENCH_D_ELASTIC, bench->forcef.data(), bench->tile);
+            return;
+        }
+        memset(bench->forcef.data(), 0, bench->forcef.size() * sizeof(struct pointf));
+        addSpringForces<float>(&bench->cube.springs, bench->pf.data(), bench->vf.data(), BENCH_K_ELASTIC,
+                               BENCH_D_ELASTIC, bench->forcef.data());
+        return;
+    }
+
+    if (stencil)
+    {
+        if (bench->precision == BENCH_MIXED)
+            computeStencilForces<float>(n, 1.0 / (n - 1), bench->p.data(), bench->v.data(), BENCH_K_ELASTIC,
+                                        BENCH_D_ELASTIC, bench->force.data(), bench->tile);
+        else
+            computeStencilForces(n, 1.0 / (n - 1), bench->p.data(), bench->v.data(), BENCH_K_ELASTIC,
+                                 BENCH_D_ELASTIC, bench->force.data(), bench->tile);
+        return;
+    }
+
+    memset(bench->force.data(), 0, bench->force.size() * sizeof(struct point));
+    if (bench->precision == BENCH_MIXED)
+        addSpringForces<float>(&bench->cube.springs, bench->p.data(), bench->v.data(), BENCH_K_ELASTIC,
+                               BENCH_D_ELASTIC, bench->force.data());
+    else if (bench->kernel == BENCH_COLOURED)
+        addSpringForcesColoured(&bench->cube.springs, bench->colourStart, bench->p.data(), bench->v.data(),
+                                BENCH_K_ELASTIC, BENCH_D_ELASTIC, bench->force.data());
+    else if (bench->kernel == BENCH_REDUCED)
+        addSpringForcesReduced(&bench->cube.springs, bench->p.data(), bench->v.data(), BENCH_K_ELASTIC,
+                               BENCH_D_ELASTIC, bench->force.data(), &bench->accumulators, (int)bench->p.size());
+    else
+        addSpringForces(&bench->cube.springs, bench->p.data(), bench->v.data(), BENCH_K_ELASTIC, BENCH_D_ELASTIC,
+                        bench->force.data());
+}
+
+// seconds per evaluation, over at least three evaluations and minimumSeconds
+static double timeEvaluation(struct benchCube* bench, double minimumSeconds)
+{
+    // one untimed evaluation to fault the pages in and warm the caches
+    evaluate(bench);
+
+    int evaluations = 0;
+    double seconds = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    while (evaluations < 3 || seconds < minimumSeconds)
+    {
+        evaluate(bench);
+        evaluations++;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return seconds / evaluations;
+}
+
+// the forces in row-major particle order, whatever the layout
+static std::vector<struct point> rowMajorForces(const struct benchCube* bench)
+{
+    std::vector<struct point> forces(bench->force.size());
+    for (size_t particle = 0; particle < forces.size(); particle++)
+    {
+        int s = bench->cube.slot[particle];
+        if (bench->precision == BENCH_FLOAT)
+            forces[particle] = point{bench->forcef[s].x, bench->forcef[s].y, bench->forcef[s].z};
+        else
+            forces[particle] = bench->force[s];
+    }
+    return forces;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<int> sizes;
+    double minimumSeconds = 0.5;
+    unsigned long long seed = 1;
+    int tile = STENCIL_DEFAULT_TILE;
+    int scaling = 0;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        const char* option = argv[arg];
+        int remaining = argc - arg - 1;
+
+        if (strcmp(option, "-seconds") == 0 && remaining >= 1)
+            minimumSeconds = atof(argv[++arg]);
+        else if (strcmp(option, "-seed") == 0 && remaining >= 1)
+            seed = strtoull(argv[++arg], NULL, 10);
+        else if (strcmp(option, "-threads") == 0 && remaining >= 1)
+            setParallelThreadCount(atoi(argv[++arg]));
+        else if (strcmp(option, "-tile") == 0 && remaining >= 1)
+            tile = atoi(argv[++arg]);
+        else if (strcmp(option, "-scaling") == 0)
+            scaling = 1;
+        else if (option[0] == '-')
+            usage();
+        else if (atoi(option) >= 3 && atoi(option) <= 1024)
+            sizes.push_back(atoi(option));
+        else
+            usage();
+    }
+    if (sizes.empty())
+    {
+        sizes.push_back(32);
+        sizes.push_back(64);
+    }
+
+    const struct
+    {
+        const char* name;
+        latticeOrder order;
+        benchKernel kernel;
+        benchPrecision precision;
+    } variants[] = {{"row-major", LATTICE_ROW_MAJOR, BENCH_SPRING_LIST, BENCH_DOUBLE},
+                    {"Morton", LATTICE_MORTON, BENCH_SPRING_LIST, BENCH_DOUBLE},
+                    {"stencil", LATTICE_ROW_MAJOR, BENCH_STENCIL, BENCH_DOUBLE},
+                    {"stencil n^3", LATTICE_ROW_MAJOR, BENCH_STENCIL_UNTILED, BENCH_DOUBLE},
+                    {"coloured", LATTICE_ROW_MAJOR, BENCH_COLOURED, BENCH_DOUBLE},
+                    {"reduce", LATTICE_ROW_MAJOR, BENCH_REDUCED, BENCH_DOUBLE},
+                    {"list float", LATTICE_ROW_MAJOR, BENCH_SPRING_LIST, BENCH_FLOAT},
+                    {"list mixed", LATTICE_ROW_MAJOR, BENCH_SPRING_LIST, BENCH_MIXED},
+                    {"stencil float", LATTICE_ROW_MAJOR, BENCH_STENCIL, BENCH_FLOAT},
+                    {"stencil mixed", LATTICE_ROW_MAJOR, BENCH_STENCIL, BENCH_MIXED}};
+    const int variantCount = sizeof(variants) / sizeof(variants[0]);
+
+    printf("# %d threads, stencil tile %d\n", parallelThreadCount(), tile);
+    printf("# %-4s %-14s %10s %12s %10s %10s %12s %12s\n", "n", "variant", "springs", "ms/eval", "ns/spring",
+           "GB/s", "max diff", "rel diff");
+    int failures = 0;
+    for (int n : sizes)
+    {
+        std::vector<struct point> reference;
+        double largestForce = 0.0;
+        for (int variant = 0; variant < variantCount; variant++)
+        {
+            struct benchCube bench;
+            buildBenchCube(&bench, n, variants[variant].order, variants[variant].kernel, variants[variant].precision,
+                           tile, seed);
+            const int springCount = bench.cube.springs.count();
+
+            double perEvaluation = timeEvaluation(&bench, minimumSeconds);
+
+            // compulsory traffic: the spring list once, positions and velocities read, forces read and written;
+            // the stencil has no list and writes the forces without reading them
+            size_t pointSize = bench.precision == BENCH_FLOAT ? sizeof(struct pointf) : sizeof(struct point);
+            double bytes = bench.kernel != BENCH_STENCIL && bench.kernel != BENCH_STENCIL_UNTILED
+                               ? springCount * (2 * sizeof(int) + sizeof(double)) +
+                                     (double)bench.p.size() * 4 * pointSize
+                               : (double)bench.p.size() * 3 * pointSize;
+
+            std::vector<struct point> forces = rowMajorForces(&bench);
+            double difference = 0.0;
+            if (variant == 0)
+            {
+                reference = forces;
+                for (const struct point& f : reference)
+                {
+                    largestForce = fmax(largestForce, fmax(fabs(f.x), fmax(fabs(f.y), fabs(f.z))));
+                }
+            }
+            for (size_t particle = 0; particle < forces.size(); particle++)
+            {
+                difference = fmax(difference, fabs(forces[particle].x - reference[particle].x));
+                difference = fmax(difference, fabs(forces[particle].y - reference[particle].y));
+                difference = fmax(difference, fabs(forces[particle].z - reference[particle].z));
+            }
+
+            double relative = largestForce > 0.0 ? difference / largestForce : 0.0;
+            double tolerance = variants[variant].precision == BENCH_FLOAT   ? BENCH_FLOAT_TOLERANCE
+                               : variants[variant].precision == BENCH_MIXED ? BENCH_MIXED_TOLERANCE
+                                                                            : BENCH_DOUBLE_TOLERANCE;
+            bool failed = !(relative <= tolerance); // also for NaN
+            failures += failed;
+
+            printf("  %-4d %-14s %10d %12.3f %10.2f %10.2f %12.3g %12.3g%s\n", n, variants[variant].name, springCount,
+                   1e3 * perEvaluation, 1e9 * perEvaluation / springCount, 1e-9 * bytes / perEvaluation,
+                   difference, relative, failed ? " FAILED" : "");
+        }
+    }
+
+    if (scaling)
+    {
+        // the parallel variants on more and more threads; the serial spring list is the baseline of the speedup
+        const int maxThreads = parallelThreadCount();
+        std::vector<int> threadCounts;
+        for (int threads = 1; threads < maxThreads; threads *= 2)
+        {
+            threadCounts.push_back(threads);
+        }
+        threadCounts.push_back(maxThreads);
+
+        printf("# scaling: speedup over the serial row-major spring list\n# %-4s %-14s", "n", "variant");
+        for (int threads : threadCounts)
+        {
+            printf(" %7d", threads);
+        }
+        printf("\n");
+
+        for (int n : sizes)
+        {
+            struct benchCube serial;
+            buildBenchCube(&serial, n, LATTICE_ROW_MAJOR, BENCH_SPRING_LIST, BENCH_DOUBLE, tile, seed);
+            double serialTime = timeEvaluation(&serial, minimumSeconds);
+
+            for (int variant = 0; variant < variantCount; variant++)
+            {
+                benchKernel kernel = variants[variant].kernel;
+                if ((kernel != BENCH_STENCIL && kernel != BENCH_COLOURED && kernel != BENCH_REDUCED) ||
+                    variants[variant].precision != BENCH_DOUBLE)
+                {
+                    continue;
+                }
+
+                struct benchCube bench;
+                buildBenchCube(&bench, n, variants[variant].order, kernel, BENCH_DOUBLE, tile, seed);
+                printf("  %-4d %-14s", n, variants[variant].name);
+                for (int threads : threadCounts)
+                {
+                    setParallelThreadCount(threads);
+                    printf(" %7.2f", serialTime / timeEvaluation(&bench, minimumSeconds));
+                    fflush(stdout);
+                }
+                printf("\n");
+                setParallelThreadCount(maxThreads);
+            }
+        }
+    }
+
+    if (failures > 0)
+    {
+        printf("%d variants differ from the row-major forces by more than their tolerance\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,41 @@
+@echo off
+rem Renders a world in the Vulkan viewer on lavapipe (Mesa's CPU Vulkan driver), captures the first frames and
+rem checks them with checkCapture.
+rem
+rem   captureCheck.bat [world file] [frames] [reference dir]
+rem
+rem LAVAPIPE_ICD must name lavapipe's ICD manifest, e.g. C:\mesa\x64\lvp_icd.x86_64.json. jello.exe (Release|x64)
+rem and checkCapture.exe must be built. The images are written to the repository root as pic0000.ppm etc.; with a
+rem reference directory they must also match the images there (see checkCapture.cpp).
+
+setlocal
+
+cd /d "%~dp0"
+
+set WORLD=%~1
+if "%WORLD%"=="" set WORLD=jello.w
+set FRAMES=%~2
+if "%FRAMES%"=="" set FRAMES=10
+
+if "%LAVAPIPE_ICD%"=="" (
+    echo [Error] LAVAPIPE_ICD is not set to lavapipe's ICD manifest.
+    exit /b 1
+)
+
+rem only lavapipe, whatever GPU drivers are installed
+set VK_DRIVER_FILES=%LAVAPIPE_ICD%
+set VK_ICD_FILENAMES=%LAVAPIPE_ICD%
+
+del /q pic????.ppm 2>nul
+
+x64\Release\jello.exe "%WORLD%" -capture %FRAMES%
+if %ERRORLEVEL% NEQ 0 (echo [Error] The viewer failed. & exit /b 1)
+
+if "%~3"=="" (
+    x64\Release\checkCapture.exe %FRAMES%
+) else (
+    x64\Release\checkCapture.exe %FRAMES% -reference "%~3"
+)
+if %ERRORLEVEL% NEQ 0 (echo [Error] Capture check failed. & exit /b 1)
+
+echo [Success] %FRAMES% frames captured on lavapipe.
@@ -0,0 +1,162 @@
+/*
+
+  checkCapture: checks the screenshots of a capture run
+
+  Reads pic0000.ppm .. pic<frames-1>.ppm from the current directory, as written by the viewers (S key, or
+  "jello <world> -capture frames" in the Vulkan viewer), and fails unless every frame exists, all have the same
+  size, no frame is a single colour (nothing drawn) and the cube moves between the first and the last frame.
+  Prints a checksum per frame. With -reference, every frame is also compared with the file of the same name in
+  that directory and may differ by at most the tolerance in any channel; run it once on a trusted capture and keep
+  the images as the reference. Exits with 1 on the first failed check. captureCheck.bat runs the viewer under
+  lavapipe and then this tool.
+
+  Usage: checkCapture frames [-reference dir] [-tolerance t]
+    frames         number of images to check
+    -reference d   directory with reference images
+    -tolerance t   largest channel difference from the reference (default 8, 0 = identical)
+
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "pic.h"
+
+static void usage()
+{
+    printf("usage: checkCapture frames [-reference dir] [-tolerance t]\n");
+    exit(1);
+}
+
+static void fail(const char* message, const std::string& fileName)
+{
+    printf("FAILED: %s: %s\n", fileName.c_str(), message);
+    exit(1);
+}
+
+static std::string frameName(int frame)
+{
+    char name[20];
+    snprintf(name, sizeof(name), "pic%04d.ppm", frame);
+    return name;
+}
+
+static Pic* readFrame(const std::string& fileName)
+{
+    std::string name = fileName;
+    Pic* pic = ppm_read(&name[0], NULL);
+    if (pic == NULL)
+    {
+        fail("missing or not a binary PPM", fileName);
+    }
+    return pic;
+}
+
+// FNV-1a over the pixels, to tell captures apart at a glance
+static unsigned long long checksum(const Pic* pic)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    size_t size = (size_t)pic->nx * pic->ny * pic->bpp;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ pic->pix[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        usage();
+    }
+
+    int frames = atoi(argv[1]);
+    const char* reference = NULL;
+    int tolerance = 8;
+    for (int arg = 2; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "-reference") == 0 && arg + 1 < argc)
+            reference = argv[++arg];
+        else if (strcmp(argv[arg], "-tolerance") == 0 && arg + 1 < argc)
+            tolerance = atoi(argv[++arg]);
+        else
+            usage();
+    }
+    if (frames < 2)
+    {
+        printf("need at least 2 frames\n");
+        exit(1);
+    }
+
+    Pic* first = NULL;
+    unsigned long long firstChecksum = 0, lastChecksum = 0;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        std::string fileName = frameName(frame);
+        Pic* pic = readFrame(fileName);
+        size_t size = (size_t)pic->nx * pic->ny * pic->bpp;
+
+        if (first == NULL)
+        {
+            first = pic;
+        }
+        else if (pic->nx != first->nx || pic->ny != first->ny || pic->bpp != first->bpp)
+        {
+            fail("size differs from pic0000.ppm", fileName);
+        }
+
+        bool uniform = true;
+        for (size_t i = pic->bpp; i < size && uniform; i++)
+        {
+            uniform = pic->pix[i] == pic->pix[i % pic->bpp];
+        }
+        if (uniform)
+        {
+            fail("a single colour, nothing was drawn", fileName);
+        }
+
+        if (reference != NULL)
+        {
+            std::string referenceName = std::string(reference) + "/" + fileName;
+            Pic* expected = readFrame(referenceName);
+            if (expected->nx != pic->nx || expected->ny != pic->ny || expected->bpp != pic->bpp)
+            {
+                fail("size differs from the reference", fileName);
+            }
+            int largest = 0;
+            for (size_t i = 0; i < size; i++)
+            {
+                int difference = abs((int)pic->pix[i] - (int)expected->pix[i]);
+                largest = difference > largest ? difference : largest;
+            }
+            if (largest > tolerance)
+            {
+                printf("FAILED: %s: differs from the reference by %d (tolerance %d)\n", fileName.c_str(), largest,
+                       tolerance);
+                exit(1);
+            }
+            pic_free(expected);
+        }
+
+        unsigned long long hash = checksum(pic);
+        printf("%s %dx%d %016llx\n", fileName.c_str(), pic->nx, pic->ny, hash);
+        firstChecksum = frame == 0 ? hash : firstChecksum;
+        lastChecksum = hash;
+        if (pic != first)
+        {
+            pic_free(pic);
+        }
+    }
+
+    if (firstChecksum == lastChecksum)
+    {
+        fail("same image as pic0000.ppm, nothing moved", frameName(frames - 1));
+    }
+
+    pic_free(first);
+    printf("%d frames OK\n", frames);
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include "collision.h"
+
+#include <math.h>
+
+#include "simd.h"
+
+CollisionPlanes::CollisionPlanes()
+{
+    // bounding box [-2, 2]^3, normals pointing inwards
+    add(1.0, 0.0, 0.0, 2.0, 0);
+    add(-1.0, 0.0, 0.0, 2.0, 0);
+    add(0.0, 1.0, 0.0, 2.0, 0);
+    add(0.0, -1.0, 0.0, 2.0, 0);
+    add(0.0, 0.0, 1.0, 2.0, 0);
+    add(0.0, 0.0, -1.0, 2.0, 0);
+}
+
+void CollisionPlanes::add(double a, double b, double c, double d, int fromWorldFile)
+{
+    double length = sqrt(a * a + b * b + c * c);
+
+    m_nx.push_back(a / length);
+    m_ny.push_back(b / length);
+    m_nz.push_back(c / length);
+    m_d.push_back(d / length);
+
+    if (fromWorldFile)
+    {
+        m_fileLines.push_back(a);
+        m_fileLines.push_back(b);
+        m_fileLines.push_back(c);
+        m_fileLines.push_back(d);
+    }
+}
+
+// Per plane: s = n.p + d is the signed distance, penetration = max(0, -s).
+// The spring pushes along n with kCollision * penetration; while penetrating, the velocity component into the
+// plane, min(0, n.v), is damped with dCollision. Both terms are zero for particles on the allowed side, so
+// there is nothing to branch on.
+void CollisionPlanes::addForces(const struct point* p, const struct point* v, const int* particles, int particleCount,
+                                double kCollision, double dCollision, struct point* force, double* energy) const
+{
+    const int planeCount = count();
+    int first = 0;
+    double penetration2 = 0.0; // sum of penetration^2, for the energy; a few extra multiplies, so always summed
+
+#if JELLO_SIMD_SSE2
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d k = _mm_set1_pd(kCollision);
+    const __m128d damping = _mm_set1_pd(dCollision);
+
+    __m128d sumPenetration2 = zero;
+
+    // two particles per iteration, x/y/z gathered into separate registers
+    for (; first + 1 < particleCount; first += 2)
+    {
+        const int i0 = particles[first], i1 = particles[first + 1];
+        __m128d px = _mm_loadh_pd(_mm_load_sd(&p[i0].x), &p[i1].x);
+        __m128d py = _mm_loadh_pd(_mm_load_sd(&p[i0].y), &p[i1].y);
+        __m128d pz = _mm_loadh_pd(_mm_load_sd(&p[i0].z), &p[i1].z);
+        __m128d vx = _mm_loadh_pd(_mm_load_sd(&v[i0].x), &v[i1].x);
+        __m128d vy = _mm_loadh_pd(_mm_load_sd(&v[i0].y), &v[i1].y);
+        __m128d vz = _mm_loadh_pd(_mm_load_sd(&v[i0].z), &v[i1].z);
+
+        __m128d fx = zero, fy = zero, fz = zero;
+        for (int n = 0; n < planeCount; n++)
+        {
+            __m128d nx = _mm_set1_pd(m_nx[n]);
+            __m128d ny = _mm_set1_pd(m_ny[n]);
+            __m128d nz = _mm_set1_pd(m_nz[n]);
+
+            __m128d s = _mm_add_pd(_mm_add_pd(_mm_mul_pd(nx, px), _mm_mul_pd(ny, py)),
+                                   _mm_add_pd(_mm_mul_pd(nz, pz), _mm_set1_pd(m_d[n])));
+            __m128d vn = _mm_add_pd(_mm_add_pd(_mm_mul_pd(nx, vx), _mm_mul_pd(ny, vy)), _mm_mul_pd(nz, vz));
+
+            __m128d penetration = _mm_max_pd(zero, _mm_sub_pd(zero, s));
+            sumPenetration2 = _mm_add_pd(sumPenetration2, _mm_mul_pd(penetration, penetration));
+            __m128d inside = _mm_cmplt_pd(s, zero);
+            __m128d approach = _mm_and_pd(inside, _mm_min_pd(zero, vn));
+
+            __m128d magnitude = _mm_sub_pd(_mm_mul_pd(k, penetration), _mm_mul_pd(damping, approach));
+            fx = _mm_add_pd(fx, _mm_mul_pd(magnitude, nx));
+            fy = _mm_add_pd(fy, _mm_mul_pd(magnitude, ny));
+            fz = _mm_add_pd(fz, _mm_mul_pd(magnitude, nz));
+        }
+
+        alignas(16) double f[6];
+        _mm_store_pd(f, fx);
+        _mm_store_pd(f + 2, fy);
+        _mm_store_pd(f + 4, fz);
+        force[i0].x += f[0];
+        force[i1].x += f[1];
+        force[i0].y += f[2];
+        force[i1].y += f[3];
+        force[i0].z += f[4];
+        force[i1].z += f[5];
+    }
+
+    alignas(16) double sums[2];
+    _mm_store_pd(sums, sumPenetration2);
+    penetration2 = sums[0] + sums[1];
+#endif
+
+    // scalar path for the remaining particles (all of them without SSE2)
+    for (int f = first; f < particleCount; f++)
+    {
+        const int i = particles[f];
+        for (int n = 0; n < planeCount; n++)
+        {
+            double s = m_nx[n] * p[i].x + m_ny[n] * p[i].y + m_nz[n] * p[i].z + m_d[n];
+            double vn = m_nx[n] * v[i].x + m_ny[n] * v[i].y + m_nz[n] * v[i].z;
+
+            double penetration = fmax(0.0, -s);
+            double approach = s < 0.0 ? fmin(0.0, vn) : 0.0;
+            penetration2 += penetration * penetration;
+
+            double magnitude = kCollision * penetration - dCollision * approach;
+            force[i].x += magnitude * m_nx[n];
+            force[i].y += magnitude * m_ny[n];
+            force[i].z += magnitude * m_nz[n];
+        }
+    }
+
+    if (energy != NULL)
+    {
+        *energy += 0.5 * kCollision * penetration2;
+    }
+}
+
+void CollisionPlanes::write(FILE* file) const
+{
+    for (size_t n = 0; n < m_fileLines.size(); n += 4)
+    {
+        fprintf(file, "plane %lf %lf %lf %lf\n", m_fileLines[n], m_fileLines[n + 1], m_fileLines[n + 2],
+                m_fileLines[n + 3]);
+    }
+}
+
+CollisionPlanes* createCollisionPlanes(const struct world* jello)
+{
+    CollisionPlanes* planes = new CollisionPlanes();
+
+    if (jello->incPlanePresent == 1 && (jello->a != 0.0 || jello->b != 0.0 || jello->c != 0.0))
+    {
+        // the world file does not say which side is solid; keep the cube on the side it starts on
+        double cx = 0.0, cy = 0.0, cz = 0.0;
+        for (int i = 0; i <= JELLO_SUBDIVISIONS; i++)
+            for (int j = 0; j <= JELLO_SUBDIVISIONS; j++)
+                for (int k = 0; k <= JELLO_SUBDIVISIONS; k++)
+                {
+                    cx += jello->p[i][j][k].x;
+                    cy += jello->p[i][j][k].y;
+                    cz += jello->p[i][j][k].z;
+                }
+
+        double side = jello->a * cx + jello->b * cy + jello->c * cz +
+                      jello->d * (JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS);
+        double sign = side < 0.0 ? -1.0 : 1.0;
+        planes->add(sign * jello->a, sign * jello->b, sign * jello->c, sign * jello->d, 0);
+    }
+
+    return planes;
+}
+
+int readCollisionPlane(FILE* file, CollisionPlanes* planes)
+{
+    double a, b, c, d;
+
+    if (fscanf(file, "%lf %lf %lf %lf", &a, &b, &c, &d) != 4 || (a == 0.0 && b == 0.0 && c == 0.0))
+    {
+        printf("plane: expected 'plane a b c d' with a non-zero normal\n");
+        return 0;
+    }
+
+    planes->add(a, b, c, d, 1);
+    return 1;
+}
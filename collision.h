@@ -0,0 +1,55 @@
+#ifndef _COLLISION_H_
+#define _COLLISION_H_
+
+#include <cstdio>
+
+#include <vector>
+
+#include "world.h"
+
+// Static collision planes: the six walls of the [-2,2]^3 bounding box, the world file's inclined plane, and any
+// number of "plane a b c d" extension lines. Each plane keeps particles on the side where a*x + b*y + c*z + d >= 0
+// with a penalty spring along its normal (kCollision, dCollision), like the original wall code.
+// The planes are stored normalized in separate arrays so all particles are tested against all planes without
+// branches; the cost per particle is one multiply-add chain per plane.
+class CollisionPlanes
+{
+public:
+    // starts with the six bounding-box walls
+    CollisionPlanes();
+
+    // adds a plane keeping particles where a*x + b*y + c*z + d >= 0; (a, b, c) need not be normalized
+    // fromWorldFile = 1 for "plane" extension lines, which write() emits again
+    void add(double a, double b, double c, double d, int fromWorldFile);
+
+    int count() const { return (int)m_d.size(); }
+
+    // unit normal and offset of plane n
+    void get(int n, double* nx, double* ny, double* nz, double* d) const
+    {
+        *nx = m_nx[n], *ny = m_ny[n], *nz = m_nz[n], *d = m_d[n];
+    }
+
+    // adds the collision forces of every plane to the particles particles[0 .. particleCount-1] of p, v and force
+    // (e.g. the free points, freePoints); with energy, also adds the potential of their penalty springs, sum of
+    // kCollision / 2 * penetration^2, to *energy
+    void addForces(const struct point* p, const struct point* v, const int* particles, int particleCount,
+                   double kCollision, double dCollision, struct point* force, double* energy = NULL) const;
+
+    // writes the "plane" extension lines
+    void write(FILE* file) const;
+
+private:
+    // unit normal (nx, ny, nz) and offset d of every plane, one array per component
+    std::vector<double> m_nx, m_ny, m_nz, m_d;
+    std::vector<double> m_fileLines; // a, b, c, d of each "plane" extension line, as read
+};
+
+// builds the box walls plus the inclined plane (if present), oriented so the cube's initial centre is on the
+// allowed side; the cube positions must already be read
+CollisionPlanes* createCollisionPlanes(const struct world* jello);
+
+// reads the rest of a "plane a b c d" world-file line; returns 0 and prints an error if it is malformed
+int readCollisionPlane(FILE* file, CollisionPlanes* planes);
+
+#endif // #ifndef _COLLISION_H_
@@ -5,220 +5,240 @@
 
   createWorld utility to create your own world files
 
-  Note: this utility uses its own copy of writeWorld routine, which is identical to the one
-  found in input.cpp . If you need to change that routine, or even the definition of the
-  world structure (you don't have to do this unless you decide to do some fancy
-  extra credit), you have to update both copies.
+  The world structure and the world-file writers are shared with the simulator (world.h, worldFile.cpp),
+  so files written here are always readable by jello.
+
+  Usage: createWorld [options] [output file (default jello.w)]
+    -resolution r         force-field grid resolution (default 30; 0 = no grid)
+    -field type           random | zero | gravity | vortex | radial | wind (default random)
+    -strength s           force-field strength (default 20)
+    -seed n               seed for the random field (default 1); the same seed always gives the same file
+    -size s               edge length of the cube (default 1)
+    -origin x y z         corner of the cube with the smallest coordinates (default 0 0 0)
+    -velocity vx vy vz    initial velocity of every control point (default 10 -10 20)
+    -integrator name      Euler | RK4 | SymplecticEuler | Verlet | DOPRI5 | XPBD | ProjectiveDynamics
+                          (default RK4)
+    -dt dt -n n           timestep and draw every nth step (default 0.0005 1)
+    -threads t            worker threads used for the field (default: all cores)
+    -sparse T             store the random or zero grid as a sparse block grid of T^3 tiles, dropping the
+                          all-zero tiles ("forcefield sparse" extension line, base-format resolution 0)
+    -binary               write the binary world format instead of text
+
+  The random field is generated with a counter-based generator (random.h): the value at grid node m depends
+  only on the seed and m, so the grid is filled in parallel and the result does not depend on the thread count.
+  The analytic field types are written as "forcefield" extension lines and need no grid, so -resolution is
+  ignored for them.
 
 */
 
-#include <string.h>
-#include <stdio.h>
-#include <math.h>
-#include <stdlib.h>
-#include <time.h> // Include time.h for seeding the random number generator
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
-#define JELLO_SUBPOINTS 8
-#define JELLO_SUBDIVISIONS (JELLO_SUBPOINTS-1)
+#include "forceField.h"
+#include "parallel.h"
+#include "random.h"
+#include "worldFile.h"
 
-struct point
+static void usage()
 {
-   double x;
-   double y;
-   double z;
-};
+    printf("usage: createWorld [-resolution r] [-field random|zero|gravity|vortex|radial|wind] [-strength s]\n"
+           "                   [-seed n] [-size s] [-origin x y z] [-velocity vx vy vz]\n"
+           "                   [-integrator Euler|RK4|SymplecticEuler|Verlet|DOPRI5|XPBD|ProjectiveDynamics]\n"
+           "                   [-dt dt] [-n n] [-threads t] [-sparse T] [-binary] [output file]\n");
+    exit(1);
+}
 
-struct world
-{
-  char integrator[10]; // "RK4" or "Euler"
-  double dt; // timestep, e.g.. 0.001
-  int n; // display only every nth timestep
-  double kElastic; // Hook's elasticity coefficient for all springs except collision springs
-  double dElastic; // Damping coefficient for all springs except collision springs
-  double kCollision; // Hook's elasticity coefficient for collision springs
-  double dCollision; // Damping coefficient collision springs
-  double mass; // mass of each of the JELLO_SUBPOINTS^3 control points, mass assumed to be equal for every control point
-  int incPlanePresent; // Is the inclined plane present? 1 = YES, 0 = NO
-  double a,b,c,d; // inclined plane has equation a * x + b * y + c * z + d = 0; if no inclined plane, these four fields are not used
-  int resolution; // resolution for the 3d grid specifying the external force field; value of 0 means that there is no force field
-  struct point * forceField; // pointer to the array of values of the force field
-  struct point p[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS]; // position of the JELLO_SUBPOINTS^3 control points
-  struct point v[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS]; // velocities of the JELLO_SUBPOINTS^3 control points
-};
-
-
-/* writes the world parameters to a world file on disk*/
-/* fileName = string containing the name of the output world file, ex: jello1.w */
-/* function creates the output world file and then fills it corresponding to the contents
-   of structure 'jello' */
-/* function aborts the program if can't access the file */
-
-/* writes the world parameters to a world file on disk*/
-/* fileName = string containing the name of the output world file, ex: jello1.w */
-/* function creates the output world file and then fills it corresponding to the contents
-   of structure 'jello' */
-/* function aborts the program if can't access the file */
-void writeWorld(const char * fileName, struct world * jello)
+// fills the dense grid with independent uniform random vectors in [-strength, strength]^3
+static void generateRandomField(struct world* jello, unsigned long long seed, double strength)
 {
-  int i,j,k;
-  FILE * file;
+    int resolution = jello->resolution;
+    struct point* field = jello->forceField;
+
+    parallelFor(resolution, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            for (int j = 0; j < resolution; j++)
+                for (int k = 0; k < resolution; k++)
+                {
+                    int node = i * resolution * resolution + j * resolution + k;
+                    philoxBlock r = philox4x32(seed, (unsigned long long)node);
+                    field[node].x = randomSigned(r.v[0]) * strength;
+                    field[node].y = randomSigned(r.v[1]) * strength;
+                    field[node].z = randomSigned(r.v[2]) * strength;
+                }
+    });
+}
 
-  file = fopen(fileName, "w");
-  if (file == NULL) {
-    printf ("can't open file\n");
-    exit(1);
-  }
-
-  /* write integrator algorithm */
-  fprintf(file,"%s\n",jello->integrator);
-
-  /* write timestep */
-  fprintf(file,"%lf %d\n",jello->dt,jello->n);
-
-  /* write physical parameters */
-  fprintf(file, "%lf %lf %lf %lf\n",
-    jello->kElastic, jello->dElastic, jello->kCollision, jello->dCollision);
-
-  /* write mass */
-  fprintf(file, "%lf\n", jello->mass);
-
-  /* write info about the plane */
-  fprintf(file, "%d\n", jello->incPlanePresent);
-  if (jello->incPlanePresent == 1)
-    fprintf(file, "%lf %lf %lf %lf\n", jello->a, jello->b, jello->c, jello->d);
-
-  /* write info about the force field */
-  fprintf(file, "%d\n", jello->resolution);
-  if (jello->resolution != 0)
-    for (i=0; i<= jello->resolution-1; i++)
-      for (j=0; j<= jello->resolution-1; j++)
-        for (k=0; k<= jello->resolution-1; k++)
-          fprintf(file, "%lf %lf %lf\n",
-             jello->forceField[i * jello->resolution * jello->resolution + j * jello->resolution + k].x,
-             jello->forceField[i * jello->resolution * jello->resolution + j * jello->resolution + k].y,
-             jello->forceField[i * jello->resolution * jello->resolution + j * jello->resolution + k].z);
-
-
-  /* write initial point positions */
-  for (i = 0; i <= JELLO_SUBDIVISIONS; i++)
-  {
-    for (j = 0; j <= JELLO_SUBDIVISIONS; j++)
+int main(int argc, char** argv)
+{
+    struct world jello;
+    int i, j, k;
+
+    const char* fileName = "jello.w";
+    const char* fieldType = "random";
+    int resolution = 30;
+    double strength = 20.0;
+    unsigned long long seed = 1;
+    double size = 1.0;
+    struct point origin = {0.0, 0.0, 0.0};
+    struct point velocity = {10.0, -10.0, 20.0};
+    int binary = 0;
+    int tileSize = 0;
+
+    memset(&jello, 0, sizeof(jello));
+
+    // set the integrator and the physical parameters
+    strcpy(jello.integrator, "RK4");
+    jello.dt = 0.0005000;
+    jello.n = 1;
+    jello.kElastic = 200;
+    jello.dElastic = 0.25;
+    jello.kCollision = 400.0;
+    jello.dCollision = 0.25;
+    jello.mass = 1.0 / 512;
+
+    // set the inclined plane (not used in this assignment; ignore)
+    jello.incPlanePresent = 1;
+    jello.a = -1;
+    jello.b = 1;
+    jello.c = 1;
+    jello.d = 2;
+
+    for (int arg = 1; arg < argc; arg++)
     {
-      for (k = 0; k <= JELLO_SUBDIVISIONS; k++)
-        fprintf(file, "%lf %lf %lf\n",
-          jello->p[i][j][k].x, jello->p[i][j][k].y, jello->p[i][j][k].z);
+        const char* option = argv[arg];
+        int remaining = argc - arg - 1;
+
+        if (strcmp(option, "-resolution") == 0 && remaining >= 1)
+            resolution = atoi(argv[++arg]);
+        else if (strcmp(option, "-field") == 0 && remaining >= 1)
+            fieldType = argv[++arg];
+        else if (strcmp(option, "-strength") == 0 && remaining >= 1)
+            strength = atof(argv[++arg]);
+        else if (strcmp(option, "-seed") == 0 && remaining >= 1)
+            seed = strtoull(argv[++arg], NULL, 10);
+        else if (strcmp(option, "-size") == 0 && remaining >= 1)
+            size = atof(argv[++arg]);
+        else if (strcmp(option, "-origin") == 0 && remaining >= 3)
+        {
+            origin.x = atof(argv[++arg]);
+            origin.y = atof(argv[++arg]);
+            origin.z = atof(argv[++arg]);
+        }
+        else if (strcmp(option, "-velocity") == 0 && remaining >= 3)
+        {
+            velocity.x = atof(argv[++arg]);
+            velocity.y = atof(argv[++arg]);
+            velocity.z = atof(argv[++arg]);
+        }
+        else if (strcmp(option, "-integrator") == 0 && remaining >= 1)
+        {
+            strncpy(jello.integrator, argv[++arg], sizeof(jello.integrator) - 1);
+            jello.integrator[sizeof(jello.integrator) - 1] = 0;
+        }
+        else if (strcmp(option, "-dt") == 0 && remaining >= 1)
+            jello.dt = atof(argv[++arg]);
+        else if (strcmp(option, "-n") == 0 && remaining >= 1)
+            jello.n = atoi(argv[++arg]);
+        else if (strcmp(option, "-threads") == 0 && remaining >= 1)
+            setParallelThreadCount(atoi(argv[++arg]));
+        else if (strcmp(option, "-sparse") == 0 && remaining >= 1)
+            tileSize = atoi(argv[++arg]);
+        else if (strcmp(option, "-binary") == 0)
+            binary = 1;
+        else if (option[0] == '-')
+            usage();
+        else
+            fileName = option;
     }
-  }
 
-  /* write initial point velocities */
-  for (i = 0; i <= JELLO_SUBDIVISIONS; i++)
-  {
-    for (j = 0; j <= JELLO_SUBDIVISIONS; j++)
+    if (resolution < 0 || resolution == 1 || size <= 0.0 || tileSize < 0)
     {
-      for (k = 0; k <= JELLO_SUBDIVISIONS; k++)
-        fprintf(file, "%lf %lf %lf\n",
-          jello->v[i][j][k].x, jello->v[i][j][k].y, jello->v[i][j][k].z);
+        printf("resolution must be 0 or at least 2, and size and tile size must be positive\n");
+        exit(1);
     }
-  }
 
-  fclose(file);
+    auto start = std::chrono::steady_clock::now();
 
-  return;
-}
+    // set the external force field
+    jello.resolution = 0;
+    jello.forceField = NULL;
+    jello.field = NULL;
+    if (strcmp(fieldType, "random") == 0 || strcmp(fieldType, "zero") == 0)
+    {
+        jello.resolution = resolution;
+        jello.forceField = (struct point*)calloc((size_t)resolution * resolution * resolution, sizeof(struct point));
+        if (strcmp(fieldType, "random") == 0)
+            generateRandomField(&jello, seed, strength);
 
-/* modify main to create your own world */
-int main()
-{
-  struct world jello;
-  int i,j,k;
-  double x,y,z;
-
-  // set the integrator and the physical parameters
-  // the values below are EXAMPLES, to be modified by you as needed
-  strcpy(jello.integrator,"RK4");
-  jello.dt=0.0005000;
-  jello.n=1;
-  jello.kElastic=200;
-  jello.dElastic=0.25;
-  jello.kCollision=400.0;
-  jello.dCollision=0.25;
-  jello.mass= 1.0 / 512;
-
-  // set the inclined plane (not used in this assignment; ignore)
-  jello.incPlanePresent=1;
-  jello.a=-1;
-  jello.b=1;
-  jello.c=1;
-  jello.d=2;
-
-  // set the external force field
-  jello.resolution=30;
-  jello.forceField =
-    (struct point *)malloc(jello.resolution*jello.resolution*jello.resolution*sizeof(struct point));
-  
-  // Seed random number generator
-  srand(time(NULL));
-  
-  for (i=0; i<= jello.resolution-1; i++)
-    for (j=0; j<= jello.resolution-1; j++)
-      for (k=0; k<= jello.resolution-1; k++)
-      {
-        // set the force at node i,j,k
-        // actual space location = x,y,z
-        x = -2 + 4*(1.0 * i / (jello.resolution-1));
-        y = -2 + 4*(1.0 * j / (jello.resolution-1));
-        z = -2 + 4*(1.0 * k / (jello.resolution-1));
-
-        // Random force field
-        double strength = 20.0;  // Adjust this to control force magnitude
-        
-        // Generate random numbers in range [-1, 1]
-        double randomX = (2.0 * rand() / RAND_MAX) - 1.0;
-        double randomY = (2.0 * rand() / RAND_MAX) - 1.0;
-        double randomZ = (2.0 * rand() / RAND_MAX) - 1.0;
-        
-        double forceX = randomX * strength;
-        double forceY = randomY * strength;
-        double forceZ = randomZ * strength;
-
-        jello.forceField[i * jello.resolution * jello.resolution
-          + j * jello.resolution + k].x = forceX;
-        jello.forceField[i * jello.resolution * jello.resolution
-          + j * jello.resolution + k].y = forceY;
-        jello.forceField[i * jello.resolution * jello.resolution
-          + j * jello.resolution + k].z = forceZ;
-      }
-
-  // set the positions of control points
-  for (i=0; i<=JELLO_SUBDIVISIONS; i++)
-    for (j=0; j<=JELLO_SUBDIVISIONS; j++)
-      for (k=0; k<=JELLO_SUBDIVISIONS; k++)
-      {
-        jello.p[i][j][k].x=1.0 * i / JELLO_SUBDIVISIONS;
-        jello.p[i][j][k].y=1.0 * j / JELLO_SUBDIVISIONS;
-        jello.p[i][j][k].z=1.0 * k / JELLO_SUBDIVISIONS;
-        if ((i==JELLO_SUBDIVISIONS) && (j==JELLO_SUBDIVISIONS) && (k==JELLO_SUBDIVISIONS))
+        if (tileSize > 0 && resolution > 0)
         {
-          jello.p[i][j][k].x=1.0 + 1.0 / JELLO_SUBDIVISIONS;
-          jello.p[i][j][k].y=1.0 + 1.0 / JELLO_SUBDIVISIONS;
-          jello.p[i][j][k].z=1.0 + 1.0 / JELLO_SUBDIVISIONS;
+            jello.field = createSparseForceField(jello.forceField, resolution, tileSize);
+            free(jello.forceField);
+            jello.forceField = NULL;
+            jello.resolution = 0;
         }
-      }
-
-  // set the velocities of control points
-  for (i=0; i<=JELLO_SUBDIVISIONS; i++)
-    for (j=0; j<=JELLO_SUBDIVISIONS; j++)
-      for (k=0; k<=JELLO_SUBDIVISIONS; k++)
-      {
-        jello.v[i][j][k].x=10.0;
-        jello.v[i][j][k].y=-10.0;
-        jello.v[i][j][k].z=20.0;
-      }
-
-  // write the jello variable out to file on disk
-  // change jello.w to whatever you need
-  writeWorld("jello.w",&jello);
-
-  return 0;
-}
+    }
+    else
+    {
+        // analytic fields are centred on the cube
+        struct point center = {origin.x + 0.5 * size, origin.y + 0.5 * size, origin.z + 0.5 * size};
+        struct point up = {0.0, 0.0, 1.0};
+        struct point down = {0.0, 0.0, -strength}; // gravity: strength is the acceleration
+
+        if (strcmp(fieldType, "gravity") == 0)
+            jello.field = createGravityForceField(down, jello.mass);
+        else if (strcmp(fieldType, "vortex") == 0)
+            jello.field = createVortexForceField(center, up, strength, size);
+        else if (strcmp(fieldType, "radial") == 0)
+            jello.field = createRadialForceField(center, -strength, size);
+        else if (strcmp(fieldType, "wind") == 0)
+        {
+            struct point direction = {1.0, 0.0, 0.0};
+            jello.field = createWindForceField(direction, strength, 0.5, 1.0);
+        }
+        else
+            usage();
+    }
 
+    auto generated = std::chrono::steady_clock::now();
+
+    // set the positions of control points
+    for (i = 0; i <= JELLO_SUBDIVISIONS; i++)
+        for (j = 0; j <= JELLO_SUBDIVISIONS; j++)
+            for (k = 0; k <= JELLO_SUBDIVISIONS; k++)
+            {
+                jello.p[i][j][k].x = origin.x + size * i / JELLO_SUBDIVISIONS;
+                jello.p[i][j][k].y = origin.y + size * j / JELLO_SUBDIVISIONS;
+                jello.p[i][j][k].z = origin.z + size * k / JELLO_SUBDIVISIONS;
+                if ((i == JELLO_SUBDIVISIONS) && (j == JELLO_SUBDIVISIONS) && (k == JELLO_SUBDIVISIONS))
+                {
+                    // pull one corner out so the cube starts with some deformation
+                    jello.p[i][j][k].x = origin.x + size * (1.0 + 1.0 / JELLO_SUBDIVISIONS);
+                    jello.p[i][j][k].y = origin.y + size * (1.0 + 1.0 / JELLO_SUBDIVISIONS);
+                    jello.p[i][j][k].z = origin.z + size * (1.0 + 1.0 / JELLO_SUBDIVISIONS);
+                }
+            }
+
+    // set the velocities of control points
+    for (i = 0; i <= JELLO_SUBDIVISIONS; i++)
+        for (j = 0; j <= JELLO_SUBDIVISIONS; j++)
+            for (k = 0; k <= JELLO_SUBDIVISIONS; k++)
+                jello.v[i][j][k] = velocity;
+
+    // write the jello variable out to file on disk
+    if (binary)
+        writeWorldBinary(fileName, &jello);
+    else
+        writeWorld(fileName, &jello);
+
+    auto written = std::chrono::steady_clock::now();
+
+    printf("%s: %s field, resolution %d, seed %llu, %d threads; generated in %.1f ms, written in %.1f ms\n", fileName,
+           fieldType, jello.resolution, seed, parallelThreadCount(),
+           std::chrono::duration<double, std::milli>(generated - start).count(),
+           std::chrono::duration<double, std::milli>(written - generated).count());
+
+    return 0;
+}
@@ -0,0 +1,453 @@
+#include "ensemble.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "collision.h"
+#include "forceField.h"
+#include "kinematics.h"
+#include "obstacle.h"
+#include "parallel.h"
+#include "perfCounters.h"
+#include "selfCollision.h"
+#include "simd.h"
+
+#define NUM_PARTICLES (JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS)
+
+// Lane vectors: ENSEMBLE_LANES doubles, one per world of a block.
+// One AVX register, two SSE2 registers, or a plain array the compiler may vectorize on its own.
+static_assert(ENSEMBLE_LANES == 4, "the lane vectors below hold exactly 4 worlds");
+
+#if JELLO_SIMD_AVX
+typedef __m256d lanes;
+static inline lanes laneLoad(const double* x) { return _mm256_load_pd(x); }
+static inline void laneStore(double* x, lanes a) { _mm256_store_pd(x, a); }
+static inline lanes laneSet(double s) { return _mm256_set1_pd(s); }
+static inline lanes laneAdd(lanes a, lanes b) { return _mm256_add_pd(a, b); }
+static inline lanes laneSub(lanes a, lanes b) { return _mm256_sub_pd(a, b); }
+static inline lanes laneMul(lanes a, lanes b) { return _mm256_mul_pd(a, b); }
+static inline lanes laneDiv(lanes a, lanes b) { return _mm256_div_pd(a, b); }
+static inline lanes laneSqrt(lanes a) { return _mm256_sqrt_pd(a); }
+static inline lanes laneMax(lanes a, lanes b) { return _mm256_max_pd(a, b); }
+static inline lanes laneAbs(lanes a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+// b in the lanes where a > threshold, 0 elsewhere
+static inline lanes laneIfGreater(lanes a, lanes threshold, lanes b)
+{
+    return _mm256_and_pd(_mm256_cmp_pd(a, threshold, _CMP_GT_OQ), b);
+}
+#elif JELLO_SIMD_SSE2
+struct lanes
+{
+    __m128d lo, hi;
+};
+static inline lanes laneLoad(const double* x) { return {_mm_load_pd(x), _mm_load_pd(x + 2)}; }
+static inline void laneStore(double* x, lanes a) { _mm_store_pd(x, a.lo), _mm_store_pd(x + 2, a.hi); }
+static inline lanes laneSet(double s) { return {_mm_set1_pd(s), _mm_set1_pd(s)}; }
+static inline lanes laneAdd(lanes a, lanes b) { return {_mm_add_pd(a.lo, b.lo), _mm_add_pd(a.hi, b.hi)}; }
+static inline lanes laneSub(lanes a, lanes b) { return {_mm_sub_pd(a.lo, b.lo), _mm_sub_pd(a.hi, b.hi)}; }
+static inline lanes laneMul(lanes a, lanes b) { return {_mm_mul_pd(a.lo, b.lo), _mm_mul_pd(a.hi, b.hi)}; }
+static inline lanes laneDiv(lanes a, lanes b) { return {_mm_div_pd(a.lo, b.lo), _mm_div_pd(a.hi, b.hi)}; }
+static inline lanes laneSqrt(lanes a) { return {_mm_sqrt_pd(a.lo), _mm_sqrt_pd(a.hi)}; }
+static inline lanes laneMax(lanes a, lanes b) { return {_mm_max_pd(a.lo, b.lo), _mm_max_pd(a.hi, b.hi)}; }
+static inline lanes laneAbs(lanes a)
+{
+    __m128d sign = _mm_set1_pd(-0.0);
+    return {_mm_andnot_pd(sign, a.lo), _mm_andnot_pd(sign, a.hi)};
+}
+static inline lanes laneIfGreater(lanes a, lanes threshold, lanes b)
+{
+    return {_mm_and_pd(_mm_cmpgt_pd(a.lo, threshold.lo), b.lo), _mm_and_pd(_mm_cmpgt_pd(a.hi, threshold.hi), b.hi)};
+}
+#else
+struct lanes
+{
+    double x[ENSEMBLE_LANES];
+};
+#define LANE_LOOP(expression)                                                                                          \
+    lanes r;                                                                                                           \
+    for (int l = 0; l < ENSEMBLE_LANES; l++)                                                                           \
+        r.x[l] = expression;                                                                                           \
+    return r;
+static inline lanes laneLoad(const double* x) { LANE_LOOP(x[l]) }
+static inline void laneStore(double* x, lanes a) { memcpy(x, a.x, sizeof(a.x)); }
+static inline lanes laneSet(double s) { LANE_LOOP(s) }
+static inline lanes laneAdd(lanes a, lanes b) { LANE_LOOP(a.x[l] + b.x[l]) }
+static inline lanes laneSub(lanes a, lanes b) { LANE_LOOP(a.x[l] - b.x[l]) }
+static inline lanes laneMul(lanes a, lanes b) { LANE_LOOP(a.x[l] * b.x[l]) }
+static inline lanes laneDiv(lanes a, lanes b) { LANE_LOOP(a.x[l] / b.x[l]) }
+static inline lanes laneSqrt(lanes a) { LANE_LOOP(sqrt(a.x[l])) }
+static inline lanes laneMax(lanes a, lanes b) { LANE_LOOP(a.x[l] > b.x[l] ? a.x[l] : b.x[l]) }
+static inline lanes laneAbs(lanes a) { LANE_LOOP(fabs(a.x[l])) }
+static inline lanes laneIfGreater(lanes a, lanes threshold, lanes b) { LANE_LOOP(a.x[l] > threshold.x[l] ? b.x[l] : 0.0) }
+#undef LANE_LOOP
+#endif
+
+// state of ENSEMBLE_LANES worlds; x[particle][axis][lane]
+struct Ensemble::block
+{
+    alignas(32) double p[NUM_PARTICLES][3][ENSEMBLE_LANES];
+    alignas(32) double v[NUM_PARTICLES][3][ENSEMBLE_LANES];
+    alignas(32) double a[NUM_PARTICLES][3][ENSEMBLE_LANES];
+
+    // RK4 stage state and the weighted sums of the stage derivatives
+    alignas(32) double stageP[NUM_PARTICLES][3][ENSEMBLE_LANES];
+    alignas(32) double stageV[NUM_PARTICLES][3][ENSEMBLE_LANES];
+    alignas(32) double sumP[NUM_PARTICLES][3][ENSEMBLE_LANES];
+    alignas(32) double sumV[NUM_PARTICLES][3][ENSEMBLE_LANES];
+
+    alignas(32) double kElastic[ENSEMBLE_LANES];
+    alignas(32) double dElastic[ENSEMBLE_LANES];
+    alignas(32) double maxStrain[ENSEMBLE_LANES];
+    double kCollision[ENSEMBLE_LANES];
+    double dCollision[ENSEMBLE_LANES];
+
+    int first; // variant in lane 0
+    int lanes; // lanes holding a variant; the rest repeat the last variant to fill the vectors
+    SelfCollision* selfCollision[ENSEMBLE_LANES];
+
+    // one lane unpacked for the per-world collision and force-field code
+    struct point laneP[NUM_PARTICLES];
+    struct point laneV[NUM_PARTICLES];
+    struct point laneForce[NUM_PARTICLES];
+};
+
+Ensemble::Ensemble(const struct world* jello, const std::vector<ensembleParameters>& variants)
+    : m_world(jello), m_variants(variants), m_step(&Ensemble::rk4), m_time(jello->time)
+{
+    if (jello->material != NULL)
+    {
+        printf("ensemble: the variants replace the world's kElastic and dElastic, so a world with stiffness or mass "
+               "lines can't be swept\n");
+        exit(1);
+    }
+    if (jello->kinematics != NULL)
+    {
+        printf("ensemble: pin and drive lines are not supported; the variants would move the kinematic points\n");
+        exit(1);
+    }
+
+    if (strcmp(jello->integrator, "Euler") == 0)
+        m_step = &Ensemble::euler;
+    else if (strcmp(jello->integrator, "SymplecticEuler") == 0)
+        m_step = &Ensemble::symplecticEuler;
+    else if (strcmp(jello->integrator, "Verlet") == 0)
+        m_step = &Ensemble::verlet;
+
+    buildSpringList(&m_springs);
+
+    const struct point* p = &jello->p[0][0][0];
+    const struct point* v = &jello->v[0][0][0];
+
+    for (int first = 0; first < variantCount(); first += ENSEMBLE_LANES)
+    {
+        block* b = new block;
+        b->first = first;
+        b->lanes = variantCount() - first < ENSEMBLE_LANES ? variantCount() - first : ENSEMBLE_LANES;
+
+        for (int l = 0; l < ENSEMBLE_LANES; l++)
+        {
+            const ensembleParameters& parameters = m_variants[first + (l < b->lanes ? l : b->lanes - 1)];
+            b->kElastic[l] = parameters.kElastic;
+            b->dElastic[l] = parameters.dElastic;
+            b->kCollision[l] = parameters.kCollision;
+            b->dCollision[l] = parameters.dCollision;
+            b->maxStrain[l] = 0.0;
+            b->selfCollision[l] =
+                jello->selfCollision != NULL && l < b->lanes ? new SelfCollision(jello->selfCollision->thickness()) : NULL;
+
+            for (int n = 0; n < NUM_PARTICLES; n++)
+            {
+                b->p[n][0][l] = p[n].x, b->p[n][1][l] = p[n].y, b->p[n][2][l] = p[n].z;
+                b->v[n][0][l] = v[n].x, b->v[n][1][l] = v[n].y, b->v[n][2][l] = v[n].z;
+            }
+        }
+
+        m_blocks.push_back(b);
+    }
+}
+
+Ensemble::~Ensemble()
+{
+    for (block* b : m_blocks)
+    {
+        for (int l = 0; l < ENSEMBLE_LANES; l++)
+        {
+            delete b->selfCollision[l];
+        }
+        delete b;
+    }
+}
+
+void Ensemble::computeAcceleration(block* b, const double (*p)[3][ENSEMBLE_LANES],
+                                   const double (*v)[3][ENSEMBLE_LANES], double t, bool measureStrain)
+{
+    double(*a)[3][ENSEMBLE_LANES] = b->a;
+    memset(a, 0, sizeof(b->a));
+
+    // springs, all lanes at once; same force as computeSpringForce, applied to both ends
+    const lanes k = laneLoad(b->kElastic);
+    const lanes d = laneLoad(b->dElastic);
+    const lanes tiny = laneSet(1e-8);
+    lanes maxStrain = laneLoad(b->maxStrain);
+
+    for (int s = 0; s < m_springs.count(); s++)
+    {
+        const int i = m_springs.a[s], j = m_springs.b[s];
+        const lanes rest = laneSet(m_springs.rest[s]);
+
+        lanes lx = laneSub(laneLoad(p[i][0]), laneLoad(p[j][0]));
+        lanes ly = laneSub(laneLoad(p[i][1]), laneLoad(p[j][1]));
+        lanes lz = laneSub(laneLoad(p[i][2]), laneLoad(p[j][2]));
+        lanes length = laneSqrt(laneAdd(laneAdd(laneMul(lx, lx), laneMul(ly, ly)), laneMul(lz, lz)));
+
+        // a collapsed spring has no direction and exerts no force
+        lanes inverseLength = laneIfGreater(length, tiny, laneDiv(laneSet(1.0), length));
+        lanes ux = laneMul(lx, inverseLength);
+        lanes uy = laneMul(ly, inverseLength);
+        lanes uz = laneMul(lz, inverseLength);
+
+        lanes vn = laneAdd(laneAdd(laneMul(laneSub(laneLoad(v[i][0]), laneLoad(v[j][0])), ux),
+                                   laneMul(laneSub(laneLoad(v[i][1]), laneLoad(v[j][1])), uy)),
+                           laneMul(laneSub(laneLoad(v[i][2]), laneLoad(v[j][2])), uz));
+
+        // -k (length - rest) - d (v1 - v2).u, along u
+        lanes magnitude = laneSub(laneMul(k, laneSub(rest, length)), laneMul(d, vn));
+        lanes fx = laneMul(magnitude, ux);
+        lanes fy = laneMul(magnitude, uy);
+        lanes fz = laneMul(magnitude, uz);
+
+        laneStore(a[i][0], laneAdd(laneLoad(a[i][0]), fx));
+        laneStore(a[i][1], laneAdd(laneLoad(a[i][1]), fy));
+        laneStore(a[i][2], laneAdd(laneLoad(a[i][2]), fz));
+        laneStore(a[j][0], laneSub(laneLoad(a[j][0]), fx));
+        laneStore(a[j][1], laneSub(laneLoad(a[j][1]), fy));
+        laneStore(a[j][2], laneSub(laneLoad(a[j][2]), fz));
+
+        if (measureStrain)
+        {
+            maxStrain = laneMax(maxStrain, laneMul(laneAbs(laneSub(length, rest)), laneSet(1.0 / m_springs.rest[s])));
+        }
+    }
+
+    laneStore(b->maxStrain, maxStrain);
+
+    // force field and collisions, one world at a time through the regular code
+    const struct world* jello = m_world;
+    const int* all;
+    const int particleCount = freePoints(jello, &all); // all of them: the constructor rejects kinematic points
+    if (jello->field != NULL || jello->planes != NULL || jello->obstacles != NULL || jello->selfCollision != NULL)
+    {
+        for (int l = 0; l < b->lanes; l++)
+        {
+            for (int n = 0; n < NUM_PARTICLES; n++)
+            {
+                b->laneP[n].x = p[n][0][l], b->laneP[n].y = p[n][1][l], b->laneP[n].z = p[n][2][l];
+                b->laneV[n].x = v[n][0][l], b->laneV[n].y = v[n][1][l], b->laneV[n].z = v[n][2][l];
+                b->laneForce[n].x = b->laneForce[n].y = b->laneForce[n].z = 0.0;
+            }
+
+            if (jello->field != NULL)
+            {
+                // particle -1: the field is shared by all blocks, so its per-particle cache can't be used
+                for (int n = 0; n < NUM_PARTICLES; n++)
+                {
+                    jello->field->addForce(-1, b->laneP[n], t, &b->laneForce[n]);
+                }
+            }
+            if (jello->planes != NULL)
+            {
+                jello->planes->addForces(b->laneP, b->laneV, all, particleCount, b->kCollision[l],
+                                         b->dCollision[l], b->laneForce);
+            }
+            if (jello->obstacles != NULL)
+            {
+                jello->obstacles->addForces(b->laneP, b->laneV, all, particleCount, b->kCollision[l],
+                                            b->dCollision[l], b->laneForce);
+            }
+            if (b->selfCollision[l] != NULL)
+            {
+                b->selfCollision[l]->addForces(b->laneP, b->laneV, b->kCollision[l], b->dCollision[l], b->laneForce);
+            }
+
+            for (int n = 0; n < NUM_PARTICLES; n++)
+            {
+                a[n][0][l] += b->laneForce[n].x;
+                a[n][1][l] += b->laneForce[n].y;
+                a[n][2][l] += b->laneForce[n].z;
+            }
+        }
+    }
+
+    // forces to accelerations
+    double* flat = &a[0][0][0];
+    const double inverseMass = 1.0 / jello->mass;
+    for (int n = 0; n < NUM_PARTICLES * 3 * ENSEMBLE_LANES; n++)
+    {
+        flat[n] *= inverseMass;
+    }
+}
+
+void Ensemble::euler(block* b)
+{
+    const double dt = m_world->dt;
+
+    computeAcceleration(b, b->p, b->v, m_time, true);
+
+    double* p = &b->p[0][0][0];
+    double* v = &b->v[0][0][0];
+    const double* a = &b->a[0][0][0];
+    for (int n = 0; n < NUM_PARTICLES * 3 * ENSEMBLE_LANES; n++)
+    {
+        p[n] += dt * v[n];
+        v[n] += dt * a[n];
+    }
+}
+
+void Ensemble::symplecticEuler(block* b)
+{
+    const double dt = m_world->dt;
+
+    computeAcceleration(b, b->p, b->v, m_time, true);
+
+    double* p = &b->p[0][0][0];
+    double* v = &b->v[0][0][0];
+    const double* a = &b->a[0][0][0];
+    for (int n = 0; n < NUM_PARTICLES * 3 * ENSEMBLE_LANES; n++)
+    {
+        v[n] += dt * a[n];
+        p[n] += dt * v[n];
+    }
+}
+
+// same drift-kick-drift scheme as Verlet() in physics.cpp
+void Ensemble::verlet(block* b)
+{
+    const double dt = m_world->dt;
+
+    double* p = &b->p[0][0][0];
+    double* v = &b->v[0][0][0];
+    const double* a = &b->a[0][0][0];
+    for (int n = 0; n < NUM_PARTICLES * 3 * ENSEMBLE_LANES; n++)
+    {
+        p[n] += 0.5 * dt * v[n];
+    }
+
+    computeAcceleration(b, b->p, b->v, m_time + 0.5 * dt, true);
+
+    for (int n = 0; n < NUM_PARTICLES * 3 * ENSEMBLE_LANES; n++)
+    {
+        v[n] += dt * a[n];
+        p[n] += 0.5 * dt * v[n];
+    }
+}
+
+// same scheme as RK4() in physics.cpp; the stage derivatives are summed as they are produced instead of being kept
+void Ensemble::rk4(block* b)
+{
+    const int count = NUM_PARTICLES * 3 * ENSEMBLE_LANES;
+    const double dt = m_world->dt;
+
+    double* p = &b->p[0][0][0];
+    double* v = &b->v[0][0][0];
+    const double* a = &b->a[0][0][0];
+    double* stageP = &b->stageP[0][0][0];
+    double* stageV = &b->stageV[0][0][0];
+    double* sumP = &b->sumP[0][0][0];
+    double* sumV = &b->sumV[0][0][0];
+
+    computeAcceleration(b, b->p, b->v, m_time, true);
+    for (int n = 0; n < count; n++)
+    {
+        sumP[n] = v[n];
+        sumV[n] = a[n];
+        stageP[n] = p[n] + 0.5 * dt * v[n];
+        stageV[n] = v[n] + 0.5 * dt * a[n];
+    }
+
+    computeAcceleration(b, b->stageP, b->stageV, m_time + 0.5 * dt, false);
+    for (int n = 0; n < count; n++)
+    {
+        sumP[n] += 2.0 * stageV[n];
+        sumV[n] += 2.0 * a[n];
+        stageP[n] = p[n] + 0.5 * dt * stageV[n];
+        stageV[n] = v[n] + 0.5 * dt * a[n];
+    }
+
+    computeAcceleration(b, b->stageP, b->stageV, m_time + 0.5 * dt, false);
+    for (int n = 0; n < count; n++)
+    {
+        sumP[n] += 2.0 * stageV[n];
+        sumV[n] += 2.0 * a[n];
+        stageP[n] = p[n] + dt * stageV[n];
+        stageV[n] = v[n] + dt * a[n];
+    }
+
+    computeAcceleration(b, b->stageP, b->stageV, m_time + dt, false);
+    for (int n = 0; n < count; n++)
+    {
+        p[n] += dt / 6 * (sumP[n] + stageV[n]);
+        v[n] += dt / 6 * (sumV[n] + a[n]);
+    }
+}
+
+void Ensemble::step()
+{
+    parallelFor((int)m_blocks.size(), [&](int begin, int end) {
+        for (int b = begin; b < end; b++)
+        {
+            PERF_REGION("ensemble block");
+            (this->*m_step)(m_blocks[b]);
+        }
+    });
+
+    m_time += m_world->dt;
+}
+
+ensembleSummary Ensemble::summary(int v) const
+{
+    const block* b = m_blocks[v / ENSEMBLE_LANES];
+    const int l = v % ENSEMBLE_LANES;
+
+    ensembleSummary result;
+    result.centerOfMass.x = result.centerOfMass.y = result.centerOfMass.z = 0.0;
+    result.maxSpeed = 0.0;
+    result.maxStrain = b->maxStrain[l];
+
+    bool finite = isfinite(result.maxStrain);
+    for (int n = 0; n < NUM_PARTICLES; n++)
+    {
+        result.centerOfMass.x += b->p[n][0][l];
+        result.centerOfMass.y += b->p[n][1][l];
+        result.centerOfMass.z += b->p[n][2][l];
+
+        double speed = sqrt(b->v[n][0][l] * b->v[n][0][l] + b->v[n][1][l] * b->v[n][1][l] +
+                            b->v[n][2][l] * b->v[n][2][l]);
+        finite = finite && isfinite(speed) && isfinite(b->p[n][0][l]) && isfinite(b->p[n][1][l]) &&
+                 isfinite(b->p[n][2][l]);
+        result.maxSpeed = speed > result.maxSpeed ? speed : result.maxSpeed;
+    }
+
+    result.centerOfMass.x /= NUM_PARTICLES;
+    result.centerOfMass.y /= NUM_PARTICLES;
+    result.centerOfMass.z /= NUM_PARTICLES;
+    result.stable = finite && result.maxStrain < ENSEMBLE_UNSTABLE_STRAIN;
+
+    return result;
+}
+
+void Ensemble::getState(int v, struct world* jello) const
+{
+    const block* b = m_blocks[v / ENSEMBLE_LANES];
+    const int l = v % ENSEMBLE_LANES;
+
+    struct point* p = &jello->p[0][0][0];
+    struct point* velocity = &jello->v[0][0][0];
+    for (int n = 0; n < NUM_PARTICLES; n++)
+    {
+        p[n].x = b->p[n][0][l], p[n].y = b->p[n][1][l], p[n].z = b->p[n][2][l];
+        velocity[n].x = b->v[n][0][l], velocity[n].y = b->v[n][1][l], velocity[n].z = b->v[n][2][l];
+    }
+    jello->time = m_time;
+}
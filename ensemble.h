@@ -0,0 +1,89 @@
+#ifndef _ENSEMBLE_H_
+#define _ENSEMBLE_H_
+
+#include <vector>
+
+#include "springs.h"
+#include "world.h"
+
+class SelfCollision;
+
+// number of worlds simulated side by side in one block; one SIMD lane per world (4 doubles = one AVX register)
+#define ENSEMBLE_LANES 4
+
+// the parameters that may differ between the variants of an ensemble
+struct ensembleParameters
+{
+    double kElastic;
+    double dElastic;
+    double kCollision;
+    double dCollision;
+};
+
+// what a parameter sweep wants to know about a variant after the run
+struct ensembleSummary
+{
+    struct point centerOfMass;
+    double maxSpeed;  // fastest control point at the end of the run
+    double maxStrain; // largest |length - rest| / rest over all springs and all steps
+    int stable;       // 1 if every value stayed finite and maxStrain stayed below ENSEMBLE_UNSTABLE_STRAIN
+};
+
+// a spring stretched to 5x its rest length means the integration has blown up; well above the initial
+// deformation of the createWorld cubes (the pulled corner strains one spring by about 1.45)
+#define ENSEMBLE_UNSTABLE_STRAIN 4.0
+
+// Many copies of one world that differ only in their ensembleParameters, stepped together.
+//
+// The variants are grouped into blocks of ENSEMBLE_LANES. A block stores its state array-of-structures-of-arrays:
+// for every particle and axis, the values of the ENSEMBLE_LANES worlds are adjacent, so the spring kernel loads
+// one vector per particle coordinate and evaluates the same spring in all worlds of the block at once. Every spring
+// is evaluated once and applied to both ends. Force fields, collision planes, obstacles and self-collision are
+// evaluated per world through the regular (scalar) code paths; they are cheap next to the springs.
+// Blocks are independent and run in parallel with parallelFor.
+//
+// The integrator is the world's (Euler, RK4, SymplecticEuler or Verlet; unknown names use RK4, as in stepWorld).
+// DOPRI5, XPBD and ProjectiveDynamics also run as RK4 at dt: adaptive substeps differ per variant, which lockstep
+// lanes can't follow, and the last two are different solvers altogether.
+// externalForce is ignored. Worlds with a material (material.h) are rejected: the variants sweep the uniform
+// kElastic and dElastic, which a material overrides per spring. So are worlds with kinematic points
+// (kinematics.h), which the lockstep lanes don't hold on their path.
+class Ensemble
+{
+public:
+    // the ensemble keeps pointers to jello's force field, planes and obstacles; jello must outlive it
+    // prints why and exits if jello has a material or kinematic points
+    Ensemble(const struct world* jello, const std::vector<ensembleParameters>& variants);
+    ~Ensemble();
+
+    int variantCount() const { return (int)m_variants.size(); }
+    const ensembleParameters& variant(int v) const { return m_variants[v]; }
+    double time() const { return m_time; }
+
+    // advances every variant by one timestep
+    void step();
+
+    ensembleSummary summary(int v) const;
+
+    // copies the positions and velocities of variant v into jello
+    void getState(int v, struct world* jello) const;
+
+private:
+    struct block;
+
+    void computeAcceleration(block* b, const double (*p)[3][ENSEMBLE_LANES], const double (*v)[3][ENSEMBLE_LANES],
+                             double t, bool measureStrain);
+    void euler(block* b);
+    void rk4(block* b);
+    void symplecticEuler(block* b);
+    void verlet(block* b);
+
+    const struct world* m_world;
+    std::vector<ensembleParameters> m_variants;
+    std::vector<block*> m_blocks;
+    springList m_springs;
+    void (Ensemble::*m_step)(block* b);
+    double m_time;
+};
+
+#endif // #ifndef _ENSEMBLE_H_
@@ -0,0 +1,646 @@
+#include "forceField.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "simd.h"
+
+#define NUM_PARTICLES (JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS)
+
+// Grid-backed fields are defined on the [-2,2]^3 bounding box. Node (i, j, k) sits at
+// (-2 + 4i/(r-1), -2 + 4j/(r-1), -2 + 4k/(r-1)) and is stored at i * r * r + j * r + k (see createWorld.cpp).
+// Outside the box the field is clamped to its value on the nearest face.
+static inline double toGrid(double x, double worldToGrid, int resolution)
+{
+    double g = (x + 2.0) * worldToGrid;
+    double gMax = resolution - 1;
+    return g >= 0.0 ? (g < gMax ? g : gMax) : 0.0; // a NaN position (a blown-up simulation) maps to 0, not out of the grid
+}
+
+static inline double length(double x, double y, double z)
+{
+    return sqrt(x * x + y * y + z * z);
+}
+
+/* ------------------------------ dense grid ------------------------------ */
+
+// One grid node, padded to 4 doubles so a node is a single aligned 256-bit load.
+struct alignas(32) forceFieldNode
+{
+    double x;
+    double y;
+    double z;
+    double w; // padding, always 0
+};
+
+// Grid cell a particle was last sampled in, reused while the particle stays inside it.
+struct forceFieldCell
+{
+    int ix, iy, iz; // lower corner of the cell; ix == -1 means "no cached cell"
+    int base;       // index of node (ix, iy, iz)
+};
+
+class DenseForceField : public ForceField
+{
+public:
+    DenseForceField(const struct point* field, int resolution)
+        : m_resolution(resolution), m_worldToGrid((resolution - 1) / 4.0), m_nodes((size_t)resolution * resolution * resolution)
+    {
+        for (size_t n = 0; n < m_nodes.size(); n++)
+        {
+            m_nodes[n].x = field[n].x;
+            m_nodes[n].y = field[n].y;
+            m_nodes[n].z = field[n].z;
+            m_nodes[n].w = 0.0;
+        }
+
+        for (int n = 0; n < NUM_PARTICLES; n++)
+        {
+            m_cells[n].ix = -1;
+        }
+    }
+
+    void addForce(int particle, const struct point& p, double t, struct point* force) override;
+
+    void write(FILE*) const override {}
+
+private:
+    int m_resolution;
+    double m_worldToGrid; // (resolution - 1) / 4
+    std::vector<forceFieldNode> m_nodes;
+    forceFieldCell m_cells[NUM_PARTICLES]; // one per particle
+};
+
+void DenseForceField::addForce(int particle, const struct point& p, double, struct point* force)
+{
+    const int r = m_resolution;
+
+    if (r == 1)
+    {
+        force->x += m_nodes[0].x;
+        force->y += m_nodes[0].y;
+        force->z += m_nodes[0].z;
+        return;
+    }
+
+    double gx = toGrid(p.x, m_worldToGrid, r);
+    double gy = toGrid(p.y, m_worldToGrid, r);
+    double gz = toGrid(p.z, m_worldToGrid, r);
+
+    // Between RK4 stages (and between most time steps) a particle moves far less than a cell,
+    // so the cell from the last lookup is usually still the right one.
+    forceFieldCell uncached = {-1, -1, -1, 0};
+    forceFieldCell& cell = particle >= 0 ? m_cells[particle] : uncached;
+    if (cell.ix < 0 || !(gx >= cell.ix && gx <= cell.ix + 1 && gy >= cell.iy && gy <= cell.iy + 1 && gz >= cell.iz && gz <= cell.iz + 1))
+    {
+        // the last cell is [r-2, r-1], so a particle on the far face still has a full cell of 8 corners
+        cell.ix = (int)gx < r - 2 ? (int)gx : r - 2;
+        cell.iy = (int)gy < r - 2 ? (int)gy : r - 2;
+        cell.iz = (int)gz < r - 2 ? (int)gz : r - 2;
+        cell.base = cell.ix * r * r + cell.iy * r + cell.iz;
+    }
+
+    double fx = gx - cell.ix;
+    double fy = gy - cell.iy;
+    double fz = gz - cell.iz;
+
+    // corner c = (dx, dy, dz) bits (4, 2, 1), matching the i * r * r + j * r + k node order
+    const int offsets[8] = {0, 1, r, r + 1, r * r, r * r + 1, r * r + r, r * r + r + 1};
+    const double wx[2] = {1.0 - fx, fx};
+    const double wy[2] = {1.0 - fy, fy};
+    const double wz[2] = {1.0 - fz, fz};
+
+    const forceFieldNode* base = &m_nodes[cell.base];
+
+#if JELLO_SIMD_AVX
+    __m256d sum = _mm256_setzero_pd();
+    for (int c = 0; c < 8; c++)
+    {
+        __m256d w = _mm256_set1_pd(wx[c >> 2] * wy[(c >> 1) & 1] * wz[c & 1]);
+        sum = _mm256_add_pd(sum, _mm256_mul_pd(w, _mm256_load_pd(&base[offsets[c]].x)));
+    }
+    alignas(32) double f[4];
+    _mm256_store_pd(f, sum);
+    force->x += f[0];
+    force->y += f[1];
+    force->z += f[2];
+#elif JELLO_SIMD_SSE2
+    __m128d sumXY = _mm_setzero_pd();
+    __m128d sumZW = _mm_setzero_pd();
+    for (int c = 0; c < 8; c++)
+    {
+        __m128d w = _mm_set1_pd(wx[c >> 2] * wy[(c >> 1) & 1] * wz[c & 1]);
+        sumXY = _mm_add_pd(sumXY, _mm_mul_pd(w, _mm_load_pd(&base[offsets[c]].x)));
+        sumZW = _mm_add_pd(sumZW, _mm_mul_pd(w, _mm_load_pd(&base[offsets[c]].z)));
+    }
+    alignas(16) double f[4];
+    _mm_store_pd(f, sumXY);
+    _mm_store_pd(f + 2, sumZW);
+    force->x += f[0];
+    force->y += f[1];
+    force->z += f[2];
+#else
+    for (int c = 0; c < 8; c++)
+    {
+        double w = wx[c >> 2] * wy[(c >> 1) & 1] * wz[c & 1];
+        force->x += w * base[offsets[c]].x;
+        force->y += w * base[offsets[c]].y;
+        force->z += w * base[offsets[c]].z;
+    }
+#endif
+}
+
+ForceField* createDenseForceField(const struct world* jello)
+{
+    if (jello->resolution <= 0 || jello->forceField == NULL)
+    {
+        return NULL;
+    }
+
+    return new DenseForceField(jello->forceField, jello->resolution);
+}
+
+/* --------------------------- sparse block grid --------------------------- */
+
+// Same node layout and world mapping as the dense grid, split into tileSize^3 tiles.
+// Only tiles with a non-zero node are stored; the others read as zero force.
+class SparseForceField : public ForceField
+{
+public:
+    SparseForceField(int resolution, int tileSize)
+        : m_resolution(resolution), m_tileSize(tileSize), m_worldToGrid((resolution - 1) / 4.0)
+    {
+        m_tilesPerAxis = (resolution + tileSize - 1) / tileSize;
+        m_tileIndex.assign((size_t)m_tilesPerAxis * m_tilesPerAxis * m_tilesPerAxis, -1);
+    }
+
+    // returns the storage for tile (ti, tj, tk), allocating it (zeroed) if needed; local node order is i * T * T + j * T + k
+    struct point* tile(int ti, int tj, int tk)
+    {
+        int& index = m_tileIndex[((size_t)ti * m_tilesPerAxis + tj) * m_tilesPerAxis + tk];
+        if (index < 0)
+        {
+            index = (int)(m_tiles.size() / tileNodeCount());
+            m_tiles.resize(m_tiles.size() + tileNodeCount(), point{0.0, 0.0, 0.0});
+        }
+        return &m_tiles[(size_t)index * tileNodeCount()];
+    }
+
+    void addForce(int particle, const struct point& p, double t, struct point* force) override;
+
+    void write(FILE* file) const override;
+
+private:
+    size_t tileNodeCount() const { return (size_t)m_tileSize * m_tileSize * m_tileSize; }
+
+    const struct point* node(int i, int j, int k) const
+    {
+        const int T = m_tileSize;
+        int index = m_tileIndex[((size_t)(i / T) * m_tilesPerAxis + j / T) * m_tilesPerAxis + k / T];
+        if (index < 0)
+        {
+            return NULL;
+        }
+        return &m_tiles[(size_t)index * tileNodeCount() + ((i % T) * T + j % T) * T + k % T];
+    }
+
+    int m_resolution;
+    int m_tileSize;
+    int m_tilesPerAxis;
+    double m_worldToGrid;
+    std::vector<int> m_tileIndex;    // per tile: index into m_tiles, or -1 for an all-zero tile
+    std::vector<struct point> m_tiles;
+};
+
+void SparseForceField::addForce(int, const struct point& p, double, struct point* force)
+{
+    const int r = m_resolution;
+
+    double gx = toGrid(p.x, m_worldToGrid, r);
+    double gy = toGrid(p.y, m_worldToGrid, r);
+    double gz = toGrid(p.z, m_worldToGrid, r);
+
+    int x0 = r > 1 ? ((int)gx < r - 2 ? (int)gx : r - 2) : 0;
+    int y0 = r > 1 ? ((int)gy < r - 2 ? (int)gy : r - 2) : 0;
+    int z0 = r > 1 ? ((int)gz < r - 2 ? (int)gz : r - 2) : 0;
+    int step = r > 1 ? 1 : 0;
+
+    const double wx[2] = {1.0 - (gx - x0), gx - x0};
+    const double wy[2] = {1.0 - (gy - y0), gy - y0};
+    const double wz[2] = {1.0 - (gz - z0), gz - z0};
+
+    for (int c = 0; c < 8; c++)
+    {
+        int dx = c >> 2, dy = (c >> 1) & 1, dz = c & 1;
+        const struct point* f = node(x0 + dx * step, y0 + dy * step, z0 + dz * step);
+        if (f != NULL)
+        {
+            double w = wx[dx] * wy[dy] * wz[dz];
+            force->x += w * f->x;
+            force->y += w * f->y;
+            force->z += w * f->z;
+        }
+    }
+}
+
+void SparseForceField::write(FILE* file) const
+{
+    const int T = m_tileSize;
+    const int n = m_tilesPerAxis;
+
+    fprintf(file, "forcefield sparse %d %d %d\n", m_resolution, T, (int)(m_tiles.size() / tileNodeCount()));
+    for (int ti = 0; ti < n; ti++)
+        for (int tj = 0; tj < n; tj++)
+            for (int tk = 0; tk < n; tk++)
+            {
+                int index = m_tileIndex[((size_t)ti * n + tj) * n + tk];
+                if (index < 0)
+                {
+                    continue;
+                }
+
+                fprintf(file, "%d %d %d\n", ti, tj, tk);
+                const struct point* tile = &m_tiles[(size_t)index * tileNodeCount()];
+                for (size_t m = 0; m < tileNodeCount(); m++)
+                {
+                    fprintf(file, "%lf %lf %lf\n", tile[m].x, tile[m].y, tile[m].z);
+                }
+            }
+}
+
+ForceField* createSparseForceField(const struct point* dense, int resolution, int tileSize)
+{
+    SparseForceField* field = new SparseForceField(resolution, tileSize);
+    const int T = tileSize;
+    const int n = (resolution + T - 1) / T;
+
+    for (int ti = 0; ti < n; ti++)
+        for (int tj = 0; tj < n; tj++)
+            for (int tk = 0; tk < n; tk++)
+            {
+                struct point* tile = NULL;
+                for (int i = ti * T; i < (ti + 1) * T && i < resolution; i++)
+                    for (int j = tj * T; j < (tj + 1) * T && j < resolution; j++)
+                        for (int k = tk * T; k < (tk + 1) * T && k < resolution; k++)
+                        {
+                            const struct point& f = dense[((size_t)i * resolution + j) * resolution + k];
+                            if (f.x == 0.0 && f.y == 0.0 && f.z == 0.0)
+                            {
+                                continue;
+                            }
+                            if (tile == NULL)
+                            {
+                                tile = field->tile(ti, tj, tk);
+                            }
+                            tile[((i - ti * T) * T + (j - tj * T)) * T + (k - tk * T)] = f;
+                        }
+            }
+
+    return field;
+}
+
+/* ---------------------------- analytic fields ---------------------------- */
+
+// Constant force everywhere.
+class UniformForceField : public ForceField
+{
+public:
+    UniformForceField(const struct point& f) : m_force(f) {}
+
+    void addForce(int, const struct point&, double, struct point* force) override
+    {
+        force->x += m_force.x;
+        force->y += m_force.y;
+        force->z += m_force.z;
+    }
+
+    void write(FILE* file) const override
+    {
+        fprintf(file, "forcefield uniform %lf %lf %lf\n", m_force.x, m_force.y, m_force.z);
+    }
+
+private:
+    struct point m_force;
+};
+
+// Constant acceleration g everywhere: the force on a control point is its own mass * g, so light and heavy points
+// of a heterogeneous material fall alike. particle = -1 uses the uniform mass.
+class GravityForceField : public ForceField
+{
+public:
+    GravityForceField(const struct point& g, double mass) : m_g(g), m_mass(mass), m_pointMasses(NULL) {}
+
+    void addForce(int particle, const struct point&, double, struct point* force) override
+    {
+        const double mass = m_pointMasses != NULL && particle >= 0 ? m_pointMasses[particle] : m_mass;
+        force->x += mass * m_g.x;
+        force->y += mass * m_g.y;
+        force->z += mass * m_g.z;
+    }
+
+    void setPointMasses(const double* mass) override { m_pointMasses = mass; }
+
+    void write(FILE* file) const override
+    {
+        fprintf(file, "forcefield gravity %lf %lf %lf\n", m_g.x, m_g.y, m_g.z);
+    }
+
+private:
+    struct point m_g;
+    double m_mass;
+    const double* m_pointMasses;
+};
+
+// Rankine vortex around the axis through 'center' along 'axis': the tangential force grows linearly up to
+// 'radius' and falls off as 1/distance beyond it. Positive strength swirls counter-clockwise about the axis.
+class VortexForceField : public ForceField
+{
+public:
+    VortexForceField(const struct point& center, const struct point& axis, double strength, double radius)
+        : m_center(center), m_strength(strength), m_radius(radius)
+    {
+        double len = length(axis.x, axis.y, axis.z);
+        m_axis.x = axis.x / len;
+        m_axis.y = axis.y / len;
+        m_axis.z = axis.z / len;
+    }
+
+    void addForce(int, const struct point& p, double, struct point* force) override
+    {
+        double dx = p.x - m_center.x, dy = p.y - m_center.y, dz = p.z - m_center.z;
+        double along = dx * m_axis.x + dy * m_axis.y + dz * m_axis.z;
+        dx -= along * m_axis.x;
+        dy -= along * m_axis.y;
+        dz -= along * m_axis.z;
+
+        double dist = length(dx, dy, dz);
+        if (dist < 1e-8)
+        {
+            return;
+        }
+
+        // |axis x d| = dist, so scale by magnitude / dist
+        double magnitude = dist < m_radius ? m_strength * dist / m_radius : m_strength * m_radius / dist;
+        double s = magnitude / dist;
+        force->x += s * (m_axis.y * dz - m_axis.z * dy);
+        force->y += s * (m_axis.z * dx - m_axis.x * dz);
+        force->z += s * (m_axis.x * dy - m_axis.y * dx);
+    }
+
+    void write(FILE* file) const override
+    {
+        fprintf(file, "forcefield vortex %lf %lf %lf %lf %lf %lf %lf %lf\n", m_center.x, m_center.y, m_center.z, m_axis.x,
+                m_axis.y, m_axis.z, m_strength, m_radius);
+    }
+
+private:
+    struct point m_center;
+    struct point m_axis;
+    double m_strength;
+    double m_radius;
+};
+
+// Push away from (strength > 0) or pull towards (strength < 0) 'center', decaying as 1 / (1 + (d / falloff)^2).
+class RadialForceField : public ForceField
+{
+public:
+    RadialForceField(const struct point& center, double strength, double falloff)
+        : m_center(center), m_strength(strength), m_falloff(falloff)
+    {
+    }
+
+    void addForce(int, const struct point& p, double, struct point* force) override
+    {
+        double dx = p.x - m_center.x, dy = p.y - m_center.y, dz = p.z - m_center.z;
+        double dist = length(dx, dy, dz);
+        if (dist < 1e-8)
+        {
+            return;
+        }
+
+        double q = dist / m_falloff;
+        double s = m_strength / (1.0 + q * q) / dist;
+        force->x += s * dx;
+        force->y += s * dy;
+        force->z += s * dz;
+    }
+
+    void write(FILE* file) const override
+    {
+        fprintf(file, "forcefield radial %lf %lf %lf %lf %lf\n", m_center.x, m_center.y, m_center.z, m_strength, m_falloff);
+    }
+
+private:
+    struct point m_center;
+    double m_strength;
+    double m_falloff;
+};
+
+// Gusting wind along 'direction': strength * (1 + gust * sin(2 pi frequency t)).
+class WindForceField : public ForceField
+{
+public:
+    WindForceField(const struct point& direction, double strength, double gust, double frequency)
+        : m_strength(strength), m_gust(gust), m_frequency(frequency)
+    {
+        double len = length(direction.x, direction.y, direction.z);
+        m_direction.x = direction.x / len;
+        m_direction.y = direction.y / len;
+        m_direction.z = direction.z / len;
+    }
+
+    void addForce(int, const struct point&, double t, struct point* force) override
+    {
+        double s = m_strength * (1.0 + m_gust * sin(2.0 * PI * m_frequency * t));
+        force->x += s * m_direction.x;
+        force->y += s * m_direction.y;
+        force->z += s * m_direction.z;
+    }
+
+    bool isTimeDependent() const override { return m_gust != 0.0 && m_frequency != 0.0; }
+
+    void write(FILE* file) const override
+    {
+        fprintf(file, "forcefield wind %lf %lf %lf %lf %lf %lf\n", m_direction.x, m_direction.y, m_direction.z, m_strength,
+                m_gust, m_frequency);
+    }
+
+private:
+    struct point m_direction;
+    double m_strength;
+    double m_gust;
+    double m_frequency;
+};
+
+/* ------------------------------- combined ------------------------------- */
+
+class SumForceField : public ForceField
+{
+public:
+    SumForceField(ForceField* a, ForceField* b) : m_a(a), m_b(b) {}
+    ~SumForceField() override
+    {
+        delete m_a;
+        delete m_b;
+    }
+
+    void addForce(int particle, const struct point& p, double t, struct point* force) override
+    {
+        m_a->addForce(particle, p, t, force);
+        m_b->addForce(particle, p, t, force);
+    }
+
+    bool isTimeDependent() const override { return m_a->isTimeDependent() || m_b->isTimeDependent(); }
+
+    void setPointMasses(const double* mass) override
+    {
+        m_a->setPointMasses(mass);
+        m_b->setPointMasses(mass);
+    }
+
+    void write(FILE* file) const override
+    {
+        m_a->write(file);
+        m_b->write(file);
+    }
+
+private:
+    ForceField* m_a;
+    ForceField* m_b;
+};
+
+ForceField* sumForceFields(ForceField* a, ForceField* b)
+{
+    if (a == NULL)
+    {
+        return b;
+    }
+    if (b == NULL)
+    {
+        return a;
+    }
+    return new SumForceField(a, b);
+}
+
+ForceField* createUniformForceField(const struct point& force)
+{
+    return new UniformForceField(force);
+}
+
+ForceField* createGravityForceField(const struct point& g, double mass)
+{
+    return new GravityForceField(g, mass);
+}
+
+ForceField* createVortexForceField(const struct point& center, const struct point& axis, double strength, double radius)
+{
+    return new VortexForceField(center, axis, strength, radius);
+}
+
+ForceField* createRadialForceField(const struct point& center, double strength, double falloff)
+{
+    return new RadialForceField(center, strength, falloff);
+}
+
+ForceField* createWindForceField(const struct point& direction, double strength, double gust, double frequency)
+{
+    return new WindForceField(direction, strength, gust, frequency);
+}
+
+/* ------------------------------ world file ------------------------------ */
+
+/*
+  Force-field extension lines, placed after the initial velocities of a world file:
+
+    forcefield uniform fx fy fz
+    forcefield gravity gx gy gz                      (acceleration; force = each point's mass * g)
+    forcefield vortex cx cy cz ax ay az strength radius (axis of any non-zero length)
+    forcefield radial cx cy cz strength falloff
+    forcefield wind dx dy dz strength gust frequency (direction of any non-zero length)
+    forcefield sparse resolution tileSize tileCount
+      then tileCount blocks of one "ti tj tk" line followed by tileSize^3 lines of 3 real numbers
+
+  Set the base-format resolution to 0 when only these fields are wanted.
+*/
+ForceField* readForceField(FILE* file, const struct world* jello)
+{
+    char type[32];
+    struct point a, b;
+    double s0, s1, s2;
+
+    if (fscanf(file, "%31s", type) != 1)
+    {
+        printf("forcefield: missing type\n");
+        return NULL;
+    }
+
+    if (strcmp(type, "uniform") == 0 && fscanf(file, "%lf %lf %lf", &a.x, &a.y, &a.z) == 3)
+    {
+        return new UniformForceField(a);
+    }
+    if (strcmp(type, "gravity") == 0 && fscanf(file, "%lf %lf %lf", &a.x, &a.y, &a.z) == 3)
+    {
+        return new GravityForceField(a, jello->mass);
+    }
+    if (strcmp(type, "vortex") == 0 &&
+        fscanf(file, "%lf %lf %lf %lf %lf %lf %lf %lf", &a.x, &a.y, &a.z, &b.x, &b.y, &b.z, &s0, &s1) == 8)
+    {
+        if (!(length(b.x, b.y, b.z) > 0.0))
+        {
+            printf("forcefield vortex: the axis is the zero vector\n");
+            return NULL;
+        }
+        return new VortexForceField(a, b, s0, s1);
+    }
+    if (strcmp(type, "radial") == 0 && fscanf(file, "%lf %lf %lf %lf %lf", &a.x, &a.y, &a.z, &s0, &s1) == 5)
+    {
+        return new RadialForceField(a, s0, s1);
+    }
+    if (strcmp(type, "wind") == 0 && fscanf(file, "%lf %lf %lf %lf %lf %lf", &a.x, &a.y, &a.z, &s0, &s1, &s2) == 6)
+    {
+        if (!(length(a.x, a.y, a.z) > 0.0))
+        {
+            printf("forcefield wind: the direction is the zero vector\n");
+            return NULL;
+        }
+        return new WindForceField(a, s0, s1, s2);
+    }
+    if (strcmp(type, "sparse") == 0)
+    {
+        int resolution, tileSize, tileCount;
+        if (fscanf(file, "%d %d %d", &resolution, &tileSize, &tileCount) != 3 || resolution <= 0 || tileSize <= 0)
+        {
+            printf("forcefield sparse: bad header\n");
+            return NULL;
+        }
+
+        SparseForceField* field = new SparseForceField(resolution, tileSize);
+        int tilesPerAxis = (resolution + tileSize - 1) / tileSize;
+        for (int t = 0; t < tileCount; t++)
+        {
+            int ti, tj, tk;
+            if (fscanf(file, "%d %d %d", &ti, &tj, &tk) != 3 || ti < 0 || tj < 0 || tk < 0 || ti >= tilesPerAxis ||
+                tj >= tilesPerAxis || tk >= tilesPerAxis)
+            {
+                printf("forcefield sparse: bad tile %d\n", t);
+                delete field;
+                return NULL;
+            }
+
+            struct point* tile = field->tile(ti, tj, tk);
+            for (int m = 0; m < tileSize * tileSize * tileSize; m++)
+            {
+                if (fscanf(file, "%lf %lf %lf", &tile[m].x, &tile[m].y, &tile[m].z) != 3)
+                {
+                    printf("forcefield sparse: tile %d is truncated\n", t);
+                    delete field;
+                    return NULL;
+                }
+            }
+        }
+        return field;
+    }
+
+    printf("forcefield: unknown or malformed type '%s'\n", type);
+    return NULL;
+}
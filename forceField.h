@@ -0,0 +1,55 @@
+#ifndef _FORCE_FIELD_H_
+#define _FORCE_FIELD_H_
+
+#include <cstdio>
+
+#include <vector>
+
+#include "world.h"
+
+// External force acting on the jello particles.
+// Backends: the dense grid from the world file, analytic fields (uniform, gravity, vortex, radial, wind) that need
+// no storage, and a sparse block grid that only stores non-zero tiles. Several fields in one world are summed.
+class ForceField
+{
+public:
+    virtual ~ForceField() = default;
+
+    // adds the force at world-space position p and simulation time t to 'force'
+    // particle = flat particle index (i * JELLO_SUBPOINTS + j) * JELLO_SUBPOINTS + k; backends may cache per particle
+    // particle = -1 bypasses any per-particle cache, so concurrent lookups from several threads are safe
+    virtual void addForce(int particle, const struct point& p, double t, struct point* force) = 0;
+
+    // true if the force at a fixed position changes over time
+    virtual bool isTimeDependent() const { return false; }
+
+    // the mass of every control point, indexed by particle, for fields that are accelerations (gravity); NULL = the
+    // world's uniform mass. readWorld sets it from the world's material, which must outlive the field.
+    virtual void setPointMasses(const double*) {}
+
+    // writes the world-file extension line(s) for this field; the dense grid is part of the base format and writes nothing
+    virtual void write(FILE* file) const = 0;
+};
+
+// builds the dense backend from jello->forceField; returns NULL if the world has no force field
+ForceField* createDenseForceField(const struct world* jello);
+
+// builds a sparse block grid from a dense resolution^3 array, dropping tiles that are entirely zero
+ForceField* createSparseForceField(const struct point* dense, int resolution, int tileSize);
+
+// reads the rest of a "forcefield <type> ..." world-file line (the "forcefield" keyword has been consumed)
+// returns NULL and prints an error if the type is unknown or the line is malformed
+ForceField* readForceField(FILE* file, const struct world* jello);
+
+// analytic fields, with the parameters of the matching "forcefield" extension line
+// gravity is an acceleration: the force on a control point is its mass * g, with 'mass' until setPointMasses
+ForceField* createUniformForceField(const struct point& force);
+ForceField* createGravityForceField(const struct point& g, double mass);
+ForceField* createVortexForceField(const struct point& center, const struct point& axis, double strength, double radius);
+ForceField* createRadialForceField(const struct point& center, double strength, double falloff);
+ForceField* createWindForceField(const struct point& direction, double strength, double gust, double frequency);
+
+// combines two fields into one that evaluates both; either argument may be NULL
+ForceField* sumForceFields(ForceField* a, ForceField* b);
+
+#endif // #ifndef _FORCE_FIELD_H_
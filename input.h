@@ -27,7 +27,6 @@ void keyboardFunc(GLFWwindow* window, int key, int scancode, int action, int mod
 #endif // #if USE_GLUT
 
 // read/write world files
-void readWorld(char* fileName, struct world* jello);
-void writeWorld(char* fileName, struct world* jello);
+#include "worldFile.h"
 
 #endif
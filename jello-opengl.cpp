@@ -17,6 +17,8 @@
 #include "jelloApp.h"
 #include "physics.h"
 #include "pic.h"
+#include "profiler.h"
+#include "scene.h"
 #include "showCube.h"
 
 static int g_iwindowWidth, g_iwindowHeight;
@@ -24,6 +26,7 @@ static int g_iwindowWidth, g_iwindowHeight;
 #if !VULKAN_BUILD
 
 struct world g_jello;
+static Scene* g_scene = NULL; // set when a scene file with several bodies is loaded instead of g_jello
 
 void myinit()
 {
@@ -75,6 +78,7 @@ void reshape(int w, int h)
 
 void display()
 {
+    PROFILE_ZONE("display");
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     glMatrixMode(GL_MODELVIEW);
@@ -176,8 +180,18 @@ void display()
     glEnable(GL_LIGHTING);
     glEnable(GL_DEPTH_TEST);
 
-    // show the cube
-    showCube(&g_jello);
+    // show the cube(s)
+    if (g_scene != NULL)
+    {
+        for (int b = 0; b < g_scene->bodyCount(); b++)
+        {
+            showCube(g_scene->body(b));
+        }
+    }
+    else
+    {
+        showCube(&g_jello);
+    }
 
     glDisable(GL_LIGHTING);
 
@@ -246,19 +260,34 @@ void doIdle()
         exit(0);
     }
 
+    if (g_iwake)
+    {
+        if (g_scene != NULL)
+        {
+            g_scene->wake();
+        }
+        else
+        {
+            wakeWorld(&g_jello);
+        }
+        g_iwake = 0;
+    }
+
     if (g_ipause == 0)
     {
-        // perform one time step of the simulation
-        if (strcmp(g_jello.integrator, "Euler") == 0)
+        // perform one time step of the simulation (next to free while the cube sleeps)
+        if (g_scene != NULL)
         {
-            Euler(&g_jello);
+            g_scene->step();
         }
         else
         {
-            RK4(&g_jello);
+            stepWorld(&g_jello);
         }
     }
 
+    profilerFrame();
+
 #if USE_GLUT
     glutPostRedisplay();
 #else
@@ -266,17 +295,46 @@ void doIdle()
 }
 
 #if USE_GLUT
+// adaptive integrators report their step statistics when the program quits, and the profiler its zones
+static void printStatistics()
+{
+    if (g_scene != NULL)
+    {
+        for (int b = 0; b < g_scene->bodyCount(); b++)
+        {
+            printIntegratorStatistics(g_scene->body(b));
+        }
+    }
+    else
+    {
+        printIntegratorStatistics(&g_jello);
+    }
+
+    // nothing without JELLO_PROFILE
+    profilerPrintSummary(stdout);
+    profilerWriteTrace("jello-trace.json");
+}
+
 int main(int argc, char** argv)
 {
     if (argc < 2)
     {
         printf("Oops! You didn't say the g_jello world file!\n");
-        printf("Usage: %s [worldfile]\n", argv[0]);
+        printf("Usage: %s [worldfile | scenefile]\n", argv[0]);
         assert(0 && "Oops! You didn't say the g_jello world file!");
         exit(0);
     }
 
-    readWorld(argv[1], &g_jello);
+    if (isSceneFile(argv[1]))
+    {
+        g_scene = new Scene();
+        readScene(argv[1], g_scene);
+    }
+    else
+    {
+        readWorld(argv[1], &g_jello);
+    }
+    atexit(printStatistics);
 
     g_iwindowWidth = 640;
     g_iwindowHeight = 480;
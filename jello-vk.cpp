@@ -115,8 +115,22 @@ void Vk_Jello::mainLoop()
 {
     while (!glfwWindowShouldClose(window))
     {
-        glfwPollEvents();
-        if (g_iphysics && (g_istep || !g_ipause))
+        if (isAsleep(&jello))
+        {
+            glfwWaitEventsTimeout(0.1);
+        }
+        else
+        {
+            glfwPollEvents();
+        }
+
+        if (g_iwake)
+        {
+            wakeWorld(&jello);
+            g_iwake = 0;
+        }
+
+        if (g_iphysics && (g_istep || !g_ipause) && !isAsleep(&jello))
         {
             physicsCompute();
             particlePosUpdate();
@@ -154,14 +168,7 @@ void Vk_Jello::updateUniformBuffer(uint32_t currentImage)
 void Vk_Jello::physicsCompute()
 {
     Sleep(10);
-    if (strcmp(jello.integrator, "Euler") == 0)
-    {
-        Euler(&jello);
-    }
-    else
-    {
-        RK4(&jello);
-    }
+    stepWorld(&jello);
 }
 
 void Vk_Jello::particlePosUpdate()
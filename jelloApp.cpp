@@ -3,6 +3,8 @@
 #if VULKAN_BUILD
 #include <cassert>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 #include <exception>
 #include <iostream>
@@ -11,28 +13,34 @@
 
 #include "input.h"
 #include "physics.h"
+#include "profiler.h"
 #include "renderer-vk.h"
 //#include "renderer-opengl.h" ///@todo Add OpenGL renderer.
 
 const std::vector<Vertex>& JelloScene::getVertexData()
 {
-    ///@todo only update vertex data when necessary, e.g. when the jello cube is updated by the physics engine.
-    ///      For now, we will update the vertex data every frame for simplicity.
+    PROFILE_ZONE("getVertexData");
+    // Called after every physics step; mainLoop skips both while the scene is asleep.
     const glm::vec3 black = {0.0f, 0.0f, 0.0f};
     std::vector<Vertex> jelloVertices;
     int currentIndex = 0;
 
-    for (int i = 0; i < JELLO_SUBPOINTS; i++)
+    // the surface vertices of every body, one body after the other
+    for (int b = 0; b < m_scene.bodyCount(); b++)
     {
-        for (int j = 0; j < JELLO_SUBPOINTS; j++)
+        const struct world* jello = m_scene.body(b);
+        for (int i = 0; i < JELLO_SUBPOINTS; i++)
         {
-            for (int k = 0; k < JELLO_SUBPOINTS; k++)
+            for (int j = 0; j < JELLO_SUBPOINTS; j++)
             {
-                if (i * j * k * (JELLO_SUBDIVISIONS - i) * (JELLO_SUBDIVISIONS - j) * (JELLO_SUBDIVISIONS - k) == 0)
+                for (int k = 0; k < JELLO_SUBPOINTS; k++)
                 {
-                    Vertex vertex = {{m_jello.p[i][j][k].x, m_jello.p[i][j][k].y, m_jello.p[i][j][k].z}, black};
-                    jelloVertices.push_back(vertex);
-                    currentIndex++;
+                    if (i * j * k * (JELLO_SUBDIVISIONS - i) * (JELLO_SUBDIVISIONS - j) * (JELLO_SUBDIVISIONS - k) == 0)
+                    {
+                        Vertex vertex = {{jello->p[i][j][k].x, jello->p[i][j][k].y, jello->p[i][j][k].z}, black};
+                        jelloVertices.push_back(vertex);
+                        currentIndex++;
+                    }
                 }
             }
         }
@@ -91,7 +99,8 @@ void JelloScene::initVerticesAndIndices()
             {
                 if (isOnSurface(i, j, k))
                 {
-                    Vertex vertex = {{m_jello.p[i][j][k].x, m_jello.p[i][j][k].y, m_jello.p[i][j][k].z}, black};
+                    const struct world* jello = m_scene.body(0);
+                    Vertex vertex = {{jello->p[i][j][k].x, jello->p[i][j][k].y, jello->p[i][j][k].z}, black};
 
                     // Vertices
                     jelloVertices.push_back(vertex);
@@ -179,6 +188,32 @@ void JelloScene::initVerticesAndIndices()
         }
     }
 
+    // the other bodies reuse the index lists of the first, offset to their own vertices
+    const int verticesPerBody = currentIndex;
+    const int indicesPerBody[4] = {(int)jelloIndices[0].size(), (int)jelloIndices[1].size(),
+                                   (int)jelloIndices[2].size(), (int)jelloIndices[3].size()};
+    assert(verticesPerBody * m_scene.bodyCount() <= 65536 && "too many bodies for 16-bit indices");
+    for (int b = 1; b < m_scene.bodyCount(); b++)
+    {
+        const struct world* jello = m_scene.body(b);
+        for (int i = 0; i < JELLO_SUBPOINTS; i++)
+            for (int j = 0; j < JELLO_SUBPOINTS; j++)
+                for (int k = 0; k < JELLO_SUBPOINTS; k++)
+                    if (isOnSurface(i, j, k))
+                    {
+                        Vertex vertex = {{jello->p[i][j][k].x, jello->p[i][j][k].y, jello->p[i][j][k].z}, black};
+                        jelloVertices.push_back(vertex);
+                    }
+
+        for (int list = 0; list < 4; list++)
+        {
+            for (int n = 0; n < indicesPerBody[list]; n++)
+            {
+                jelloIndices[list].push_back((uint16_t)(jelloIndices[list][n] + b * verticesPerBody));
+            }
+        }
+    }
+
     m_jelloIndexBufferInfo.points.startIndex     = 0;
     m_jelloIndexBufferInfo.points.count          = jelloIndices[0].size();
     m_jelloIndexBufferInfo.structural.startIndex = m_jelloIndexBufferInfo.points.startIndex +
@@ -202,19 +237,34 @@ void JelloScene::initVerticesAndIndices()
     m_jelloIndices.insert(m_jelloIndices.end(), jelloIndices[3].begin(), jelloIndices[3].end());
 }
 
-void JelloScene::doPhysics()
+JelloScene::JelloScene(char* fileName)
 {
-    if (strcmp(m_jello.integrator, "RK4") == 0)
+    if (isSceneFile(fileName))
     {
-        RK4(&m_jello);
+        ::readScene(fileName, &m_scene);
     }
     else
     {
-        assert(strcmp(m_jello.integrator, "Euler") == 0);
-        Euler(&m_jello);
+        // a plain world file is a scene with one body
+        struct world* jello = (struct world*)calloc(1, sizeof(struct world));
+        ::readWorld(fileName, jello);
+        m_scene.add(jello);
+    }
+}
+
+JelloScene::~JelloScene()
+{
+    for (int b = 0; b < m_scene.bodyCount(); b++)
+    {
+        printIntegratorStatistics(m_scene.body(b));
     }
 }
 
+void JelloScene::doPhysics()
+{
+    m_scene.step();
+}
+
 static void framebufferResizeCallback(GLFWwindow* window, int width, int height)
 {
     auto app = reinterpret_cast<JelloApp*>(glfwGetWindowUserPointer(window));
@@ -244,6 +294,10 @@ void JelloApp::run()
     mainLoop();
     destroyRenderer();
     destroyWindow();
+
+    // nothing without JELLO_PROFILE
+    profilerPrintSummary(stdout);
+    profilerWriteTrace("jello-trace.json");
 }
 
 void JelloApp::createScene(char* fileName)
@@ -316,9 +370,24 @@ void JelloApp::mainLoop()
 {
     while (!glfwWindowShouldClose(m_hwindow))
     {
-        glfwPollEvents();
+        if (m_pScene->isAsleep() && !g_isaveScreenToFile)
+        {
+            // nothing to simulate or upload: block until there is input (camera, keys), redrawing at 10 Hz at most
+            glfwWaitEventsTimeout(0.1);
+        }
+        else
+        {
+            glfwPollEvents();
+        }
+
+        if (g_iwake)
+        {
+            m_pScene->wake();
+            g_iwake = 0;
+        }
 
-        if (g_iphysics && (g_istep || !g_ipause))
+        // a sleeping scene keeps its positions, so neither the step nor the vertex upload is needed
+        if (g_iphysics && (g_istep || !g_ipause) && !m_pScene->isAsleep())
         {
             Sleep(10);
 
@@ -328,6 +397,9 @@ void JelloApp::mainLoop()
             m_pRenderer->updateVertexData(m_pScene->getVertexData());
         }
 
+        saveScreenToFile();
+        profilerFrame();
+
         ///@todo change to m_pRenderer->(m_pScene)?
         drawFrame();
 
@@ -335,6 +407,40 @@ void JelloApp::mainLoop()
     }
 }
 
+void JelloApp::setCaptureFrames(int frames)
+{
+    g_isaveScreenToFile = 1;
+    m_captureFrames = frames;
+}
+
+// Same cadence as doIdle() in the OpenGL path: one picxxxx.ppm every 1/15 s of simulated time, 300 at most.
+void JelloApp::saveScreenToFile()
+{
+    if (g_isaveScreenToFile != 1)
+    {
+        return;
+    }
+
+    if (m_captureTimeCounter >= (1.0 / 15))
+    {
+        char s[20] = "picxxxx.ppm";
+        s[3] = 48 + (m_sprite / 1000);
+        s[4] = 48 + (m_sprite % 1000) / 100;
+        s[5] = 48 + (m_sprite % 100) / 10;
+        s[6] = 48 + m_sprite % 10;
+
+        m_pRenderer->requestScreenshot(s);
+        m_captureTimeCounter -= (1.0 / 15);
+        m_sprite++;
+    }
+    m_captureTimeCounter += 0.0005;
+
+    if (m_sprite >= m_captureFrames) // allow only 300 snapshots, or the -capture count
+    {
+        glfwSetWindowShouldClose(m_hwindow, GLFW_TRUE);
+    }
+}
+
 void JelloApp::destroyWindow()
 {
     glfwDestroyWindow(m_hwindow);
@@ -360,12 +466,16 @@ int main(int argc, char** argv)
     if (argc < 2)
     {
         printf("Oops! You didn't say the jello world file!\n");
-        printf("Usage: %s [worldfile]\n", argv[0]);
+        printf("Usage: %s [worldfile | scenefile] [-capture frames]\n", argv[0]);
         assert(false);
         exit(0);
     }
 
     JelloApp app(argv[1]);
+    if (argc >= 4 && strcmp(argv[2], "-capture") == 0)
+    {
+        app.setCaptureFrames(atoi(argv[3]));
+    }
 
     try
     {
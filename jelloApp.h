@@ -4,6 +4,7 @@
 #include "types.h"
 #include "input.h"
 #include "renderer-vk.h"
+#include "scene.h"
 
 #if VULKAN_BUILD
 
@@ -12,19 +13,20 @@ class Renderer;
 class JelloScene
 {
 public:
-    JelloScene(char* fileName)
-    {
-        ::readWorld(fileName, &m_jello);
-    }
+    // loads a world file, or a scene file with several bodies
+    JelloScene(char* fileName);
+    ~JelloScene();
 
     const std::vector<Vertex>& getVertexData();
     const std::vector<uint16_t>& getIndexData();
     const IndexBufferInfo& getIndexBufferInfo();
     void initVerticesAndIndices();
     void doPhysics();
+    bool isAsleep() const { return m_scene.asleep(); }
+    void wake() { m_scene.wake(); }
 
 private:
-    struct world            m_jello = {};
+    Scene                   m_scene;
     IndexBufferInfo         m_jelloIndexBufferInfo = {};
     std::vector<uint16_t>   m_jelloIndices;
     std::vector<Vertex>     m_jelloVertices;
@@ -43,11 +45,14 @@ public:
     void createScene(char* fileName);
     void drawFrame();
     void setFramebufferResized(bool resized);
+    // turns screenshot saving on from the start and closes the window after 'frames' images, e.g. for captureCheck.bat
+    void setCaptureFrames(int frames);
 
 private:
     void createWindow();
     void createRenderer();
     void mainLoop();
+    void saveScreenToFile();
     void destroyWindow();
     void destroyRenderer();
 
@@ -55,6 +60,9 @@ private:
     JelloScene*     m_pScene = nullptr;
     Renderer*       m_pRenderer = nullptr;
     uint32_t        m_currentFrame = 0;
+    int             m_sprite = 0;               // number of images saved to disk so far
+    double          m_captureTimeCounter = 0.0;
+    int             m_captureFrames = 300;      // the window closes after this many images
 };
 
 #endif // #if VULKAN_BUILD
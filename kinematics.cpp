@@ -0,0 +1,137 @@
+#include "kinematics.h"
+
+#include <math.h>
+#include <string.h>
+
+#define N JELLO_SUBPOINTS
+#define NUM_PARTICLES (JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS)
+
+int isKinematicKeyword(const char* keyword)
+{
+    return strcmp(keyword, "pin") == 0 || strcmp(keyword, "drive") == 0;
+}
+
+int readKinematicLine(const char* keyword, FILE* file, struct world* jello)
+{
+    kinematicRegion region;
+    memset(&region, 0, sizeof(region));
+    region.drive = strcmp(keyword, "drive") == 0;
+
+    bool valid = fscanf(file, "%d %d %d %d %d %d", &region.from[0], &region.from[1], &region.from[2], &region.to[0],
+                        &region.to[1], &region.to[2]) == 6;
+    for (int axis = 0; axis < 3 && valid; axis++)
+    {
+        valid = region.from[axis] >= 0 && region.from[axis] <= region.to[axis] && region.to[axis] < N;
+    }
+    if (region.drive)
+    {
+        valid = valid && fscanf(file, "%lf %lf %lf %lf", &region.amplitude.x, &region.amplitude.y,
+                                &region.amplitude.z, &region.frequency) == 4;
+    }
+    if (!valid)
+    {
+        printf("%s: expected 'pin i0 j0 k0 i1 j1 k1' or 'drive i0 j0 k0 i1 j1 k1 ax ay az frequency', with "
+               "0 <= i0 <= i1 <= %d etc.\n",
+               keyword, JELLO_SUBDIVISIONS);
+        return 0;
+    }
+
+    if (jello->kinematics == NULL)
+    {
+        jello->kinematics = new struct kinematics;
+        jello->kinematics->mask.assign(NUM_PARTICLES, 0);
+        jello->kinematics->anchor.resize(NUM_PARTICLES);
+        jello->kinematics->amplitude.assign(NUM_PARTICLES, point{0.0, 0.0, 0.0});
+        jello->kinematics->frequency.assign(NUM_PARTICLES, 0.0);
+    }
+    struct kinematics* kinematics = jello->kinematics;
+    kinematics->regions.push_back(region);
+
+    // points that were kinematic already keep their anchor, the others anchor where the world file put them
+    const struct point* p = &jello->p[0][0][0];
+    for (int i = region.from[0]; i <= region.to[0]; i++)
+        for (int j = region.from[1]; j <= region.to[1]; j++)
+            for (int k = region.from[2]; k <= region.to[2]; k++)
+            {
+                int particle = (i * N + j) * N + k;
+                if (!kinematics->mask[particle])
+                {
+                    kinematics->anchor[particle] = p[particle];
+                }
+                kinematics->mask[particle] = 1;
+                kinematics->amplitude[particle] = region.amplitude;
+                kinematics->frequency[particle] = region.frequency;
+            }
+
+    kinematics->free.clear();
+    kinematics->points.clear();
+    for (int particle = 0; particle < NUM_PARTICLES; particle++)
+    {
+        (kinematics->mask[particle] ? kinematics->points : kinematics->free).push_back(particle);
+    }
+
+    applyKinematics(kinematics, jello->time, &jello->p[0][0][0], &jello->v[0][0][0]);
+    return 1;
+}
+
+void writeKinematics(FILE* file, const struct kinematics* kinematics)
+{
+    for (const kinematicRegion& region : kinematics->regions)
+    {
+        fprintf(file, "%s %d %d %d %d %d %d", region.drive ? "drive" : "pin", region.from[0], region.from[1],
+                region.from[2], region.to[0], region.to[1], region.to[2]);
+        if (region.drive)
+            fprintf(file, " %.17g %.17g %.17g %.17g\n", region.amplitude.x, region.amplitude.y, region.amplitude.z,
+                    region.frequency);
+        else
+            fprintf(file, "\n");
+    }
+}
+
+void applyKinematics(const struct kinematics* kinematics, double t, struct point* p, struct point* v)
+{
+    if (kinematics == NULL)
+    {
+        return;
+    }
+
+    for (int particle : kinematics->points)
+    {
+        const struct point& anchor = kinematics->anchor[particle];
+        const struct point& amplitude = kinematics->amplitude[particle];
+        const double omega = 2.0 * PI * kinematics->frequency[particle];
+        const double s = sin(omega * t), c = omega * cos(omega * t);
+        p[particle].x = anchor.x + amplitude.x * s;
+        p[particle].y = anchor.y + amplitude.y * s;
+        p[particle].z = anchor.z + amplitude.z * s;
+        v[particle].x = amplitude.x * c;
+        v[particle].y = amplitude.y * c;
+        v[particle].z = amplitude.z * c;
+    }
+}
+
+int freePoints(const struct world* jello, const int** points)
+{
+    if (jello->kinematics != NULL)
+    {
+        *points = jello->kinematics->free.data();
+        return (int)jello->kinematics->free.size();
+    }
+
+    // built on the first call; the initialization of a function-local static is thread-safe
+    static const std::vector<int> all = [] {
+        std::vector<int> indices(NUM_PARTICLES);
+        for (int n = 0; n < NUM_PARTICLES; n++)
+        {
+            indices[n] = n;
+        }
+        return indices;
+    }();
+    *points = all.data();
+    return NUM_PARTICLES;
+}
+
+const unsigned char* kinematicMask(const struct world* jello)
+{
+    return jello->kinematics != NULL ? jello->kinematics->mask.data() : NULL;
+}
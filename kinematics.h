@@ -0,0 +1,61 @@
+#ifndef _KINEMATICS_H_
+#define _KINEMATICS_H_
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "world.h"
+
+// Kinematic control points: pinned in place or driven along a scripted path, e.g. a cube hanging from a corner or
+// standing on a shaker table. Set by world-file lines that each cover a box of control points, indices
+// 0 .. JELLO_SUBDIVISIONS inclusive; a later line overrides earlier ones for the points it covers:
+//   pin i0 j0 k0 i1 j1 k1                          the points stay where the world file puts them
+//   drive i0 j0 k0 i1 j1 k1 ax ay az frequency     the points oscillate about where the world file puts them:
+//                                                  p(t) = p(0) + a sin(2 pi frequency t)
+//
+// The force-based integrators and XPBD only move the free points: the force passes and the integration loops run
+// over the list of free points, and the kinematic ones are set to their path (position and velocity) at every
+// time a force evaluation sees, so they still pull on their neighbours. A rig with many pinned points is cheaper
+// to step, not dearer. ProjectiveDynamics leaves the kinematic points out of its linear system, whose smaller
+// matrix is factored once per set of kinematic points; the ensemble rejects worlds with kinematic points.
+struct kinematicRegion
+{
+    int drive; // 1 = "drive" line, 0 = "pin" line
+    int from[3];
+    int to[3];
+    struct point amplitude;
+    double frequency;
+};
+
+struct kinematics
+{
+    std::vector<unsigned char> mask; // per control point, flat index as in &jello->p[0][0][0]: 1 = kinematic
+    std::vector<int> free;           // the other points, ascending
+    std::vector<int> points;         // the kinematic points, ascending
+    std::vector<struct point> anchor;    // per control point, the path of the kinematic ones
+    std::vector<struct point> amplitude; // 0 for pinned points
+    std::vector<double> frequency;
+    std::vector<kinematicRegion> regions; // the lines it was built from, in order, for writing the world back
+};
+
+int isKinematicKeyword(const char* keyword);
+
+// reads the rest of a "pin" or "drive" line into jello->kinematics (created on the first line) and puts the points
+// it covers on their path at time 0; returns 0 (after printing why) if the line is malformed
+int readKinematicLine(const char* keyword, FILE* file, struct world* jello);
+
+void writeKinematics(FILE* file, const struct kinematics* kinematics);
+
+// sets the positions and velocities of the kinematic points (p and v are &jello->p[0][0][0] etc.) to their path
+// at time t; does nothing if kinematics is NULL
+void applyKinematics(const struct kinematics* kinematics, double t, struct point* p, struct point* v);
+
+// the control points the integrators move, ascending: the free points if jello has kinematic points, all of
+// them otherwise; returns how many
+int freePoints(const struct world* jello, const int** points);
+
+// per control point, 1 for the kinematic ones; NULL if jello has none
+const unsigned char* kinematicMask(const struct world* jello);
+
+#endif // #ifndef _KINEMATICS_H_
@@ -0,0 +1,183 @@
+#include "material.h"
+
+#include <math.h>
+#include <string.h>
+
+#define N JELLO_SUBPOINTS
+#define NUM_PARTICLES (JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS)
+
+int isMaterialKeyword(const char* keyword)
+{
+    return strcmp(keyword, "stiffness") == 0 || strcmp(keyword, "mass") == 0;
+}
+
+static struct material* createMaterial(const struct world* jello)
+{
+    struct material* material = new struct material;
+    buildSpringList(&material->springs);
+    colourSpringList(&material->springs, &material->colourStart);
+    material->kElastic.assign(material->springs.count(), jello->kElastic);
+    material->dElastic.assign(material->springs.count(), jello->dElastic);
+    material->mass.assign(NUM_PARTICLES, jello->mass);
+    material->inverseMass.assign(NUM_PARTICLES, 1.0 / jello->mass);
+    return material;
+}
+
+static bool inRegion(const materialRegion& region, int particle)
+{
+    int index[3] = {particle / (N * N), particle / N % N, particle % N};
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (index[axis] < region.from[axis] || index[axis] > region.to[axis])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int readMaterialLine(const char* keyword, FILE* file, struct world* jello)
+{
+    materialRegion region;
+    region.isMass = strcmp(keyword, "mass") == 0;
+
+    bool valid = fscanf(file, "%d %d %d %d %d %d", &region.from[0], &region.from[1], &region.from[2], &region.to[0],
+                        &region.to[1], &region.to[2]) == 6;
+    for (int axis = 0; axis < 3 && valid; axis++)
+    {
+        valid = region.from[axis] >= 0 && region.from[axis] <= region.to[axis] && region.to[axis] < N;
+    }
+    if (region.isMass)
+    {
+        valid = valid && fscanf(file, "%lf", &region.value[0]) == 1 && region.value[0] > 0.0;
+    }
+    else
+    {
+        valid = valid && fscanf(file, "%lf %lf", &region.value[0], &region.value[1]) == 2 && region.value[0] >= 0.0 &&
+                region.value[1] >= 0.0;
+    }
+    if (!valid)
+    {
+        printf("%s: expected 'stiffness i0 j0 k0 i1 j1 k1 kElastic dElastic' or 'mass i0 j0 k0 i1 j1 k1 m', with "
+               "0 <= i0 <= i1 <= %d etc., a positive mass and non-negative constants\n",
+               keyword, JELLO_SUBDIVISIONS);
+        return 0;
+    }
+
+    if (jello->material == NULL)
+    {
+        jello->material = createMaterial(jello);
+    }
+    struct material* material = jello->material;
+    material->regions.push_back(region);
+
+    if (region.isMass)
+    {
+        for (int particle = 0; particle < NUM_PARTICLES; particle++)
+        {
+            if (inRegion(region, particle))
+            {
+                material->mass[particle] = region.value[0];
+                material->inverseMass[particle] = 1.0 / region.value[0];
+            }
+        }
+    }
+    else
+    {
+        for (int s = 0; s < material->springs.count(); s++)
+        {
+            if (inRegion(region, material->springs.a[s]) && inRegion(region, material->springs.b[s]))
+            {
+                material->kElastic[s] = region.value[0];
+                material->dElastic[s] = region.value[1];
+            }
+        }
+    }
+    return 1;
+}
+
+void writeMaterial(FILE* file, const struct material* material)
+{
+    for (const materialRegion& region : material->regions)
+    {
+        fprintf(file, "%s %d %d %d %d %d %d", region.isMass ? "mass" : "stiffness", region.from[0], region.from[1],
+                region.from[2], region.to[0], region.to[1], region.to[2]);
+        if (region.isMass)
+            fprintf(file, " %.17g\n", region.value[0]);
+        else
+            fprintf(file, " %.17g %.17g\n", region.value[0], region.value[1]);
+    }
+}
+
+void dropSprings(struct material* material, const unsigned char* mask)
+{
+    struct springList& springs = material->springs;
+    int kept = 0, begin = 0;
+    for (size_t c = 0; c + 1 < material->colourStart.size(); c++)
+    {
+        const int end = material->colourStart[c + 1];
+        for (int s = begin; s < end; s++)
+        {
+            if (mask[springs.a[s]] && mask[springs.b[s]])
+            {
+                continue;
+            }
+            springs.a[kept] = springs.a[s];
+            springs.b[kept] = springs.b[s];
+            springs.rest[kept] = springs.rest[s];
+            material->kElastic[kept] = material->kElastic[s];
+            material->dElastic[kept] = material->dElastic[s];
+            kept++;
+        }
+        material->colourStart[c + 1] = kept;
+        begin = end;
+    }
+    springs.a.resize(kept);
+    springs.b.resize(kept);
+    springs.rest.resize(kept);
+    material->kElastic.resize(kept);
+    material->dElastic.resize(kept);
+}
+
+double addMaterialSpringForces(const struct material* material, const struct point* p, const struct point* v,
+                               struct point* force)
+{
+    const int count = material->springs.count();
+    const int* a = material->springs.a.data();
+    const int* b = material->springs.b.data();
+    const double* rest = material->springs.rest.data();
+    const double* kElastic = material->kElastic.data();
+    const double* dElastic = material->dElastic.data();
+    double potential = 0.0;
+
+    for (int s = 0; s < count; s++)
+    {
+        const struct point& p1 = p[a[s]];
+        const struct point& p2 = p[b[s]];
+        double lx = p1.x - p2.x, ly = p1.y - p2.y, lz = p1.z - p2.z;
+        double length = sqrt(lx * lx + ly * ly + lz * lz);
+        if (length < 1e-8)
+        {
+            continue; // Avoid division by zero, as computeSpringForce
+        }
+
+        // Hooke's law along the spring plus damping of the relative velocity along it, as computeSpringForce
+        const struct point& v1 = v[a[s]];
+        const struct point& v2 = v[b[s]];
+        double stretch = length - rest[s];
+        double inverseLength = 1.0 / length;
+        double dot = ((v1.x - v2.x) * lx + (v1.y - v2.y) * ly + (v1.z - v2.z) * lz) * inverseLength;
+        double magnitude = (-kElastic[s] * stretch - dElastic[s] * dot) * inverseLength;
+        potential += 0.5 * kElastic[s] * stretch * stretch;
+
+        double fx = magnitude * lx, fy = magnitude * ly, fz = magnitude * lz;
+        force[a[s]].x += fx;
+        force[a[s]].y += fy;
+        force[a[s]].z += fz;
+        force[b[s]].x -= fx;
+        force[b[s]].y -= fy;
+        force[b[s]].z -= fz;
+    }
+
+    return potential;
+}
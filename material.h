@@ -0,0 +1,61 @@
+#ifndef _MATERIAL_H_
+#define _MATERIAL_H_
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "springs.h"
+#include "world.h"
+
+// Heterogeneous material: a stiffness and damping per spring and a mass per control point, for layered or locally
+// stiffened jello. Set by world-file lines that each cover a box of control points, indices 0 .. JELLO_SUBDIVISIONS
+// inclusive; later lines override earlier ones, and whatever no line covers keeps the world's kElastic, dElastic
+// and mass:
+//   stiffness i0 j0 k0 i1 j1 k1 kElastic dElastic   the springs with both ends in the box
+//   mass i0 j0 k0 i1 j1 k1 m                        the control points in the box
+//
+// The constants are stored per spring next to the spring list (buildSpringList, coloured with colourSpringList),
+// structure of arrays, and the force-based integrators evaluate the springs from that list with each spring's own
+// constants: the same kernel for every spring, no per-spring branch. computeAcceleration then scales the forces by
+// the per-point inverse mass. "forcefield gravity" is an acceleration, so every point falls alike whatever its mass;
+// the other fields are forces. XPBD projects the coloured springs with each spring's compliance and each point's
+// inverse mass, and ProjectiveDynamics builds its matrix from the per-spring weights and per-point masses. The
+// ensemble varies the uniform constants between its variants and rejects worlds with a material.
+struct materialRegion
+{
+    int isMass; // 1 = "mass" line, 0 = "stiffness" line
+    int from[3];
+    int to[3];
+    double value[2]; // kElastic and dElastic, or the mass
+};
+
+struct material
+{
+    struct springList springs;
+    std::vector<int> colourStart;        // the springs of colour c are [colourStart[c], colourStart[c + 1])
+    std::vector<double> kElastic;        // per spring
+    std::vector<double> dElastic;        // per spring
+    std::vector<double> mass;            // per control point, (i * JELLO_SUBPOINTS + j) * JELLO_SUBPOINTS + k
+    std::vector<double> inverseMass;     // 1 / mass
+    std::vector<materialRegion> regions; // the lines it was built from, in order, for writing the world back
+};
+
+int isMaterialKeyword(const char* keyword);
+
+// reads the rest of a "stiffness" or "mass" line and applies it to jello->material, which is created with the
+// world's uniform values first; returns 0 (after printing why) if the line is malformed
+int readMaterialLine(const char* keyword, FILE* file, struct world* jello);
+
+void writeMaterial(FILE* file, const struct material* material);
+
+// removes the springs with both ends marked in mask (per control point), e.g. between two kinematic points: they
+// move no free point. The others keep their order and colours.
+void dropSprings(struct material* material, const unsigned char* mask);
+
+// Adds the spring and damping forces of every spring, each with its own constants, to both of its control points;
+// p, v and force are &jello->p[0][0][0] etc. Returns the elastic potential of the springs.
+double addMaterialSpringForces(const struct material* material, const struct point* p, const struct point* v,
+                               struct point* force);
+
+#endif // #ifndef _MATERIAL_H_
@@ -0,0 +1,294 @@
+#include "obstacle.h"
+
+#include <math.h>
+#include <string.h>
+
+static inline double length(double x, double y, double z)
+{
+    return sqrt(x * x + y * y + z * z);
+}
+
+// unit vector from q to p, or +z if they coincide
+static inline double directionAndDistance(const struct point& p, const struct point& q, struct point* direction)
+{
+    double dx = p.x - q.x, dy = p.y - q.y, dz = p.z - q.z;
+    double l = length(dx, dy, dz);
+    if (l < 1e-12)
+    {
+        direction->x = 0.0;
+        direction->y = 0.0;
+        direction->z = 1.0;
+        return 0.0;
+    }
+    direction->x = dx / l;
+    direction->y = dy / l;
+    direction->z = dz / l;
+    return l;
+}
+
+/* ------------------------------- primitives ------------------------------- */
+
+class SphereObstacle : public Obstacle
+{
+public:
+    SphereObstacle(const struct point& center, double radius) : m_center(center), m_radius(radius) {}
+
+    double distance(const struct point& p, struct point* gradient) const override
+    {
+        return directionAndDistance(p, m_center, gradient) - m_radius;
+    }
+
+    void write(FILE* file) const override
+    {
+        fprintf(file, "sphere %lf %lf %lf %lf\n", m_center.x, m_center.y, m_center.z, m_radius);
+    }
+
+private:
+    struct point m_center;
+    double m_radius;
+};
+
+class CapsuleObstacle : public Obstacle
+{
+public:
+    CapsuleObstacle(const struct point& a, const struct point& b, double radius) : m_a(a), m_b(b), m_radius(radius)
+    {
+        m_ab.x = b.x - a.x;
+        m_ab.y = b.y - a.y;
+        m_ab.z = b.z - a.z;
+        double l2 = m_ab.x * m_ab.x + m_ab.y * m_ab.y + m_ab.z * m_ab.z;
+        m_invLength2 = l2 > 0.0 ? 1.0 / l2 : 0.0;
+    }
+
+    double distance(const struct point& p, struct point* gradient) const override
+    {
+        // closest point on the segment
+        double t = ((p.x - m_a.x) * m_ab.x + (p.y - m_a.y) * m_ab.y + (p.z - m_a.z) * m_ab.z) * m_invLength2;
+        t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+        struct point q = {m_a.x + t * m_ab.x, m_a.y + t * m_ab.y, m_a.z + t * m_ab.z};
+        return directionAndDistance(p, q, gradient) - m_radius;
+    }
+
+    void write(FILE* file) const override
+    {
+        fprintf(file, "capsule %lf %lf %lf %lf %lf %lf %lf\n", m_a.x, m_a.y, m_a.z, m_b.x, m_b.y, m_b.z, m_radius);
+    }
+
+private:
+    struct point m_a, m_b;
+    struct point m_ab;
+    double m_invLength2;
+    double m_radius;
+};
+
+/* -------------------------------- voxel SDF -------------------------------- */
+
+// Precomputed signed distances on a regular grid, e.g. baked from a triangle mesh.
+// The lookup is one trilinear interpolation no matter how complex the original shape was.
+// Outside the grid the obstacle is considered absent.
+class VoxelSdfObstacle : public Obstacle
+{
+public:
+    VoxelSdfObstacle(const std::string& fileName, int nx, int ny, int nz, const struct point& origin, double spacing)
+        : m_fileName(fileName), m_nx(nx), m_ny(ny), m_nz(nz), m_origin(origin), m_spacing(spacing),
+          m_values((size_t)nx * ny * nz)
+    {
+    }
+
+    double* values() { return m_values.data(); }
+
+    double distance(const struct point& p, struct point* gradient) const override;
+
+    void write(FILE* file) const override { fprintf(file, "sdf %s\n", m_fileName.c_str()); }
+
+private:
+    std::string m_fileName;
+    int m_nx, m_ny, m_nz;
+    struct point m_origin;
+    double m_spacing;
+    std::vector<double> m_values; // value (i, j, k) at i * ny * nz + j * nz + k
+};
+
+double VoxelSdfObstacle::distance(const struct point& p, struct point* gradient) const
+{
+    double gx = (p.x - m_origin.x) / m_spacing;
+    double gy = (p.y - m_origin.y) / m_spacing;
+    double gz = (p.z - m_origin.z) / m_spacing;
+
+    if (!(gx >= 0.0 && gy >= 0.0 && gz >= 0.0 && gx <= m_nx - 1 && gy <= m_ny - 1 && gz <= m_nz - 1))
+    {
+        gradient->x = gradient->y = gradient->z = 0.0;
+        return HUGE_VAL;
+    }
+
+    // the last cell is [n-2, n-1], so a point on the far face still has a full cell
+    int ix = (int)gx < m_nx - 2 ? (int)gx : m_nx - 2;
+    int iy = (int)gy < m_ny - 2 ? (int)gy : m_ny - 2;
+    int iz = (int)gz < m_nz - 2 ? (int)gz : m_nz - 2;
+    double fx = gx - ix, fy = gy - iy, fz = gz - iz;
+
+    const double* c = &m_values[(size_t)ix * m_ny * m_nz + (size_t)iy * m_nz + iz];
+    const int sy = m_nz, sx = m_ny * m_nz;
+    double c000 = c[0], c001 = c[1], c010 = c[sy], c011 = c[sy + 1];
+    double c100 = c[sx], c101 = c[sx + 1], c110 = c[sx + sy], c111 = c[sx + sy + 1];
+
+    // interpolate along z, then y, then x; the gradient is the exact derivative of the trilinear interpolant
+    double c00 = c000 + fz * (c001 - c000), c01 = c010 + fz * (c011 - c010);
+    double c10 = c100 + fz * (c101 - c100), c11 = c110 + fz * (c111 - c110);
+    double c0 = c00 + fy * (c01 - c00), c1 = c10 + fy * (c11 - c10);
+    double d = c0 + fx * (c1 - c0);
+
+    double dx = c1 - c0;
+    double dy = (1.0 - fx) * (c01 - c00) + fx * (c11 - c10);
+    double dz = (1.0 - fx) * ((1.0 - fy) * (c001 - c000) + fy * (c011 - c010)) +
+                fx * ((1.0 - fy) * (c101 - c100) + fy * (c111 - c110));
+
+    double l = length(dx, dy, dz);
+    if (l < 1e-12)
+    {
+        gradient->x = gradient->y = 0.0;
+        gradient->z = 1.0;
+    }
+    else
+    {
+        gradient->x = dx / l;
+        gradient->y = dy / l;
+        gradient->z = dz / l;
+    }
+
+    return d;
+}
+
+/*
+  Voxel SDF file (text, like the world file):
+    nx ny nz                 grid size, each at least 2
+    ox oy oz spacing         world position of node (0, 0, 0) and the distance between nodes
+    nx * ny * nz lines       signed distance of node (i, j, k), k fastest, then j, then i
+  fileName is the name on the world-file line, kept for writing the world back; path is where it is opened.
+*/
+static Obstacle* readVoxelSdf(const char* fileName, const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        printf("sdf: can't open file %s\n", path);
+        return NULL;
+    }
+
+    int nx, ny, nz;
+    struct point origin;
+    double spacing;
+    if (fscanf(file, "%d %d %d %lf %lf %lf %lf", &nx, &ny, &nz, &origin.x, &origin.y, &origin.z, &spacing) != 7 ||
+        nx < 2 || ny < 2 || nz < 2 || spacing <= 0.0)
+    {
+        printf("sdf: bad header in %s\n", path);
+        fclose(file);
+        return NULL;
+    }
+
+    VoxelSdfObstacle* obstacle = new VoxelSdfObstacle(fileName, nx, ny, nz, origin, spacing);
+    double* values = obstacle->values();
+    for (size_t n = 0; n < (size_t)nx * ny * nz; n++)
+    {
+        if (fscanf(file, "%lf", &values[n]) != 1)
+        {
+            printf("sdf: %s ends after %d values\n", path, (int)n);
+            delete obstacle;
+            fclose(file);
+            return NULL;
+        }
+    }
+
+    fclose(file);
+    return obstacle;
+}
+
+/* ------------------------------- obstacle set ------------------------------- */
+
+Obstacles::~Obstacles()
+{
+    for (Obstacle* obstacle : m_obstacles)
+    {
+        delete obstacle;
+    }
+}
+
+void Obstacles::addForces(const struct point* p, const struct point* v, const int* particles, int particleCount,
+                          double kCollision, double dCollision, struct point* force, double* energy) const
+{
+    double depth2 = 0.0;
+    for (const Obstacle* obstacle : m_obstacles)
+    {
+        for (int f = 0; f < particleCount; f++)
+        {
+            const int i = particles[f];
+            struct point n;
+            double d = obstacle->distance(p[i], &n);
+            if (d >= 0.0)
+            {
+                continue;
+            }
+
+            // same response as CollisionPlanes: spring on the depth, damping of the approaching velocity
+            double vn = n.x * v[i].x + n.y * v[i].y + n.z * v[i].z;
+            double magnitude = -kCollision * d - dCollision * (vn < 0.0 ? vn : 0.0);
+            force[i].x += magnitude * n.x;
+            force[i].y += magnitude * n.y;
+            force[i].z += magnitude * n.z;
+            depth2 += d * d;
+        }
+    }
+
+    if (energy != NULL)
+    {
+        *energy += 0.5 * kCollision * depth2;
+    }
+}
+
+void Obstacles::write(FILE* file) const
+{
+    for (const Obstacle* obstacle : m_obstacles)
+    {
+        obstacle->write(file);
+    }
+}
+
+bool isObstacleKeyword(const char* keyword)
+{
+    return strcmp(keyword, "sphere") == 0 || strcmp(keyword, "capsule") == 0 || strcmp(keyword, "sdf") == 0;
+}
+
+Obstacle* readObstacle(const char* type, FILE* file, const char* directory)
+{
+    struct point a, b;
+    double radius;
+
+    if (strcmp(type, "sphere") == 0 && fscanf(file, "%lf %lf %lf %lf", &a.x, &a.y, &a.z, &radius) == 4 &&
+        radius > 0.0)
+    {
+        return new SphereObstacle(a, radius);
+    }
+    if (strcmp(type, "capsule") == 0 &&
+        fscanf(file, "%lf %lf %lf %lf %lf %lf %lf", &a.x, &a.y, &a.z, &b.x, &b.y, &b.z, &radius) == 7 &&
+        radius > 0.0)
+    {
+        return new CapsuleObstacle(a, b, radius);
+    }
+    if (strcmp(type, "sdf") == 0)
+    {
+        char fileName[4096];
+        if (fscanf(file, "%4095s", fileName) != 1)
+        {
+            printf("sdf: missing file name\n");
+            return NULL;
+        }
+
+        // relative names are relative to the world file, not to the working directory
+        bool absolute = fileName[0] == '/' || fileName[0] == '\\' || (fileName[0] != 0 && fileName[1] == ':');
+        std::string path = absolute ? std::string(fileName) : std::string(directory) + fileName;
+        return readVoxelSdf(fileName, path.c_str());
+    }
+
+    printf("%s: unknown or malformed obstacle\n", type);
+    return NULL;
+}
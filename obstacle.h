@@ -0,0 +1,60 @@
+#ifndef _OBSTACLE_H_
+#define _OBSTACLE_H_
+
+#include <cstdio>
+
+#include <string>
+#include <vector>
+
+#include "world.h"
+
+// Static obstacle described by a signed distance function (negative inside).
+// Particles inside get the same penalty response as the collision planes: kCollision * depth along the
+// distance gradient, plus dCollision damping of the velocity into the obstacle.
+class Obstacle
+{
+public:
+    virtual ~Obstacle() = default;
+
+    // signed distance at p; *gradient receives the unit outward direction (valid where the distance is < 0)
+    virtual double distance(const struct point& p, struct point* gradient) const = 0;
+
+    // writes the world-file extension line for this obstacle
+    virtual void write(FILE* file) const = 0;
+};
+
+// All obstacles of a world.
+class Obstacles
+{
+public:
+    ~Obstacles();
+
+    void add(Obstacle* obstacle) { m_obstacles.push_back(obstacle); }
+
+    int count() const { return (int)m_obstacles.size(); }
+    const Obstacle* get(int o) const { return m_obstacles[o]; }
+
+    // adds the collision forces of every obstacle to the particles particles[0 .. particleCount-1]; with energy,
+    // also adds the potential of their penalty springs to *energy, as CollisionPlanes::addForces
+    void addForces(const struct point* p, const struct point* v, const int* particles, int particleCount,
+                   double kCollision, double dCollision, struct point* force, double* energy = NULL) const;
+
+    void write(FILE* file) const;
+
+private:
+    std::vector<Obstacle*> m_obstacles;
+};
+
+// reads the rest of an obstacle world-file line whose keyword 'type' has been consumed:
+//   sphere cx cy cz radius
+//   capsule ax ay az bx by bz radius        (segment a-b inflated by radius)
+//   sdf fileName                            (voxel grid, see readVoxelSdf() in obstacle.cpp)
+// a relative sdf file name is looked up in 'directory', the world file's directory with a trailing separator
+// ("" for the working directory); the obstacle writes the name back as it was given
+// returns NULL and prints an error if the type is unknown or the line (or sdf file) is malformed
+Obstacle* readObstacle(const char* type, FILE* file, const char* directory);
+
+// true if 'keyword' starts an obstacle line
+bool isObstacleKeyword(const char* keyword);
+
+#endif // #ifndef _OBSTACLE_H_
@@ -0,0 +1,182 @@
+#include "parallel.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+// One job at a time: the caller publishes a body and a chunk count, bumps the generation, and the workers
+// grab chunk indices until they run out.
+class ThreadPool
+{
+public:
+    ThreadPool() : m_threadCount(0), m_generation(0), m_stop(false), m_body(nullptr), m_count(0), m_chunks(0),
+                   m_nextChunk(0), m_pendingChunks(0)
+    {
+        unsigned int hardware = std::thread::hardware_concurrency();
+        resize(hardware > 0 ? (int)hardware : 1);
+    }
+
+    ~ThreadPool() { stopWorkers(); }
+
+    int threadCount() const { return m_threadCount; }
+
+    void resize(int threadCount)
+    {
+        if (threadCount < 1)
+        {
+            threadCount = 1;
+        }
+
+        std::lock_guard<std::mutex> jobLock(m_jobMutex);
+        stopWorkers();
+
+        m_threadCount = threadCount;
+        m_stop = false;
+        for (int t = 1; t < threadCount; t++)
+        {
+            m_workers.emplace_back(&ThreadPool::workerLoop, this);
+        }
+    }
+
+    void run(int count, const std::function<void(int, int)>& body)
+    {
+        // one job in flight; concurrent callers from different threads queue up here
+        std::lock_guard<std::mutex> jobLock(m_jobMutex);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_body = &body;
+            m_count = count;
+            m_chunks = m_threadCount < count ? m_threadCount : count;
+            m_nextChunk = 0;
+            m_pendingChunks = m_chunks;
+            m_generation++;
+        }
+        m_wake.notify_all();
+
+        s_insideBody = true;
+        runChunks();
+        s_insideBody = false;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_pendingChunks == 0; });
+        m_body = nullptr;
+    }
+
+    static thread_local bool s_insideBody;
+
+private:
+    void stopWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (std::thread& worker : m_workers)
+        {
+            worker.join();
+        }
+        m_workers.clear();
+    }
+
+    // takes chunks until none are left; called by the workers and by the thread that started the job
+    void runChunks()
+    {
+        for (;;)
+        {
+            int chunk;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_nextChunk >= m_chunks)
+                {
+                    return;
+                }
+                chunk = m_nextChunk++;
+            }
+
+            int begin = (int)((long long)m_count * chunk / m_chunks);
+            int end = (int)((long long)m_count * (chunk + 1) / m_chunks);
+            (*m_body)(begin, end);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_pendingChunks == 0)
+            {
+                m_done.notify_one();
+            }
+        }
+    }
+
+    void workerLoop()
+    {
+        s_insideBody = true;
+        unsigned long long seenGeneration = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [&] { return m_stop || m_generation != seenGeneration; });
+                if (m_stop)
+                {
+                    return;
+                }
+                seenGeneration = m_generation;
+            }
+            runChunks();
+        }
+    }
+
+    int m_threadCount;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_jobMutex;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    unsigned long long m_generation;
+    bool m_stop;
+
+    const std::function<void(int, int)>* m_body;
+    int m_count;
+    int m_chunks;
+    int m_nextChunk;
+    int m_pendingChunks;
+};
+
+thread_local bool ThreadPool::s_insideBody = false;
+
+ThreadPool& pool()
+{
+    static ThreadPool threadPool;
+    return threadPool;
+}
+} // namespace
+
+void parallelFor(int count, const std::function<void(int begin, int end)>& body)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    if (ThreadPool::s_insideBody || count == 1 || pool().threadCount() == 1)
+    {
+        body(0, count);
+        return;
+    }
+
+    pool().run(count, body);
+}
+
+int parallelThreadCount()
+{
+    return pool().threadCount();
+}
+
+void setParallelThreadCount(int threadCount)
+{
+    pool().resize(threadCount);
+}
@@ -0,0 +1,18 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <functional>
+
+// Minimal fork-join helper on a persistent pool of worker threads (created on first use).
+// parallelFor splits [0, count) into one contiguous chunk per thread and calls body(begin, end) for each chunk;
+// the calling thread works on the first chunk and the call returns once every chunk is done.
+// Calls made from inside a body run serially on the calling thread, so nesting is safe.
+void parallelFor(int count, const std::function<void(int begin, int end)>& body);
+
+// number of threads parallelFor uses, including the caller; defaults to the hardware concurrency
+int parallelThreadCount();
+
+// changes the number of threads (clamped to at least 1); must not be called from inside a parallelFor body
+void setParallelThreadCount(int threadCount);
+
+#endif // #ifndef _PARALLEL_H_
@@ -0,0 +1,294 @@
+#include "perfCounters.h"
+
+#include <string.h>
+
+#if JELLO_PERF_COUNTERS
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <mutex>
+#include <vector>
+
+#define PERF_MAX_REGIONS 32
+
+static const char* counterNames[PERF_COUNTER_COUNT] = {"cycles",    "instructions", "L1d misses",
+                                                       "LLC misses", "branch miss",  "task ms"};
+
+static bool enabled = false;
+
+// the counters of one thread: one group for the hardware counters (read together), the task clock on its own
+struct threadCounters
+{
+    int leader;                       // -1 = no hardware counter could be opened
+    int fds[PERF_COUNTER_COUNT];      // -1 = not available
+    int groupIndex[PERF_COUNTER_COUNT]; // position in the group read, for the hardware counters
+    int groupSize;
+
+    struct region
+    {
+        const char* name;
+        long long calls;
+        long long totals[PERF_COUNTER_COUNT];
+    };
+    int regionCount;
+    region regions[PERF_MAX_REGIONS];
+};
+
+static std::mutex registryLock;
+static std::vector<threadCounters*> registry; // never shrinks; counters stay open until exit
+static thread_local threadCounters* localCounters = NULL;
+
+static int openCounter(unsigned int type, unsigned long long config, int groupFd)
+{
+    struct perf_event_attr attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.size = sizeof(attributes);
+    attributes.type = type;
+    attributes.config = config;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    attributes.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attributes.disabled = groupFd == -1 ? 1 : 0; // the group starts when its leader is enabled
+
+    // this thread, any CPU
+    return (int)syscall(SYS_perf_event_open, &attributes, 0, -1, groupFd, 0);
+}
+
+static threadCounters* openThreadCounters()
+{
+    const struct
+    {
+        unsigned int type;
+        unsigned long long config;
+    } events[PERF_COUNTER_COUNT] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK}};
+
+    threadCounters* counters = new threadCounters;
+    memset(counters, 0, sizeof(*counters));
+    counters->leader = -1;
+
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+    {
+        counters->fds[c] = -1;
+        if (c == PERF_TASK_CLOCK)
+        {
+            counters->fds[c] = openCounter(events[c].type, events[c].config, -1);
+        }
+        else
+        {
+            counters->fds[c] = openCounter(events[c].type, events[c].config, counters->leader);
+            if (counters->fds[c] != -1)
+            {
+                counters->groupIndex[c] = counters->groupSize++;
+                counters->leader = counters->leader == -1 ? counters->fds[c] : counters->leader;
+            }
+        }
+    }
+
+    if (counters->leader != -1)
+    {
+        ioctl(counters->leader, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    if (counters->fds[PERF_TASK_CLOCK] != -1)
+    {
+        ioctl(counters->fds[PERF_TASK_CLOCK], PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    std::lock_guard<std::mutex> lock(registryLock);
+    registry.push_back(counters);
+    return counters;
+}
+
+// current counter values, scaled up where the kernel had to multiplex the group
+static void readCounters(const threadCounters* counters, long long values[PERF_COUNTER_COUNT])
+{
+    unsigned long long buffer[3 + PERF_COUNTER_COUNT]; // nr, time enabled, time running, values
+
+    memset(values, 0, PERF_COUNTER_COUNT * sizeof(long long));
+    if (counters->leader != -1 && read(counters->leader, buffer, sizeof(buffer)) > 0)
+    {
+        double scale = buffer[2] > 0 ? (double)buffer[1] / buffer[2] : 1.0;
+        for (int c = 0; c < PERF_TASK_CLOCK; c++)
+        {
+            if (counters->fds[c] != -1)
+            {
+                values[c] = (long long)(buffer[3 + counters->groupIndex[c]] * scale);
+            }
+        }
+    }
+    if (counters->fds[PERF_TASK_CLOCK] != -1 && read(counters->fds[PERF_TASK_CLOCK], buffer, sizeof(buffer)) > 0)
+    {
+        values[PERF_TASK_CLOCK] = (long long)buffer[3];
+    }
+}
+
+PerfRegion::PerfRegion(const char* name) : m_name(name), m_active(enabled)
+{
+    if (m_active)
+    {
+        if (localCounters == NULL)
+        {
+            localCounters = openThreadCounters();
+        }
+        readCounters(localCounters, m_start);
+    }
+}
+
+PerfRegion::~PerfRegion()
+{
+    if (!m_active)
+    {
+        return;
+    }
+
+    long long end[PERF_COUNTER_COUNT];
+    readCounters(localCounters, end);
+
+    // a handful of regions, found by their name pointer
+    threadCounters* counters = localCounters;
+    int r = 0;
+    while (r < counters->regionCount && counters->regions[r].name != m_name)
+    {
+        r++;
+    }
+    if (r == counters->regionCount)
+    {
+        if (r == PERF_MAX_REGIONS)
+        {
+            return;
+        }
+        counters->regions[r].name = m_name;
+        counters->regionCount++;
+    }
+
+    counters->regions[r].calls++;
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+    {
+        counters->regions[r].totals[c] += end[c] - m_start[c];
+    }
+}
+
+int perfCountersEnable()
+{
+    if (localCounters == NULL)
+    {
+        localCounters = openThreadCounters();
+    }
+
+    int available = 0;
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+    {
+        available += localCounters->fds[c] != -1;
+    }
+    if (available == 0)
+    {
+        printf("perf counters: perf_event_open failed (%s); check /proc/sys/kernel/perf_event_paranoid\n",
+               strerror(errno));
+        return 0;
+    }
+    if (localCounters->leader == -1)
+    {
+        printf("perf counters: no hardware counters (e.g. in a virtual machine); counting the task clock only\n");
+    }
+
+    enabled = true;
+    return 1;
+}
+
+void perfCountersPrint(FILE* file)
+{
+    std::vector<threadCounters::region> regions;
+    bool available[PERF_COUNTER_COUNT] = {};
+
+    std::lock_guard<std::mutex> lock(registryLock);
+    for (const threadCounters* counters : registry)
+    {
+        for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+        {
+            available[c] = available[c] || counters->fds[c] != -1;
+        }
+        for (int r = 0; r < counters->regionCount; r++)
+        {
+            size_t s = 0;
+            while (s < regions.size() && regions[s].name != counters->regions[r].name)
+            {
+                s++;
+            }
+            if (s == regions.size())
+            {
+                regions.push_back(counters->regions[r]);
+                continue;
+            }
+            regions[s].calls += counters->regions[r].calls;
+            for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+            {
+                regions[s].totals[c] += counters->regions[r].totals[c];
+            }
+        }
+    }
+
+    fprintf(file, "perf counters (all threads, user space):\n  %-20s %10s", "region", "calls");
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+    {
+        fprintf(file, " %14s", counterNames[c]);
+    }
+    fprintf(file, " %6s %10s %10s\n", "IPC", "L1d/kinst", "LLC/kinst");
+
+    for (const threadCounters::region& region : regions)
+    {
+        fprintf(file, "  %-20s %10lld", region.name, region.calls);
+        for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+        {
+            if (!available[c])
+                fprintf(file, " %14s", "-");
+            else if (c == PERF_TASK_CLOCK)
+                fprintf(file, " %14.3f", region.totals[c] * 1e-6);
+            else
+                fprintf(file, " %14lld", region.totals[c]);
+        }
+
+        const long long* t = region.totals;
+        if (available[PERF_CYCLES] && available[PERF_INSTRUCTIONS] && t[PERF_CYCLES] > 0 && t[PERF_INSTRUCTIONS] > 0)
+        {
+            fprintf(file, " %6.2f %10.2f %10.2f\n", (double)t[PERF_INSTRUCTIONS] / t[PERF_CYCLES],
+                    available[PERF_L1D_MISSES] ? 1000.0 * t[PERF_L1D_MISSES] / t[PERF_INSTRUCTIONS] : 0.0,
+                    available[PERF_LLC_MISSES] ? 1000.0 * t[PERF_LLC_MISSES] / t[PERF_INSTRUCTIONS] : 0.0);
+        }
+        else
+        {
+            fprintf(file, " %6s %10s %10s\n", "-", "-", "-");
+        }
+    }
+}
+
+#else // #if JELLO_PERF_COUNTERS
+
+PerfRegion::PerfRegion(const char* name) : m_name(name), m_active(false)
+{
+}
+
+PerfRegion::~PerfRegion()
+{
+}
+
+int perfCountersEnable()
+{
+    printf("perf counters: only available on Linux\n");
+    return 0;
+}
+
+void perfCountersPrint(FILE* file)
+{
+}
+
+#endif // #if JELLO_PERF_COUNTERS
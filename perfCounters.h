@@ -0,0 +1,64 @@
+#ifndef _PERF_COUNTERS_H_
+#define _PERF_COUNTERS_H_
+
+#include <stdio.h>
+
+// Hardware performance counters around code regions, through Linux perf_event_open:
+//
+//   {
+//       PERF_REGION("computeAcceleration"); // counts the rest of the enclosing scope
+//       ...
+//   }
+//
+// Counted per region, per thread, and summed over threads: cycles, instructions, L1 data cache read misses,
+// last-level cache misses, branch misses, and the task clock (a software counter, so virtual machines that
+// hide the hardware counters still get times). The kernel only counts user space of the calling thread.
+//
+// Off until perfCountersEnable() is called: a region then costs one branch. Enabled, every region boundary reads
+// the counters with two system calls (about a microsecond), so only time regions that take much longer.
+// Compiled in on Linux (JELLO_PERF_COUNTERS); elsewhere the functions do nothing and enabling fails.
+#ifndef JELLO_PERF_COUNTERS
+#ifdef __linux__
+#define JELLO_PERF_COUNTERS 1
+#else
+#define JELLO_PERF_COUNTERS 0
+#endif
+#endif
+
+enum perfCounter
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_TASK_CLOCK, // ns
+    PERF_COUNTER_COUNT
+};
+
+class PerfRegion
+{
+public:
+    explicit PerfRegion(const char* name);
+    ~PerfRegion();
+
+private:
+    const char* m_name;
+    long long m_start[PERF_COUNTER_COUNT];
+    bool m_active;
+};
+
+#define PERF_CONCATENATE2(a, b) a##b
+#define PERF_CONCATENATE(a, b) PERF_CONCATENATE2(a, b)
+#define PERF_REGION(name) PerfRegion PERF_CONCATENATE(perfRegion, __LINE__)(name)
+
+// Starts counting in every thread that enters a region from now on. Returns 1 if the counters could be opened
+// on the calling thread, 0 (after printing why) if not; counters the CPU or the kernel doesn't offer are left out
+// and printed as "-".
+int perfCountersEnable();
+
+// Per region: calls, the counter totals, instructions per cycle, and misses per thousand instructions.
+// Call while no region is being counted, e.g. after the run.
+void perfCountersPrint(FILE* file);
+
+#endif // #ifndef _PERF_COUNTERS_H_
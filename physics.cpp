@@ -8,16 +8,30 @@
 #include "physics.h"
 
 #include <math.h>
-
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "collision.h"
+#include "forceField.h"
+#include "kinematics.h"
+#include "material.h"
+#include "obstacle.h"
+#include "perfCounters.h"
+#include "profiler.h"
+#include "projectiveDynamics.h"
+#include "selfCollision.h"
 #include "utils.h"
+#include "xpbd.h"
 
 /* Computes acceleration to every control point of the jello cube,
    which is in state given by 'jello'.
    Returns result in array 'a'. */
 
 // Helper function to compute spring force between two points
+// With potential, also adds half the spring's elastic energy: every spring is evaluated once from each end.
 void computeSpringForce(point p1, point p2, point v1, point v2, double restLength, double kHook,
-                        double kDamp, point* force)
+                        double kDamp, point* force, double* potential)
 {
     // Vector from p1 to p2
     point L;
@@ -39,6 +53,10 @@ void computeSpringForce(point p1, point p2, point v1, point v2, double restLengt
     point springForceVec;
     double springMagnitude = -kHook * (length - restLength);
     pMULTIPLY(unitL, springMagnitude, springForceVec);
+    if (potential != NULL)
+    {
+        *potential += 0.25 * kHook * (length - restLength) * (length - restLength);
+    }
 
     // Damping force: F = -kd * ((v1-v2) dot unitL)
     point vDiff;
@@ -54,7 +72,7 @@ void computeSpringForce(point p1, point p2, point v1, point v2, double restLengt
     pSUM(*force, dampingForceVec, *force);
 }
 
-void addStructuralForces(struct world* jello, int i, int j, int k, point* force)
+void addStructuralForces(struct world* jello, int i, int j, int k, point* force, double* potential)
 {
     // Connect to 6 immediate neighbors (x, y, z directions)
     int neighbors[6][3] = {
@@ -78,12 +96,12 @@ void addStructuralForces(struct world* jello, int i, int j, int k, point* force)
         {
             computeSpringForce(jello->p[i][j][k], jello->p[ni][nj][nk], jello->v[i][j][k],
                                jello->v[ni][nj][nk], restLength, jello->kElastic, jello->dElastic,
-                               force);
+                               force, potential);
         }
     }
 }
 
-void addShearForces(struct world* jello, int i, int j, int k, point* force)
+void addShearForces(struct world* jello, int i, int j, int k, point* force, double* potential)
 {
     // Face diagonals (12 springs per point)
     int planeShearNeighbors[12][3] = {// xy plane diagonals
@@ -116,7 +134,7 @@ void addShearForces(struct world* jello, int i, int j, int k, point* force)
         {
             computeSpringForce(jello->p[i][j][k], jello->p[ni][nj][nk], jello->v[i][j][k],
                                jello->v[ni][nj][nk], planeRestLength, jello->kElastic,
-                               jello->dElastic, force);
+                               jello->dElastic, force, potential);
         }
     }
 
@@ -136,12 +154,12 @@ void addShearForces(struct world* jello, int i, int j, int k, point* force)
         {
             computeSpringForce(jello->p[i][j][k], jello->p[ni][nj][nk], jello->v[i][j][k],
                                jello->v[ni][nj][nk], bodyRestLength, jello->kElastic,
-                               jello->dElastic, force);
+                               jello->dElastic, force, potential);
         }
     }
 }
 
-void addBendForces(struct world* jello, int i, int j, int k, point* force)
+void addBendForces(struct world* jello, int i, int j, int k, point* force, double* potential)
 {
     // Connect to points 2 units away in each axis direction
     int bendNeighbors[6][3] = {{2, 0, 0}, {-2, 0, 0}, {0, 2, 0}, {0, -2, 0}, {0, 0, 2}, {0, 0, -2}};
@@ -160,379 +178,921 @@ void addBendForces(struct world* jello, int i, int j, int k, point* force)
         {
             computeSpringForce(jello->p[i][j][k], jello->p[ni][nj][nk], jello->v[i][j][k],
                                jello->v[ni][nj][nk], restLength, jello->kElastic, jello->dElastic,
-                               force);
+                               force, potential);
         }
     }
 }
 
 void addForceFieldForce(struct world* jello, int i, int j, int k, point* force)
 {
-    if (jello->forceField == NULL)
+    if (jello->field == NULL)
     {
         return;
     }
 
-    point p = jello->p[i][j][k];
+    int particle = (i * JELLO_SUBPOINTS + j) * JELLO_SUBPOINTS + k;
+    jello->field->addForce(particle, jello->p[i][j][k], jello->time, force);
+}
 
-    // Map position to grid coordinates [0, resolution-1]
-    // Assuming the jello cube is positioned in [0, JELLO_SUBDIVISIONS] range (natural grid
-    // coordinates)
-    double x_grid = p.x;
-    double y_grid = p.y;
-    double z_grid = p.z;
+// the (i, j, k) of control point (i * JELLO_SUBPOINTS + j) * JELLO_SUBPOINTS + k
+static inline void particleIndex(int particle, int* i, int* j, int* k)
+{
+    *i = particle / (JELLO_SUBPOINTS * JELLO_SUBPOINTS);
+    *j = particle / JELLO_SUBPOINTS % JELLO_SUBPOINTS;
+    *k = particle % JELLO_SUBPOINTS;
+}
 
-    // Clamp to valid range
-    if (x_grid < 0)
+void computeAcceleration(struct world* jello,
+                         point a[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS])
+{
+    PROFILE_ZONE("computeAcceleration");
+    PERF_REGION("computeAcceleration");
+    int i, j, k, f;
+
+    // The per-point passes run over the free points only, and kinematic points get no acceleration; the springs
+    // between a free and a kinematic point still pull the free one. The energy sample then covers the free points.
+    const int* freeList;
+    const int freeCount = freePoints(jello, &freeList);
+
+    // energy diagnostics requested by stepWorld: summed by the passes below instead of in a sweep of their own
+    struct energySample* sample = jello->energy != NULL && jello->energy->requested ? jello->energy : NULL;
+    double springPotential = 0.0, collisionPotential = 0.0;
+    double* potential = sample != NULL ? &springPotential : NULL;
+    double* collision = sample != NULL ? &collisionPotential : NULL;
+
+    // Compute the internal and external forces for each mass point, accumulated in 'a'.
+    // One pass per kind of force, so each can be timed; the per-point summation order is the same as in one pass.
+    const struct material* material = jello->material;
+    if (material != NULL)
     {
-        x_grid = 0;
+        // every spring once from the list, with its own constants
+        PROFILE_ZONE("material springs");
+        memset(a, 0, JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS * sizeof(point));
+        springPotential = addMaterialSpringForces(material, &jello->p[0][0][0], &jello->v[0][0][0], &a[0][0][0]);
     }
-    if (x_grid > jello->resolution - 1)
+    else
     {
-        x_grid = jello->resolution - 1;
+        {
+            PROFILE_ZONE("structural springs");
+            for (f = 0; f < freeCount; f++)
+            {
+                particleIndex(freeList[f], &i, &j, &k);
+                point* force = &a[i][j][k];
+
+                // Reset force accumulator
+                pMAKE(0.0, 0.0, 0.0, *force);
+
+                addStructuralForces(jello, i, j, k, force, potential);
+            }
+        }
+
+        {
+            PROFILE_ZONE("shear springs");
+            for (f = 0; f < freeCount; f++)
+            {
+                particleIndex(freeList[f], &i, &j, &k);
+                addShearForces(jello, i, j, k, &a[i][j][k], potential);
+            }
+        }
+
+        {
+            PROFILE_ZONE("bend springs");
+            for (f = 0; f < freeCount; f++)
+            {
+                particleIndex(freeList[f], &i, &j, &k);
+                addBendForces(jello, i, j, k, &a[i][j][k], potential);
+            }
+        }
     }
-    if (y_grid < 0)
+
+    if (jello->field != NULL || jello->externalForce != NULL)
     {
-        y_grid = 0;
+        PROFILE_ZONE("force field");
+        PERF_REGION("force field");
+        for (f = 0; f < freeCount; f++)
+        {
+            particleIndex(freeList[f], &i, &j, &k);
+            point* force = &a[i][j][k];
+
+            if (jello->field != NULL)
+            {
+                addForceFieldForce(jello, i, j, k, force);
+            }
+
+            if (jello->externalForce != NULL)
+            {
+                pSUM(*force, jello->externalForce[freeList[f]], *force);
+            }
+        }
     }
-    if (y_grid > jello->resolution - 1)
+
+    // Collision forces, the free mass points against all planes, then obstacles, then the cube's own surface
     {
-        y_grid = jello->resolution - 1;
+        PROFILE_ZONE("collision");
+        if (jello->planes != NULL)
+        {
+            jello->planes->addForces(&jello->p[0][0][0], &jello->v[0][0][0], freeList, freeCount, jello->kCollision,
+                                     jello->dCollision, &a[0][0][0], collision);
+        }
+        if (jello->obstacles != NULL)
+        {
+            jello->obstacles->addForces(&jello->p[0][0][0], &jello->v[0][0][0], freeList, freeCount,
+                                        jello->kCollision, jello->dCollision, &a[0][0][0], collision);
+        }
+        if (jello->selfCollision != NULL)
+        {
+            jello->selfCollision->addForces(&jello->p[0][0][0], &jello->v[0][0][0], jello->kCollision,
+                                            jello->dCollision, &a[0][0][0], kinematicMask(jello));
+            collisionPotential += jello->selfCollision->contactEnergy();
+        }
     }
-    if (z_grid < 0)
+
+    if (jello->kinematics != NULL)
     {
-        z_grid = 0;
+        for (int particle : jello->kinematics->points)
+        {
+            pMAKE(0.0, 0.0, 0.0, (&a[0][0][0])[particle]);
+        }
     }
-    if (z_grid > jello->resolution - 1)
+
+    // Forces to accelerations, and the sums over the velocities for the energy diagnostics.
+    // The masses of a material per point, or the uniform mass read with a stride of 0: the same loop either way.
+    const double uniformMass = jello->mass, uniformInverseMass = 1.0 / jello->mass;
+    const double* mass = material != NULL ? material->mass.data() : &uniformMass;
+    const double* inverseMass = material != NULL ? material->inverseMass.data() : &uniformInverseMass;
+    const int stride = material != NULL ? 1 : 0;
+    double kinetic2 = 0.0;
+    point momentum = {0.0, 0.0, 0.0};
+    for (f = 0; f < freeCount; f++)
     {
-        z_grid = jello->resolution - 1;
+        point& acceleration = (&a[0][0][0])[freeList[f]];
+        int particle = freeList[f] * stride;
+        pMULTIPLY(acceleration, inverseMass[particle], acceleration);
+        if (sample != NULL)
+        {
+            const point& v = (&jello->v[0][0][0])[freeList[f]];
+            kinetic2 += mass[particle] * (v.x * v.x + v.y * v.y + v.z * v.z);
+            momentum.x += mass[particle] * v.x;
+            momentum.y += mass[particle] * v.y;
+            momentum.z += mass[particle] * v.z;
+        }
     }
 
-    // Trilinear interpolation
-    int x0 = (int)floor(x_grid);
-    int y0 = (int)floor(y_grid);
-    int z0 = (int)floor(z_grid);
-    int x1 = (x0 < jello->resolution - 1) ? x0 + 1 : x0;
-    int y1 = (y0 < jello->resolution - 1) ? y0 + 1 : y0;
-    int z1 = (z0 < jello->resolution - 1) ? z0 + 1 : z0;
+    if (sample != NULL)
+    {
+        sample->requested = 0;
+        sample->time = jello->time;
+        sample->kinetic = 0.5 * kinetic2;
+        sample->spring = springPotential;
+        sample->collision = collisionPotential;
+        sample->momentum = momentum;
+    }
+}
 
-    double xd = x_grid - x0;
-    double yd = y_grid - y0;
-    double zd = z_grid - z0;
+/* performs one step of Euler Integration */
+/* as a result, updates the jello structure */
+void Euler(struct world* jello)
+{
+    int i, j, k, f;
+    const int* freeList;
+    const int freeCount = freePoints(jello, &freeList);
+    point a[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS];
 
-    // Bounds checking for array access
-    if (x0 < 0 || x1 >= jello->resolution || y0 < 0 || y1 >= jello->resolution || z0 < 0 ||
-        z1 >= jello->resolution)
+    computeAcceleration(jello, a);
+
+    for (f = 0; f < freeCount; f++)
     {
-        return;
+        particleIndex(freeList[f], &i, &j, &k);
+        jello->p[i][j][k].x += jello->dt * jello->v[i][j][k].x;
+        jello->p[i][j][k].y += jello->dt * jello->v[i][j][k].y;
+        jello->p[i][j][k].z += jello->dt * jello->v[i][j][k].z;
+        jello->v[i][j][k].x += jello->dt * a[i][j][k].x;
+        jello->v[i][j][k].y += jello->dt * a[i][j][k].y;
+        jello->v[i][j][k].z += jello->dt * a[i][j][k].z;
     }
 
-    // Get force field values at 8 corners
-    int stride = jello->resolution * jello->resolution;
-    point f000 = jello->forceField[x0 + y0 * jello->resolution + z0 * stride];
-    point f100 = jello->forceField[x1 + y0 * jello->resolution + z0 * stride];
-    point f010 = jello->forceField[x0 + y1 * jello->resolution + z0 * stride];
-    point f110 = jello->forceField[x1 + y1 * jello->resolution + z0 * stride];
-    point f001 = jello->forceField[x0 + y0 * jello->resolution + z1 * stride];
-    point f101 = jello->forceField[x1 + y0 * jello->resolution + z1 * stride];
-    point f011 = jello->forceField[x0 + y1 * jello->resolution + z1 * stride];
-    point f111 = jello->forceField[x1 + y1 * jello->resolution + z1 * stride];
-
-    // Trilinear interpolation using macros
-    point f00, f01, f10, f11, f0, f1, f;
-
-    // Interpolate in x direction
-    f00.x = f000.x * (1 - xd) + f100.x * xd;
-    f00.y = f000.y * (1 - xd) + f100.y * xd;
-    f00.z = f000.z * (1 - xd) + f100.z * xd;
-
-    f01.x = f001.x * (1 - xd) + f101.x * xd;
-    f01.y = f001.y * (1 - xd) + f101.y * xd;
-    f01.z = f001.z * (1 - xd) + f101.z * xd;
-
-    f10.x = f010.x * (1 - xd) + f110.x * xd;
-    f10.y = f010.y * (1 - xd) + f110.y * xd;
-    f10.z = f010.z * (1 - xd) + f110.z * xd;
-
-    f11.x = f011.x * (1 - xd) + f111.x * xd;
-    f11.y = f011.y * (1 - xd) + f111.y * xd;
-    f11.z = f011.z * (1 - xd) + f111.z * xd;
-
-    // Interpolate in y direction
-    f0.x = f00.x * (1 - yd) + f10.x * yd;
-    f0.y = f00.y * (1 - yd) + f10.y * yd;
-    f0.z = f00.z * (1 - yd) + f10.z * yd;
-
-    f1.x = f01.x * (1 - yd) + f11.x * yd;
-    f1.y = f01.y * (1 - yd) + f11.y * yd;
-    f1.z = f01.z * (1 - yd) + f11.z * yd;
-
-    // Interpolate in z direction
-    f.x = f0.x * (1 - zd) + f1.x * zd;
-    f.y = f0.y * (1 - zd) + f1.y * zd;
-    f.z = f0.z * (1 - zd) + f1.z * zd;
-
-    // Add interpolated force
-    pSUM(*force, f, *force);
+    jello->time += jello->dt;
+    applyKinematics(jello->kinematics, jello->time, &jello->p[0][0][0], &jello->v[0][0][0]);
 }
 
-void addCollisionForces(struct world* jello, int i, int j, int k, point* force)
+/* performs one step of RK4 Integration */
+/* as a result, updates the jello structure */
+void RK4(struct world* jello)
 {
-    point p = jello->p[i][j][k];
-    point v = jello->v[i][j][k];
+    point F1p[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS],
+        F1v[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS],
+        F2p[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS],
+        F2v[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS],
+        F3p[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS],
+        F3v[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS],
+        F4p[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS],
+        F4v[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS];
 
-    // Bounding box: [-2, 2] range
-    double xMin = -2.0, xMax = 2.0;
-    double yMin = -2.0, yMax = 2.0;
-    double zMin = -2.0, zMax = 2.0;
+    point a[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS];
 
-    double penetration;
+    struct world buffer;
+
+    int i, j, k, f;
+    const int* freeList;
+    const int freeCount = freePoints(jello, &freeList);
+
+    buffer = *jello; // make a copy of jello
+
+    computeAcceleration(jello, a);
 
-    // X faces - wall at xMin (x = -2)
-    if (p.x < xMin)
     {
-        penetration = xMin - p.x;                    // Positive: how far past the wall
-        force->x += jello->kCollision * penetration; // Push out (positive direction)
-        if (v.x < 0)                                 // Also moving into wall
+        PROFILE_ZONE("RK4 stage update");
+        for (f = 0; f < freeCount; f++)
         {
-            force->x += jello->dCollision * fabs(v.x); // Add damping force (positive)
+            particleIndex(freeList[f], &i, &j, &k);
+            pMULTIPLY(jello->v[i][j][k], jello->dt, F1p[i][j][k]);
+            pMULTIPLY(a[i][j][k], jello->dt, F1v[i][j][k]);
+            pMULTIPLY(F1p[i][j][k], 0.5, buffer.p[i][j][k]);
+            pMULTIPLY(F1v[i][j][k], 0.5, buffer.v[i][j][k]);
+            pSUM(jello->p[i][j][k], buffer.p[i][j][k], buffer.p[i][j][k]);
+            pSUM(jello->v[i][j][k], buffer.v[i][j][k], buffer.v[i][j][k]);
         }
     }
-    // X faces - wall at xMax (x = 2)
-    if (p.x > xMax)
+
+    buffer.time = jello->time + 0.5 * jello->dt;
+    applyKinematics(buffer.kinematics, buffer.time, &buffer.p[0][0][0], &buffer.v[0][0][0]);
+    computeAcceleration(&buffer, a);
+
     {
-        penetration = p.x - xMax;                    // Positive: how far past the wall
-        force->x -= jello->kCollision * penetration; // Push back (negative direction)
-        if (v.x > 0)                                 // Also moving into wall
+        PROFILE_ZONE("RK4 stage update");
+        for (f = 0; f < freeCount; f++)
         {
-            force->x -= jello->dCollision * fabs(v.x); // Subtract damping force (negative)
+            particleIndex(freeList[f], &i, &j, &k);
+            // F2p = dt * buffer.v;
+            pMULTIPLY(buffer.v[i][j][k], jello->dt, F2p[i][j][k]);
+            // F2v = dt * a(buffer.p,buffer.v);
+            pMULTIPLY(a[i][j][k], jello->dt, F2v[i][j][k]);
+            pMULTIPLY(F2p[i][j][k], 0.5, buffer.p[i][j][k]);
+            pMULTIPLY(F2v[i][j][k], 0.5, buffer.v[i][j][k]);
+            pSUM(jello->p[i][j][k], buffer.p[i][j][k], buffer.p[i][j][k]);
+            pSUM(jello->v[i][j][k], buffer.v[i][j][k], buffer.v[i][j][k]);
         }
     }
 
-    // Y faces - wall at yMin (y = -2)
-    if (p.y < yMin)
+    computeAcceleration(&buffer, a);
+
     {
-        penetration = yMin - p.y;
-        force->y += jello->kCollision * penetration;
-        if (v.y < 0)
+        PROFILE_ZONE("RK4 stage update");
+        for (f = 0; f < freeCount; f++)
         {
-            force->y += jello->dCollision * fabs(v.y);
+            particleIndex(freeList[f], &i, &j, &k);
+            // F3p = dt * buffer.v;
+            pMULTIPLY(buffer.v[i][j][k], jello->dt, F3p[i][j][k]);
+            // F3v = dt * a(buffer.p,buffer.v);
+            pMULTIPLY(a[i][j][k], jello->dt, F3v[i][j][k]);
+            pMULTIPLY(F3p[i][j][k], 1.0, buffer.p[i][j][k]);
+            pMULTIPLY(F3v[i][j][k], 1.0, buffer.v[i][j][k]);
+            pSUM(jello->p[i][j][k], buffer.p[i][j][k], buffer.p[i][j][k]);
+            pSUM(jello->v[i][j][k], buffer.v[i][j][k], buffer.v[i][j][k]);
         }
     }
-    // Y faces - wall at yMax (y = 2)
-    if (p.y > yMax)
+    buffer.time = jello->time + jello->dt;
+    applyKinematics(buffer.kinematics, buffer.time, &buffer.p[0][0][0], &buffer.v[0][0][0]);
+    computeAcceleration(&buffer, a);
+
     {
-        penetration = p.y - yMax;
-        force->y -= jello->kCollision * penetration;
-        if (v.y > 0)
+        PROFILE_ZONE("RK4 stage update");
+        for (f = 0; f < freeCount; f++)
         {
-            force->y -= jello->dCollision * fabs(v.y);
+            particleIndex(freeList[f], &i, &j, &k);
+            // F3p = dt * buffer.v;
+            pMULTIPLY(buffer.v[i][j][k], jello->dt, F4p[i][j][k]);
+            // F3v = dt * a(buffer.p,buffer.v);
+            pMULTIPLY(a[i][j][k], jello->dt, F4v[i][j][k]);
+
+            pMULTIPLY(F2p[i][j][k], 2, buffer.p[i][j][k]);
+            pMULTIPLY(F3p[i][j][k], 2, buffer.v[i][j][k]);
+            pSUM(buffer.p[i][j][k], buffer.v[i][j][k], buffer.p[i][j][k]);
+            pSUM(buffer.p[i][j][k], F1p[i][j][k], buffer.p[i][j][k]);
+            pSUM(buffer.p[i][j][k], F4p[i][j][k], buffer.p[i][j][k]);
+            pMULTIPLY(buffer.p[i][j][k], 1.0 / 6, buffer.p[i][j][k]);
+            pSUM(buffer.p[i][j][k], jello->p[i][j][k], jello->p[i][j][k]);
+
+            pMULTIPLY(F2v[i][j][k], 2, buffer.p[i][j][k]);
+            pMULTIPLY(F3v[i][j][k], 2, buffer.v[i][j][k]);
+            pSUM(buffer.p[i][j][k], buffer.v[i][j][k], buffer.p[i][j][k]);
+            pSUM(buffer.p[i][j][k], F1v[i][j][k], buffer.p[i][j][k]);
+            pSUM(buffer.p[i][j][k], F4v[i][j][k], buffer.p[i][j][k]);
+            pMULTIPLY(buffer.p[i][j][k], 1.0 / 6, buffer.p[i][j][k]);
+            pSUM(buffer.p[i][j][k], jello->v[i][j][k], jello->v[i][j][k]);
         }
     }
 
-    // Z faces - wall at zMin (z = -2)
-    if (p.z < zMin)
+    jello->time += jello->dt;
+    applyKinematics(jello->kinematics, jello->time, &jello->p[0][0][0], &jello->v[0][0][0]);
+
+    return;
+}
+
+/* performs one step of symplectic (semi-implicit) Euler integration */
+/* the velocities are updated first and the new velocities move the points; one force evaluation per step
+   like Euler, but the energy stays bounded instead of growing, so it is stable at much larger timesteps */
+void SymplecticEuler(struct world* jello)
+{
+    int i, j, k, f;
+    const int* freeList;
+    const int freeCount = freePoints(jello, &freeList);
+    point a[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS];
+
+    computeAcceleration(jello, a);
+
+    for (f = 0; f < freeCount; f++)
     {
-        penetration = zMin - p.z;
-        force->z += jello->kCollision * penetration;
-        if (v.z < 0)
-        {
-            force->z += jello->dCollision * fabs(v.z);
-        }
+        particleIndex(freeList[f], &i, &j, &k);
+        jello->v[i][j][k].x += jello->dt * a[i][j][k].x;
+        jello->v[i][j][k].y += jello->dt * a[i][j][k].y;
+        jello->v[i][j][k].z += jello->dt * a[i][j][k].z;
+        jello->p[i][j][k].x += jello->dt * jello->v[i][j][k].x;
+        jello->p[i][j][k].y += jello->dt * jello->v[i][j][k].y;
+        jello->p[i][j][k].z += jello->dt * jello->v[i][j][k].z;
+    }
+
+    jello->time += jello->dt;
+    applyKinematics(jello->kinematics, jello->time, &jello->p[0][0][0], &jello->v[0][0][0]);
+}
+
+/* performs one step of velocity Verlet integration, in its position (drift-kick-drift) form */
+/* half a step of motion, a full velocity update with the forces at the midpoint, then the other half step.
+   Second order and symplectic with one force evaluation per step; unlike the kick-drift-kick form it needs no
+   acceleration kept from the previous step, so the world can be edited (or contacts change) between steps. */
+void Verlet(struct world* jello)
+{
+    int i, j, k, f;
+    const int* freeList;
+    const int freeCount = freePoints(jello, &freeList);
+    point a[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS];
+    double time = jello->time;
+    double halfStep = 0.5 * jello->dt;
+
+    for (f = 0; f < freeCount; f++)
+    {
+        particleIndex(freeList[f], &i, &j, &k);
+        jello->p[i][j][k].x += halfStep * jello->v[i][j][k].x;
+        jello->p[i][j][k].y += halfStep * jello->v[i][j][k].y;
+        jello->p[i][j][k].z += halfStep * jello->v[i][j][k].z;
     }
-    // Z faces - wall at zMax (z = 2)
-    if (p.z > zMax)
+
+    jello->time = time + halfStep;
+    applyKinematics(jello->kinematics, jello->time, &jello->p[0][0][0], &jello->v[0][0][0]);
+    computeAcceleration(jello, a);
+
+    for (f = 0; f < freeCount; f++)
+    {
+        particleIndex(freeList[f], &i, &j, &k);
+        jello->v[i][j][k].x += jello->dt * a[i][j][k].x;
+        jello->v[i][j][k].y += jello->dt * a[i][j][k].y;
+        jello->v[i][j][k].z += jello->dt * a[i][j][k].z;
+        jello->p[i][j][k].x += halfStep * jello->v[i][j][k].x;
+        jello->p[i][j][k].y += halfStep * jello->v[i][j][k].y;
+        jello->p[i][j][k].z += halfStep * jello->v[i][j][k].z;
+    }
+
+    jello->time = time + jello->dt;
+    applyKinematics(jello->kinematics, jello->time, &jello->p[0][0][0], &jello->v[0][0][0]);
+}
+
+/* Dormand-Prince 5(4) tableau: nodes c, stage weights a, 5th-order weights b (the last stage row) and the
+   error weights e = b - b*, where b* are the embedded 4th-order weights */
+static const double dopriC[7] = {0.0, 1.0 / 5, 3.0 / 10, 4.0 / 5, 8.0 / 9, 1.0, 1.0};
+static const double dopriA[7][6] = {
+    {0, 0, 0, 0, 0, 0},
+    {1.0 / 5, 0, 0, 0, 0, 0},
+    {3.0 / 40, 9.0 / 40, 0, 0, 0, 0},
+    {44.0 / 45, -56.0 / 15, 32.0 / 9, 0, 0, 0},
+    {19372.0 / 6561, -25360.0 / 2187, 64448.0 / 6561, -212.0 / 729, 0, 0},
+    {9017.0 / 3168, -355.0 / 33, 46732.0 / 5247, 49.0 / 176, -5103.0 / 18656, 0},
+    {35.0 / 384, 0, 500.0 / 1113, 125.0 / 192, -2187.0 / 6784, 11.0 / 84}};
+static const double dopriE[7] = {71.0 / 57600,     0, -71.0 / 16695, 71.0 / 1920, -17253.0 / 339200,
+                                 22.0 / 525, -1.0 / 40};
+
+#define DOPRI5_DEFAULT_RELATIVE_TOLERANCE 1e-4
+#define DOPRI5_DEFAULT_ABSOLUTE_TOLERANCE 1e-5
+
+/* stage derivatives of one DOPRI5 substep: dp/dt = v (the stage velocity), dv/dt = a */
+struct dopriStages
+{
+    point p0[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS];
+    point v0[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS];
+    point kp[7][JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS];
+    point kv[7][JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS];
+};
+
+// about 200 KB, too much for the stack of a worker thread and too much to allocate per step: one per thread,
+// allocated on the thread's first DOPRI5 step and kept until exit (Scene steps bodies on the worker threads)
+static thread_local dopriStages* localStages = NULL;
+
+/* sets jello->p, v of the free points to y0 + h * sum_j w[j] k[j] over the first 'stages' stage derivatives */
+static void dopriCombine(struct world* jello, const dopriStages* s, const double* w, int stages, double h)
+{
+    const int* freeList;
+    const int count = freePoints(jello, &freeList);
+    const point* p0 = &s->p0[0][0][0];
+    const point* v0 = &s->v0[0][0][0];
+    point* p = &jello->p[0][0][0];
+    point* v = &jello->v[0][0][0];
+
+    for (int f = 0; f < count; f++)
     {
-        penetration = p.z - zMax;
-        force->z -= jello->kCollision * penetration;
-        if (v.z > 0)
+        const int n = freeList[f];
+        point dp = {0.0, 0.0, 0.0}, dv = {0.0, 0.0, 0.0};
+        for (int j = 0; j < stages; j++)
         {
-            force->z -= jello->dCollision * fabs(v.z);
+            const point& kp = (&s->kp[j][0][0][0])[n];
+            const point& kv = (&s->kv[j][0][0][0])[n];
+            dp.x += w[j] * kp.x, dp.y += w[j] * kp.y, dp.z += w[j] * kp.z;
+            dv.x += w[j] * kv.x, dv.y += w[j] * kv.y, dv.z += w[j] * kv.z;
         }
+        p[n].x = p0[n].x + h * dp.x, p[n].y = p0[n].y + h * dp.y, p[n].z = p0[n].z + h * dp.z;
+        v[n].x = v0[n].x + h * dv.x, v[n].y = v0[n].y + h * dv.y, v[n].z = v0[n].z + h * dv.z;
     }
 }
 
-void computeAcceleration(struct world* jello,
-                         point a[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS])
+/* evaluates stage 'stage' at the state currently in jello->p, v */
+static void dopriEvaluate(struct world* jello, dopriStages* s, int stage)
 {
-    int i, j, k;
-    point force;
+    memcpy(s->kp[stage], jello->v, sizeof(jello->v));
+    computeAcceleration(jello, s->kv[stage]);
+}
 
-    // Initialize all accelerations
-    for (i = 0; i <= JELLO_SUBDIVISIONS; i++)
+/* RMS over all position and velocity components of error / (atol + rtol * max(|y0|, |y1|)); <= 1 is acceptable */
+static double dopriErrorNorm(const struct world* jello, const dopriStages* s, double h, double relativeTolerance,
+                             double absoluteTolerance)
+{
+    const int count = JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS;
+    const double* y0[2] = {&s->p0[0][0][0].x, &s->v0[0][0][0].x};
+    const double* y1[2] = {&jello->p[0][0][0].x, &jello->v[0][0][0].x};
+    double sum = 0.0;
+
+    for (int part = 0; part < 2; part++)
     {
-        for (j = 0; j <= JELLO_SUBDIVISIONS; j++)
+        for (int n = 0; n < 3 * count; n++)
         {
-            for (k = 0; k <= JELLO_SUBDIVISIONS; k++)
+            double error = 0.0;
+            for (int j = 0; j < 7; j++)
             {
-                pMAKE(0.0, 0.0, 0.0, a[i][j][k]);
+                const double* k = part == 0 ? &s->kp[j][0][0][0].x : &s->kv[j][0][0][0].x;
+                error += dopriE[j] * k[n];
             }
+            double scale = absoluteTolerance + relativeTolerance * fmax(fabs(y0[part][n]), fabs(y1[part][n]));
+            double ratio = h * error / scale;
+            sum += ratio * ratio;
         }
     }
 
-    // Compute forces for each mass point
-    for (i = 0; i <= JELLO_SUBDIVISIONS; i++)
+    return sqrt(sum / (2 * 3 * count));
+}
+
+/* advances the jello by dt with adaptive Dormand-Prince 5(4) substeps */
+/* Each substep estimates its local error from the embedded 4th-order solution and is retried with a smaller size
+   if the error exceeds the tolerances; the next size is predicted from the error either way. Quiet motion runs at
+   substeps far larger than an RK4 dt, impacts get as many small ones as they need. The last stage of a substep is
+   the first of the next (FSAL), so an accepted substep costs 6 force evaluations. The substep size is carried over
+   to the next call in jello->adaptive, together with the accepted / rejected counts. */
+void DOPRI5(struct world* jello)
+{
+    if (jello->adaptive == NULL)
     {
-        for (j = 0; j <= JELLO_SUBDIVISIONS; j++)
+        jello->adaptive = (struct adaptiveStep*)calloc(1, sizeof(struct adaptiveStep));
+        jello->adaptive->relativeTolerance = DOPRI5_DEFAULT_RELATIVE_TOLERANCE;
+        jello->adaptive->absoluteTolerance = DOPRI5_DEFAULT_ABSOLUTE_TOLERANCE;
+    }
+
+    struct adaptiveStep* control = jello->adaptive;
+    if (localStages == NULL)
+    {
+        localStages = new dopriStages;
+    }
+    dopriStages* s = localStages;
+
+    const double end = jello->time + jello->dt;
+    const double minStep = 1e-6 * jello->dt;
+    double h = control->step > 0.0 ? control->step : jello->dt;
+    bool haveFirstStage = false;
+
+    while (jello->time < end)
+    {
+        // substeps that would leave a sliver of the interval are stretched to its end
+        double remaining = end - jello->time;
+        bool last = h >= 0.99 * remaining;
+        double substep = last ? remaining : h;
+        double time = jello->time;
+
+        memcpy(s->p0, jello->p, sizeof(jello->p));
+        memcpy(s->v0, jello->v, sizeof(jello->v));
+        if (!haveFirstStage)
         {
-            for (k = 0; k <= JELLO_SUBDIVISIONS; k++)
-            {
-                // Reset force accumulator
-                pMAKE(0.0, 0.0, 0.0, force);
+            dopriEvaluate(jello, s, 0);
+        }
 
-                addStructuralForces(jello, i, j, k, &force);
+        for (int stage = 1; stage < 7; stage++)
+        {
+            dopriCombine(jello, s, dopriA[stage], stage, substep);
+            jello->time = time + dopriC[stage] * substep;
+            applyKinematics(jello->kinematics, jello->time, &jello->p[0][0][0], &jello->v[0][0][0]);
+            dopriEvaluate(jello, s, stage);
+        }
+        // jello->p, v now hold the 5th-order solution (stage 7 is evaluated there)
 
-                addShearForces(jello, i, j, k, &force);
+        double error = dopriErrorNorm(jello, s, substep, control->relativeTolerance, control->absoluteTolerance);
+        bool accept = error <= 1.0 || substep <= minStep;
 
-                addBendForces(jello, i, j, k, &force);
+        // h_new = h * 0.9 * error^(-1/5), limited to [0.2, 5] times the old size (at most 1 after a rejection)
+        double factor = error > 0.0 ? 0.9 * pow(error, -0.2) : 5.0;
+        factor = fmin(accept ? 5.0 : 1.0, fmax(0.2, factor));
+        h = fmax(minStep, substep * factor);
 
-                if (jello->resolution != 0)
-                {
-                    addForceFieldForce(jello, i, j, k, &force);
-                }
+        if (accept)
+        {
+            control->accepted++;
+            jello->time = last ? end : time + substep;
+            memcpy(s->kp[0], s->kp[6], sizeof(s->kp[0]));
+            memcpy(s->kv[0], s->kv[6], sizeof(s->kv[0]));
+            haveFirstStage = true;
+        }
+        else
+        {
+            control->rejected++;
+            memcpy(jello->p, s->p0, sizeof(jello->p));
+            memcpy(jello->v, s->v0, sizeof(jello->v));
+            jello->time = time;
+            haveFirstStage = true; // stage 1 only depends on the unchanged start of the substep
+        }
+    }
 
-                addCollisionForces(jello, i, j, k, &force);
+    control->step = h;
+}
 
-                pMULTIPLY(force, 1.0 / jello->mass, a[i][j][k]);
-            }
+void printIntegratorStatistics(const struct world* jello)
+{
+    const struct stabilityGuard* guard = jello->guard;
+    if (guard != NULL && guard->rollbacks > 0)
+    {
+        printf("stability guard: %lld of %lld steps rolled back (%.2f%%), %lld substeps at reduced dt (down to dt / %d), "
+               "%lld unrecoverable\n",
+               guard->rollbacks, guard->steps, 100.0 * guard->rollbacks / guard->steps, guard->substeps,
+               1 << guard->deepestHalving, guard->giveUps);
+    }
+
+    const struct sleepState* sleep = jello->sleep;
+    if (sleep != NULL && sleep->sleptSteps > 0)
+    {
+        printf("sleep: %lld of %lld steps skipped at rest (%.1f%%)%s\n", sleep->sleptSteps, sleep->steps,
+               100.0 * sleep->sleptSteps / sleep->steps, sleep->asleep ? ", asleep now" : "");
+    }
+
+    if (jello->adaptive == NULL || jello->adaptive->accepted + jello->adaptive->rejected == 0)
+    {
+        return;
+    }
+
+    const struct adaptiveStep* control = jello->adaptive;
+    printf("%s: t = %g, %lld substeps accepted, %lld rejected (%.1f%%), mean substep %g (dt %g), next substep %g\n",
+           jello->integrator, jello->time, control->accepted, control->rejected,
+           100.0 * control->rejected / (control->accepted + control->rejected),
+           control->accepted > 0 ? jello->time / control->accepted : 0.0, jello->dt, control->step);
+}
+
+const struct integrator integrators[] = {
+    {"Euler", Euler, 1, 1},
+    {"RK4", RK4, 4, 1},
+    {"SymplecticEuler", SymplecticEuler, 1, 1},
+    {"Verlet", Verlet, 1, 0}, // evaluates after the first half drift
+    {"DOPRI5", DOPRI5, 6, 1}, // per accepted substep
+    {"XPBD", XPBD, 0, 0}, // no computeAcceleration: external forces once, then constraint sweeps, see xpbd.h
+    {"ProjectiveDynamics", ProjectiveDynamics, 0, 0}, // likewise; local projections and back-substitutions
+    {NULL, NULL, 0, 0},
+};
+
+const struct integrator* findIntegrator(const char* name)
+{
+    for (const struct integrator* entry = integrators; entry->name != NULL; entry++)
+    {
+        if (strcmp(entry->name, name) == 0)
+        {
+            return entry;
         }
     }
+    return NULL;
 }
 
-/* performs one step of Euler Integration */
-/* as a result, updates the jello structure */
-void Euler(struct world* jello)
+#define GUARD_DEFAULT_MAX_SPEED 10000.0
+#define GUARD_DEFAULT_MAX_STRETCH 5.0
+#define GUARD_MAX_HALVINGS 10 // retries go down to dt / 1024
+
+/* cheap per-step health check: finite positions and velocities, no control point faster than maxSpeed and no
+   structural spring longer than maxStretch rest lengths (a diverging integrator trips all three quickly) */
+static bool isStable(const struct world* jello, const struct stabilityGuard* guard)
 {
+    const double maxSpeed2 = guard->maxSpeed * guard->maxSpeed;
+    const double maxLength = guard->maxStretch / JELLO_SUBDIVISIONS;
+    const double maxLength2 = maxLength * maxLength;
     int i, j, k;
-    point a[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS];
-
-    computeAcceleration(jello, a);
 
     for (i = 0; i <= JELLO_SUBDIVISIONS; i++)
-    {
         for (j = 0; j <= JELLO_SUBDIVISIONS; j++)
-        {
             for (k = 0; k <= JELLO_SUBDIVISIONS; k++)
             {
-                jello->p[i][j][k].x += jello->dt * jello->v[i][j][k].x;
-                jello->p[i][j][k].y += jello->dt * jello->v[i][j][k].y;
-                jello->p[i][j][k].z += jello->dt * jello->v[i][j][k].z;
-                jello->v[i][j][k].x += jello->dt * a[i][j][k].x;
-                jello->v[i][j][k].y += jello->dt * a[i][j][k].y;
-                jello->v[i][j][k].z += jello->dt * a[i][j][k].z;
+                const point& p = jello->p[i][j][k];
+                const point& v = jello->v[i][j][k];
+
+                // also false for NaN
+                if (!(v.x * v.x + v.y * v.y + v.z * v.z <= maxSpeed2) || !isfinite(p.x) || !isfinite(p.y) ||
+                    !isfinite(p.z))
+                {
+                    return false;
+                }
+
+                const int next[3][3] = {{i + 1, j, k}, {i, j + 1, k}, {i, j, k + 1}};
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    if (next[axis][0] > JELLO_SUBDIVISIONS || next[axis][1] > JELLO_SUBDIVISIONS ||
+                        next[axis][2] > JELLO_SUBDIVISIONS)
+                    {
+                        continue;
+                    }
+                    point L;
+                    pDIFFERENCE(p, jello->p[next[axis][0]][next[axis][1]][next[axis][2]], L);
+                    if (L.x * L.x + L.y * L.y + L.z * L.z > maxLength2)
+                    {
+                        return false;
+                    }
+                }
             }
-        }
-    }
+
+    return true;
 }
 
-/* performs one step of RK4 Integration */
-/* as a result, updates the jello structure */
-void RK4(struct world* jello)
+/* positions, velocities and time of a world, to roll back a step */
+struct worldSnapshot
 {
-    point F1p[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS],
-        F1v[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS],
-        F2p[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS],
-        F2v[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS],
-        F3p[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS],
-        F3v[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS],
-        F4p[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS],
-        F4v[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS];
+    point p[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS];
+    point v[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS];
+    double time;
 
-    point a[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS];
+    void save(const struct world* jello)
+    {
+        memcpy(p, jello->p, sizeof(p));
+        memcpy(v, jello->v, sizeof(v));
+        time = jello->time;
+    }
 
-    struct world buffer;
+    void restore(struct world* jello) const
+    {
+        memcpy(jello->p, p, sizeof(p));
+        memcpy(jello->v, v, sizeof(v));
+        jello->time = time;
+    }
+};
 
-    int i, j, k;
+// one snapshot per halving depth: [0] for guardedStep, [h] for stepInHalves at depth h; per thread, allocated on
+// the thread's first guarded step and kept until exit, so a step allocates nothing
+static thread_local worldSnapshot* localSnapshots = NULL;
 
-    buffer = *jello; // make a copy of jello
+/* advances by 'interval' in two steps of half the size, halving further wherever a half is unstable;
+   returns false (with the world rolled back to where the failing half started) past GUARD_MAX_HALVINGS */
+static bool stepInHalves(struct world* jello, const struct integrator* entry, double interval, int halving)
+{
+    struct stabilityGuard* guard = jello->guard;
+    worldSnapshot* snapshot = &localSnapshots[halving];
+    bool stable = true;
 
-    computeAcceleration(jello, a);
+    if (halving > guard->deepestHalving)
+    {
+        guard->deepestHalving = halving;
+    }
 
-    for (i = 0; i <= JELLO_SUBDIVISIONS; i++)
+    for (int half = 0; half < 2 && stable; half++)
     {
-        for (j = 0; j <= JELLO_SUBDIVISIONS; j++)
+        snapshot->save(jello);
+        jello->dt = 0.5 * interval;
+        guard->halving = halving;
+        entry->step(jello);
+        guard->halving = 0;
+        guard->substeps++;
+
+        if (!isStable(jello, guard))
         {
-            for (k = 0; k <= JELLO_SUBDIVISIONS; k++)
-            {
-                pMULTIPLY(jello->v[i][j][k], jello->dt, F1p[i][j][k]);
-                pMULTIPLY(a[i][j][k], jello->dt, F1v[i][j][k]);
-                pMULTIPLY(F1p[i][j][k], 0.5, buffer.p[i][j][k]);
-                pMULTIPLY(F1v[i][j][k], 0.5, buffer.v[i][j][k]);
-                pSUM(jello->p[i][j][k], buffer.p[i][j][k], buffer.p[i][j][k]);
-                pSUM(jello->v[i][j][k], buffer.v[i][j][k], buffer.v[i][j][k]);
-            }
+            snapshot->restore(jello);
+            stable = halving < GUARD_MAX_HALVINGS && stepInHalves(jello, entry, 0.5 * interval, halving + 1);
         }
     }
 
-    computeAcceleration(&buffer, a);
+    return stable;
+}
 
-    for (i = 0; i <= JELLO_SUBDIVISIONS; i++)
+/* one step of the integrator, checked by the stability guard */
+static void guardedStep(struct world* jello, const struct integrator* entry)
+{
+    PERF_REGION(entry->name);
+    struct stabilityGuard* guard = jello->guard;
+    if (!guard->enabled)
     {
-        for (j = 0; j <= JELLO_SUBDIVISIONS; j++)
+        entry->step(jello);
+        return;
+    }
+
+    // keep the state from before the step, so a diverging step can be redone with smaller steps
+    if (localSnapshots == NULL)
+    {
+        localSnapshots = new worldSnapshot[GUARD_MAX_HALVINGS + 1];
+    }
+    worldSnapshot* snapshot = &localSnapshots[0];
+    snapshot->save(jello);
+    guard->steps++;
+
+    entry->step(jello);
+
+    if (!isStable(jello, guard))
+    {
+        const double dt = jello->dt;
+        guard->rollbacks++;
+        snapshot->restore(jello);
+
+        if (!stepInHalves(jello, entry, dt, 1))
         {
-            for (k = 0; k <= JELLO_SUBDIVISIONS; k++)
+            // even dt / 2^GUARD_MAX_HALVINGS diverges: keep the last good positions, stop the motion and move on
+            guard->giveUps++;
+            if (guard->giveUps == 1)
             {
-                // F2p = dt * buffer.v;
-                pMULTIPLY(buffer.v[i][j][k], jello->dt, F2p[i][j][k]);
-                // F2v = dt * a(buffer.p,buffer.v);
-                pMULTIPLY(a[i][j][k], jello->dt, F2v[i][j][k]);
-                pMULTIPLY(F2p[i][j][k], 0.5, buffer.p[i][j][k]);
-                pMULTIPLY(F2v[i][j][k], 0.5, buffer.v[i][j][k]);
-                pSUM(jello->p[i][j][k], buffer.p[i][j][k], buffer.p[i][j][k]);
-                pSUM(jello->v[i][j][k], buffer.v[i][j][k], buffer.v[i][j][k]);
+                printf("stability guard: the simulation diverges even at dt / %d; check kElastic, kCollision and "
+                       "dt. Rolling back and stopping the cube.\n",
+                       1 << GUARD_MAX_HALVINGS);
             }
+            memset(jello->v, 0, sizeof(jello->v));
         }
+
+        // the retries leave the time wherever the last good substep ended; the step is always one dt
+        jello->dt = dt;
+        jello->time = snapshot->time + dt;
     }
+}
 
-    computeAcceleration(&buffer, a);
+#define SLEEP_DEFAULT_MAX_SPEED 0.01
+#define SLEEP_DEFAULT_MAX_KINETIC_ENERGY 1e-6
+#define SLEEP_DEFAULT_STEPS 200
 
-    for (i = 0; i <= JELLO_SUBDIVISIONS; i++)
+static bool externalForceChanged(const struct world* jello)
+{
+    if (jello->externalForce == NULL)
     {
-        for (j = 0; j <= JELLO_SUBDIVISIONS; j++)
+        return false;
+    }
+    return memcmp(jello->externalForce, jello->sleep->externalForce, sizeof(jello->sleep->externalForce)) != 0;
+}
+
+/* true if the forces on the body change with time on their own: a time-dependent force field or a control point
+   driven along a moving path; such a body must not sleep, however calm it is at the moment */
+static bool hasTimeDependentForces(const struct world* jello)
+{
+    if (jello->field != NULL && jello->field->isTimeDependent())
+    {
+        return true;
+    }
+    if (jello->kinematics != NULL)
+    {
+        for (int particle : jello->kinematics->points)
         {
-            for (k = 0; k <= JELLO_SUBDIVISIONS; k++)
+            const point& amplitude = jello->kinematics->amplitude[particle];
+            if (jello->kinematics->frequency[particle] != 0.0 &&
+                (amplitude.x != 0.0 || amplitude.y != 0.0 || amplitude.z != 0.0))
             {
-                // F3p = dt * buffer.v;
-                pMULTIPLY(buffer.v[i][j][k], jello->dt, F3p[i][j][k]);
-                // F3v = dt * a(buffer.p,buffer.v);
-                pMULTIPLY(a[i][j][k], jello->dt, F3v[i][j][k]);
-                pMULTIPLY(F3p[i][j][k], 1.0, buffer.p[i][j][k]);
-                pMULTIPLY(F3v[i][j][k], 1.0, buffer.v[i][j][k]);
-                pSUM(jello->p[i][j][k], buffer.p[i][j][k], buffer.p[i][j][k]);
-                pSUM(jello->v[i][j][k], buffer.v[i][j][k], buffer.v[i][j][k]);
+                return true;
             }
         }
     }
-    computeAcceleration(&buffer, a);
+    return false;
+}
 
-    for (i = 0; i <= JELLO_SUBDIVISIONS; i++)
+/* counts calm steps after an integration step and puts the body to sleep after stepsToSleep of them */
+static void updateSleep(struct world* jello)
+{
+    struct sleepState* sleep = jello->sleep;
+    if (hasTimeDependentForces(jello))
     {
-        for (j = 0; j <= JELLO_SUBDIVISIONS; j++)
+        sleep->calmSteps = 0;
+        return;
+    }
+
+    const point* v = &jello->v[0][0][0];
+    const double maxSpeed2 = sleep->maxSpeed * sleep->maxSpeed;
+    const double* mass = jello->material != NULL ? jello->material->mass.data() : &jello->mass;
+    const int stride = jello->material != NULL ? 1 : 0;
+    double kinetic2 = 0.0;
+    bool calm = true;
+
+    for (int n = 0; n < JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS && calm; n++)
+    {
+        double speed2 = v[n].x * v[n].x + v[n].y * v[n].y + v[n].z * v[n].z;
+        kinetic2 += mass[n * stride] * speed2;
+        calm = speed2 <= maxSpeed2;
+    }
+    calm = calm && 0.5 * kinetic2 <= sleep->maxKineticEnergy;
+
+    sleep->calmSteps = calm ? sleep->calmSteps + 1 : 0;
+    if (sleep->calmSteps >= sleep->stepsToSleep)
+    {
+        // freeze the residual jitter, and remember the forces from outside so a change can wake the body
+        sleep->asleep = 1;
+        memset(jello->v, 0, sizeof(jello->v));
+        if (jello->externalForce != NULL)
         {
-            for (k = 0; k <= JELLO_SUBDIVISIONS; k++)
-            {
-                // F3p = dt * buffer.v;
-                pMULTIPLY(buffer.v[i][j][k], jello->dt, F4p[i][j][k]);
-                // F3v = dt * a(buffer.p,buffer.v);
-                pMULTIPLY(a[i][j][k], jello->dt, F4v[i][j][k]);
-
-                pMULTIPLY(F2p[i][j][k], 2, buffer.p[i][j][k]);
-                pMULTIPLY(F3p[i][j][k], 2, buffer.v[i][j][k]);
-                pSUM(buffer.p[i][j][k], buffer.v[i][j][k], buffer.p[i][j][k]);
-                pSUM(buffer.p[i][j][k], F1p[i][j][k], buffer.p[i][j][k]);
-                pSUM(buffer.p[i][j][k], F4p[i][j][k], buffer.p[i][j][k]);
-                pMULTIPLY(buffer.p[i][j][k], 1.0 / 6, buffer.p[i][j][k]);
-                pSUM(buffer.p[i][j][k], jello->p[i][j][k], jello->p[i][j][k]);
-
-                pMULTIPLY(F2v[i][j][k], 2, buffer.p[i][j][k]);
-                pMULTIPLY(F3v[i][j][k], 2, buffer.v[i][j][k]);
-                pSUM(buffer.p[i][j][k], buffer.v[i][j][k], buffer.p[i][j][k]);
-                pSUM(buffer.p[i][j][k], F1v[i][j][k], buffer.p[i][j][k]);
-                pSUM(buffer.p[i][j][k], F4v[i][j][k], buffer.p[i][j][k]);
-                pMULTIPLY(buffer.p[i][j][k], 1.0 / 6, buffer.p[i][j][k]);
-                pSUM(buffer.p[i][j][k], jello->v[i][j][k], jello->v[i][j][k]);
-            }
+            memcpy(sleep->externalForce, jello->externalForce, sizeof(sleep->externalForce));
         }
     }
+}
 
-    return;
+/* asks the step's first force evaluation for the energy diagnostics, or evaluates the start state right away if
+   the integrator's first evaluation sees a different state */
+static void requestEnergySample(struct world* jello, const struct integrator* entry)
+{
+    if (jello->energy == NULL)
+    {
+        return;
+    }
+
+    jello->energy->requested = 1;
+    if (!entry->startEvaluation)
+    {
+        point a[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS]; // discarded, like the integrators' own
+        computeAcceleration(jello, a);
+    }
+}
+
+int isAsleep(const struct world* jello)
+{
+    return jello->sleep != NULL && jello->sleep->enabled && jello->sleep->asleep;
+}
+
+void wakeWorld(struct world* jello)
+{
+    if (jello->sleep != NULL)
+    {
+        jello->sleep->asleep = 0;
+        jello->sleep->calmSteps = 0;
+    }
+}
+
+void stepWorld(struct world* jello)
+{
+    PROFILE_ZONE("stepWorld");
+    const struct integrator* entry = findIntegrator(jello->integrator);
+    if (entry == NULL)
+    {
+        entry = findIntegrator("RK4");
+    }
+
+    if (jello->guard == NULL)
+    {
+        jello->guard = (struct stabilityGuard*)calloc(1, sizeof(struct stabilityGuard));
+        jello->guard->enabled = 1;
+        jello->guard->maxSpeed = GUARD_DEFAULT_MAX_SPEED;
+        jello->guard->maxStretch = GUARD_DEFAULT_MAX_STRETCH;
+    }
+    if (jello->sleep == NULL)
+    {
+        jello->sleep = (struct sleepState*)calloc(1, sizeof(struct sleepState));
+        jello->sleep->enabled = 1;
+        jello->sleep->maxSpeed = SLEEP_DEFAULT_MAX_SPEED;
+        jello->sleep->maxKineticEnergy = SLEEP_DEFAULT_MAX_KINETIC_ENERGY;
+        jello->sleep->stepsToSleep = SLEEP_DEFAULT_STEPS;
+    }
+
+    struct sleepState* sleep = jello->sleep;
+    if (!sleep->enabled)
+    {
+        requestEnergySample(jello, entry);
+        guardedStep(jello, entry);
+        return;
+    }
+
+    sleep->steps++;
+    if (sleep->asleep && (externalForceChanged(jello) || hasTimeDependentForces(jello)))
+    {
+        wakeWorld(jello);
+    }
+    if (sleep->asleep)
+    {
+        if (jello->energy != NULL)
+        {
+            // at rest: no motion, the potentials are those of the last sample
+            jello->energy->time = jello->time;
+            jello->energy->kinetic = 0.0;
+            pMAKE(0.0, 0.0, 0.0, jello->energy->momentum);
+        }
+
+        // the forces on a sleeping body are those it fell asleep under: the same external forces, and no
+        // time-dependent field or drive (those keep it awake)
+        sleep->sleptSteps++;
+        jello->time += jello->dt;
+        return;
+    }
+
+    requestEnergySample(jello, entry);
+    guardedStep(jello, entry);
+    updateSleep(jello);
 }
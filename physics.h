@@ -8,7 +8,8 @@
 #ifndef _PHYSICS_H_
 #define _PHYSICS_H_
 
-#include "types.h"
+#include "world.h"
+
 void computeAcceleration(struct world* jello,
                          struct point a[JELLO_SUBPOINTS][JELLO_SUBPOINTS][JELLO_SUBPOINTS]);
 
@@ -17,4 +18,51 @@ void computeAcceleration(struct world* jello,
 void Euler(struct world* jello);
 void RK4(struct world* jello);
 
+// one-force-evaluation symplectic integrators: semi-implicit Euler and velocity Verlet (position form)
+void SymplecticEuler(struct world* jello);
+void Verlet(struct world* jello);
+
+// adaptive Dormand-Prince 5(4): advances by dt in as many substeps as the tolerances in jello->adaptive require
+void DOPRI5(struct world* jello);
+
+// prints the stability guard's rollback counts (if it had to step in), the steps skipped asleep and the accepted /
+// rejected substep counts of an adaptive integrator; nothing for a fixed-step run that never diverged or slept
+void printIntegratorStatistics(const struct world* jello);
+
+// an integrator that can be named in the world file
+struct integrator
+{
+    const char* name;
+    void (*step)(struct world* jello);
+    int forceEvaluations; // computeAcceleration calls per step
+    int startEvaluation;  // 1 if the step's first computeAcceleration call sees the state at the start of the step
+};
+
+// the registered integrators, terminated by an entry whose name is NULL
+extern const struct integrator integrators[];
+
+// looks up an integrator by name; NULL if there is none
+const struct integrator* findIntegrator(const char* name);
+
+// one step of the integrator named in jello->integrator; unknown names use RK4
+// Guarded unless the world file says "guard off": after every step the positions and velocities are checked
+// (finite, speed, structural stretch; limits in jello->guard). A step that fails is rolled back and redone as two
+// half steps, halving again where a half fails, down to dt / 1024. If even that diverges, the step is rolled back
+// and the cube stopped, so the run goes on. The counts are kept in jello->guard.
+// Unless the world file says "sleep off", a cube that stays calm (slow control points, low kinetic energy; limits
+// in jello->sleep) for a number of consecutive steps falls asleep: its velocities are zeroed and stepWorld only
+// advances the time until wakeWorld is called or jello->externalForce changes. A cube under a time-dependent force
+// field (ForceField::isTimeDependent, e.g. a gusting wind) or with driven control points never sleeps.
+// With jello->energy set, every step also fills in jello->energy: kinetic, spring and collision energy and the
+// linear momentum at the start of the step. They are summed inside the step's first force evaluation where that
+// sees the start state (integrator::startEvaluation); other integrators pay one extra evaluation. Contacts with
+// other bodies of a scene (jello->externalForce) are not included.
+void stepWorld(struct world* jello);
+
+// 1 if stepWorld is skipping the cube's integration; its positions won't change until it wakes
+int isAsleep(const struct world* jello);
+
+// wakes a sleeping cube, e.g. after user interaction; it falls asleep again once it has been calm long enough
+void wakeWorld(struct world* jello);
+
 #endif
@@ -0,0 +1,234 @@
+#include "profiler.h"
+
+#if JELLO_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#define PROFILER_MAX_ZONES 64
+
+// nanoseconds since the first use of the profiler
+static long long profilerNow()
+{
+    static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+// Written only by its thread; the atomics let the summary read it while the thread keeps recording.
+struct threadBuffer
+{
+    struct event
+    {
+        const char* name;
+        long long start;
+        long long end;
+    };
+
+    struct zone
+    {
+        const char* name;
+        std::atomic<long long> count;
+        std::atomic<long long> total; // ns
+        std::atomic<long long> max;   // ns
+    };
+
+    int thread;                     // 0 = the first thread that recorded a zone
+    std::atomic<long long> written; // events recorded so far; the ring holds the last PROFILER_EVENTS_PER_THREAD
+    event events[PROFILER_EVENTS_PER_THREAD];
+    std::atomic<int> zoneCount;
+    zone zones[PROFILER_MAX_ZONES];
+
+    void record(const char* name, long long start, long long end);
+};
+
+static std::mutex registryLock;
+static std::vector<threadBuffer*> registry; // never shrinks; buffers live until exit
+static thread_local threadBuffer* localBuffer = NULL;
+
+static threadBuffer* getLocalBuffer()
+{
+    if (localBuffer == NULL)
+    {
+        threadBuffer* buffer = new threadBuffer;
+        buffer->written = 0;
+        buffer->zoneCount = 0;
+
+        std::lock_guard<std::mutex> lock(registryLock);
+        buffer->thread = (int)registry.size();
+        registry.push_back(buffer);
+        localBuffer = buffer;
+    }
+    return localBuffer;
+}
+
+void threadBuffer::record(const char* name, long long start, long long end)
+{
+    long long n = written.load(std::memory_order_relaxed);
+    event& e = events[n % PROFILER_EVENTS_PER_THREAD];
+    e.name = name;
+    e.start = start;
+    e.end = end;
+    written.store(n + 1, std::memory_order_release);
+
+    // a handful of zones per thread, so a linear search on the name pointer is cheap
+    int count = zoneCount.load(std::memory_order_relaxed);
+    int z = 0;
+    while (z < count && zones[z].name != name)
+    {
+        z++;
+    }
+    if (z == count)
+    {
+        if (count == PROFILER_MAX_ZONES)
+        {
+            return; // trace only
+        }
+        zones[z].name = name;
+        zones[z].count.store(0, std::memory_order_relaxed);
+        zones[z].total.store(0, std::memory_order_relaxed);
+        zones[z].max.store(0, std::memory_order_relaxed);
+        zoneCount.store(count + 1, std::memory_order_release);
+    }
+
+    const long long duration = end - start;
+    zone& totals = zones[z];
+    totals.count.store(totals.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    totals.total.store(totals.total.load(std::memory_order_relaxed) + duration, std::memory_order_relaxed);
+    if (duration > totals.max.load(std::memory_order_relaxed))
+    {
+        totals.max.store(duration, std::memory_order_relaxed);
+    }
+}
+
+ProfileZone::ProfileZone(const char* name) : m_name(name), m_start(profilerNow())
+{
+}
+
+ProfileZone::~ProfileZone()
+{
+    getLocalBuffer()->record(m_name, m_start, profilerNow());
+}
+
+int profilerWriteTrace(const char* fileName)
+{
+    FILE* file = fopen(fileName, "w");
+    if (file == NULL)
+    {
+        printf("can't open file %s\n", fileName);
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(registryLock);
+    const char* separator = "";
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (threadBuffer* buffer : registry)
+    {
+        long long written = buffer->written.load(std::memory_order_acquire);
+        long long first = written > PROFILER_EVENTS_PER_THREAD ? written - PROFILER_EVENTS_PER_THREAD : 0;
+        for (long long n = first; n < written; n++)
+        {
+            const threadBuffer::event& e = buffer->events[n % PROFILER_EVENTS_PER_THREAD];
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", separator,
+                    e.name, buffer->thread, e.start * 1e-3, (e.end - e.start) * 1e-3);
+            separator = ",\n";
+        }
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+    return 1;
+}
+
+void profilerPrintSummary(FILE* file)
+{
+    struct zoneSummary
+    {
+        const char* name;
+        long long count;
+        long long total;
+        long long max;
+    };
+    // totals at the previous call, to report only the window since then
+    static std::vector<zoneSummary> previous;
+    static long long previousTime = 0;
+
+    std::vector<zoneSummary> current;
+    {
+        std::lock_guard<std::mutex> lock(registryLock);
+        for (threadBuffer* buffer : registry)
+        {
+            int count = buffer->zoneCount.load(std::memory_order_acquire);
+            for (int z = 0; z < count; z++)
+            {
+                const threadBuffer::zone& zone = buffer->zones[z];
+                size_t s = 0;
+                while (s < current.size() && current[s].name != zone.name)
+                {
+                    s++;
+                }
+                if (s == current.size())
+                {
+                    current.push_back({zone.name, 0, 0, 0});
+                }
+                current[s].count += zone.count.load(std::memory_order_relaxed);
+                current[s].total += zone.total.load(std::memory_order_relaxed);
+                long long max = zone.max.load(std::memory_order_relaxed);
+                current[s].max = max > current[s].max ? max : current[s].max;
+            }
+        }
+    }
+
+    long long now = profilerNow();
+    fprintf(file, "profile, last %.2f s (all threads; max is since start):\n", (now - previousTime) * 1e-9);
+    fprintf(file, "  %-28s %10s %12s %12s %12s\n", "zone", "count", "total ms", "mean us", "max us");
+    for (const zoneSummary& zone : current)
+    {
+        long long count = zone.count;
+        long long total = zone.total;
+        for (const zoneSummary& old : previous)
+        {
+            if (old.name == zone.name)
+            {
+                count -= old.count;
+                total -= old.total;
+            }
+        }
+        if (count > 0)
+        {
+            fprintf(file, "  %-28s %10lld %12.3f %12.3f %12.3f\n", zone.name, count, total * 1e-6,
+                    total * 1e-3 / count, zone.max * 1e-3);
+        }
+    }
+
+    previous = current;
+    previousTime = now;
+}
+
+void profilerFrame()
+{
+    static long long lastSummary = profilerNow();
+    long long now = profilerNow();
+    if ((now - lastSummary) * 1e-9 >= PROFILER_SUMMARY_INTERVAL)
+    {
+        profilerPrintSummary(stdout);
+        lastSummary = now;
+    }
+}
+
+#else // #if JELLO_PROFILE
+
+int profilerWriteTrace(const char*)
+{
+    return 0;
+}
+
+void profilerPrintSummary(FILE*)
+{
+}
+
+void profilerFrame()
+{
+}
+
+#endif // #if JELLO_PROFILE
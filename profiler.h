@@ -0,0 +1,63 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <stdio.h>
+
+// Scoped timers for the hot paths (force passes, integrator stages, vertex extraction and upload, rendering).
+//
+//   void f()
+//   {
+//       PROFILE_ZONE("f"); // times the rest of the enclosing scope
+//       ...
+//   }
+//
+// Compiled in only with JELLO_PROFILE=1 (make PROFILE=1, or the preprocessor definition in Visual Studio);
+// otherwise PROFILE_ZONE expands to nothing and the functions below do nothing, so release builds pay nothing.
+//
+// Every thread records into its own buffer: a ring of the last PROFILER_EVENTS_PER_THREAD zones for the trace
+// and running totals per zone for the summary. Recording takes no lock; a thread only takes the registry lock
+// once, when it records its first zone. Zone names must be string literals (the pointer identifies the zone).
+#ifndef JELLO_PROFILE
+#define JELLO_PROFILE 0
+#endif
+
+#define PROFILER_EVENTS_PER_THREAD (1 << 16)
+
+#if JELLO_PROFILE
+
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char* name);
+    ~ProfileZone();
+
+private:
+    const char* m_name;
+    long long m_start;
+};
+
+#define PROFILE_CONCATENATE2(a, b) a##b
+#define PROFILE_CONCATENATE(a, b) PROFILE_CONCATENATE2(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCATENATE(profileZone, __LINE__)(name)
+
+#else
+
+#define PROFILE_ZONE(name)
+
+#endif // #if JELLO_PROFILE
+
+// Writes the buffered zones of all threads as Chrome trace-event JSON (open with chrome://tracing or Perfetto).
+// Call while no zones are being recorded, e.g. at exit. Returns 0 if the file can't be written or profiling is
+// compiled out.
+int profilerWriteTrace(const char* fileName);
+
+// Prints count, total, mean and max time per zone, over all threads, for the zones recorded since the previous
+// call (the first call covers everything so far).
+void profilerPrintSummary(FILE* file);
+
+// Call once per frame: prints the summary of the last PROFILER_SUMMARY_INTERVAL seconds whenever that much wall
+// time has passed.
+#define PROFILER_SUMMARY_INTERVAL 5.0
+void profilerFrame();
+
+#endif // #ifndef _PROFILER_H_
@@ -0,0 +1,381 @@
+#include "projectiveDynamics.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "collision.h"
+#include "forceField.h"
+#include "kinematics.h"
+#include "material.h"
+#include "obstacle.h"
+#include "parallel.h"
+#include "selfCollision.h"
+#include "sparseCholesky.h"
+#include "springs.h"
+
+#define NUM_PARTICLES (JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS)
+
+// factorizations kept for different parameter sets (e.g. bodies with different stiffness in one scene)
+#define SYSTEM_CACHE_SIZE 8
+
+// A = M / dt^2 + sum over the springs of (kElastic + dElastic / dt) times the spring's Laplacian, over the free
+// particles, factored; the kinematic particles are known at the end of the step, so their columns move to the
+// right-hand side. M and the spring constants are the material's (material.h) or the world's uniform ones.
+struct pdSystem
+{
+    double mass, dt, kElastic, dElastic;  // the world's uniform constants
+    bool heterogeneous;                   // built from a material
+    std::vector<unsigned char> kinematic; // the kinematics mask it was built for; empty if all particles are free
+    std::vector<int> particle;            // per row, the free particle it solves for
+
+    // the springs with their constants and, per particle, the springs that end there:
+    // incident[incidentStart[n] .. incidentStart[n + 1]), spring index, negative (-1 - s) at the spring's second end
+    springList springs;
+    std::vector<double> springK, springD; // per spring
+    std::vector<double> pointMass;        // per particle
+    std::vector<int> incidentStart;
+    std::vector<int> incident;
+
+    SparseCholesky cholesky;
+};
+
+static bool isKinematic(const std::vector<unsigned char>& kinematic, int n)
+{
+    return !kinematic.empty() && kinematic[n];
+}
+
+static std::shared_ptr<const pdSystem> buildSystem(const struct world* jello)
+{
+    const struct material* material = jello->material;
+    const double dt = jello->dt;
+
+    std::shared_ptr<pdSystem> system = std::make_shared<pdSystem>();
+    system->mass = jello->mass;
+    system->dt = dt;
+    system->kElastic = jello->kElastic;
+    system->dElastic = jello->dElastic;
+    system->heterogeneous = material != NULL;
+    if (jello->kinematics != NULL)
+    {
+        system->kinematic = jello->kinematics->mask;
+    }
+    if (material != NULL)
+    {
+        system->springs = material->springs;
+        system->springK = material->kElastic;
+        system->springD = material->dElastic;
+        system->pointMass = material->mass;
+    }
+    else
+    {
+        buildSpringList(&system->springs);
+        system->springK.assign(system->springs.count(), jello->kElastic);
+        system->springD.assign(system->springs.count(), jello->dElastic);
+        system->pointMass.assign(NUM_PARTICLES, jello->mass);
+    }
+    const springList& springs = system->springs;
+
+    system->incidentStart.assign(NUM_PARTICLES + 1, 0);
+    for (int s = 0; s < springs.count(); s++)
+    {
+        system->incidentStart[springs.a[s] + 1]++;
+        system->incidentStart[springs.b[s] + 1]++;
+    }
+    for (int n = 0; n < NUM_PARTICLES; n++)
+    {
+        system->incidentStart[n + 1] += system->incidentStart[n];
+    }
+    system->incident.resize(system->incidentStart[NUM_PARTICLES]);
+    std::vector<int> next(system->incidentStart.begin(), system->incidentStart.end() - 1);
+    for (int s = 0; s < springs.count(); s++)
+    {
+        system->incident[next[springs.a[s]]++] = s;
+        system->incident[next[springs.b[s]]++] = -1 - s;
+    }
+
+    std::vector<int> row(NUM_PARTICLES, -1);
+    for (int n = 0; n < NUM_PARTICLES; n++)
+    {
+        if (!isKinematic(system->kinematic, n))
+        {
+            row[n] = (int)system->particle.size();
+            system->particle.push_back(n);
+        }
+    }
+    const int rows = (int)system->particle.size();
+
+    // compressed columns of the symmetric matrix: the diagonal, then -weight per spring to another free particle
+    std::vector<int> columnStart(rows + 1), rowIndex;
+    std::vector<double> values;
+    for (int r = 0; r < rows; r++)
+    {
+        const int n = system->particle[r];
+        columnStart[r] = (int)rowIndex.size();
+        rowIndex.push_back(r);
+        values.push_back(system->pointMass[n] / (dt * dt));
+        const size_t diagonal = values.size() - 1;
+        for (int e = system->incidentStart[n]; e < system->incidentStart[n + 1]; e++)
+        {
+            int s = system->incident[e] >= 0 ? system->incident[e] : -1 - system->incident[e];
+            int other = system->incident[e] >= 0 ? springs.b[s] : springs.a[s];
+            double weight = system->springK[s] + system->springD[s] / dt;
+            values[diagonal] += weight;
+            if (row[other] >= 0)
+            {
+                rowIndex.push_back(row[other]);
+                values.push_back(-weight);
+            }
+        }
+    }
+    columnStart[rows] = (int)rowIndex.size();
+
+    if (!system->cholesky.factor(rows, columnStart, rowIndex, values))
+    {
+        return NULL;
+    }
+    return system;
+}
+
+static bool matches(const pdSystem& system, const struct world* jello)
+{
+    static const std::vector<unsigned char> allFree;
+    const struct material* material = jello->material;
+    if (system.mass != jello->mass || system.dt != jello->dt || system.kElastic != jello->kElastic ||
+        system.dElastic != jello->dElastic || system.heterogeneous != (material != NULL) ||
+        system.kinematic != (jello->kinematics != NULL ? jello->kinematics->mask : allFree))
+    {
+        return false;
+    }
+    // the same kinematic points drop the same springs, so equal constants mean equal springs
+    return material == NULL || (system.springK == material->kElastic && system.springD == material->dElastic &&
+                                system.pointMass == material->mass);
+}
+
+// the factorization for the world's current parameters; factored on first use and whenever they change
+// The stability guard's retries step at dt / 2, dt / 4, ...; their factorizations are kept apart, so a burst of
+// retries cannot evict the ones for the bodies' own dt.
+static std::shared_ptr<const pdSystem> findSystem(const struct world* jello)
+{
+    static std::mutex mutex;
+    static std::vector<std::shared_ptr<const pdSystem>> caches[2]; // own dt, guard retries; most recently used last
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (std::vector<std::shared_ptr<const pdSystem>>& cache : caches)
+    {
+        for (size_t c = 0; c < cache.size(); c++)
+        {
+            std::shared_ptr<const pdSystem> system = cache[c];
+            if (matches(*system, jello))
+            {
+                cache.erase(cache.begin() + c);
+                cache.push_back(system);
+                return system;
+            }
+        }
+    }
+
+    std::shared_ptr<const pdSystem> system = buildSystem(jello);
+    if (system != NULL)
+    {
+        std::vector<std::shared_ptr<const pdSystem>>& cache =
+            caches[jello->guard != NULL && jello->guard->halving > 0 ? 1 : 0];
+        if (cache.size() == SYSTEM_CACHE_SIZE)
+        {
+            cache.erase(cache.begin());
+        }
+        cache.push_back(system);
+    }
+    return system;
+}
+
+// moves penetrating free particles back onto the collision planes and obstacle surfaces
+static void projectContacts(const struct world* jello, struct point* p)
+{
+    const int planeCount = jello->planes != NULL ? jello->planes->count() : 0;
+    const int obstacleCount = jello->obstacles != NULL ? jello->obstacles->count() : 0;
+    if (planeCount + obstacleCount == 0)
+    {
+        return;
+    }
+
+    const int* freeList;
+    const int freeCount = freePoints(jello, &freeList);
+    parallelFor(freeCount, [&](int begin, int end) {
+        for (int f = begin; f < end; f++)
+        {
+            const int n = freeList[f];
+            for (int plane = 0; plane < planeCount; plane++)
+            {
+                double nx, ny, nz, d;
+                jello->planes->get(plane, &nx, &ny, &nz, &d);
+                double s = nx * p[n].x + ny * p[n].y + nz * p[n].z + d;
+                if (s < 0.0)
+                {
+                    p[n].x -= s * nx, p[n].y -= s * ny, p[n].z -= s * nz;
+                }
+            }
+            for (int o = 0; o < obstacleCount; o++)
+            {
+                struct point gradient;
+                double s = jello->obstacles->get(o)->distance(p[n], &gradient);
+                if (s < 0.0)
+                {
+                    p[n].x -= s * gradient.x, p[n].y -= s * gradient.y, p[n].z -= s * gradient.z;
+                }
+            }
+        }
+    });
+}
+
+void ProjectiveDynamics(struct world* jello)
+{
+    const double dt = jello->dt;
+
+    std::shared_ptr<const pdSystem> system = findSystem(jello);
+    if (system == NULL)
+    {
+        // only possible with a non-positive mass or negative stiffness; nothing sensible to integrate
+        jello->time += dt;
+        return;
+    }
+    const springList& springs = system->springs;
+    const int* incidentStart = system->incidentStart.data();
+    const int* incident = system->incident.data();
+
+    struct point* p = &jello->p[0][0][0];
+    struct point* v = &jello->v[0][0][0];
+
+    // external forces
+    std::vector<struct point> force(NUM_PARTICLES, {0.0, 0.0, 0.0});
+    if (jello->field != NULL)
+    {
+        for (int n = 0; n < NUM_PARTICLES; n++)
+        {
+            jello->field->addForce(n, p[n], jello->time, &force[n]);
+        }
+    }
+    if (jello->externalForce != NULL)
+    {
+        for (int n = 0; n < NUM_PARTICLES; n++)
+        {
+            force[n].x += jello->externalForce[n].x;
+            force[n].y += jello->externalForce[n].y;
+            force[n].z += jello->externalForce[n].z;
+        }
+    }
+    if (jello->selfCollision != NULL)
+    {
+        jello->selfCollision->addForces(p, v, jello->kCollision, jello->dCollision, force.data(), kinematicMask(jello));
+    }
+
+    // inertial prediction q_n + dt v_n, kept out of the colliders; it is also the first guess
+    std::vector<struct point> previous(p, p + NUM_PARTICLES);
+    for (int n = 0; n < NUM_PARTICLES; n++)
+    {
+        p[n].x += dt * v[n].x;
+        p[n].y += dt * v[n].y;
+        p[n].z += dt * v[n].z;
+    }
+    projectContacts(jello, p);
+    applyKinematics(jello->kinematics, jello->time + dt, p, v);
+
+    // constant part of the right-hand side of each free particle, per axis: mass / dt^2 * prediction
+    // + sum over its springs of dElastic / dt * (q_n - q_m) + (kElastic + dElastic / dt) * q_m of the kinematic
+    // neighbours m at the end of the step
+    const int rows = (int)system->particle.size();
+    std::vector<double> constant(3 * rows);
+    for (int r = 0; r < rows; r++)
+    {
+        const int n = system->particle[r];
+        const double inertia = system->pointMass[n] / (dt * dt);
+        double sum[3] = {0.0, 0.0, 0.0};
+        for (int e = incidentStart[n]; e < incidentStart[n + 1]; e++)
+        {
+            int s = incident[e] >= 0 ? incident[e] : -1 - incident[e];
+            int m = incident[e] >= 0 ? springs.b[s] : springs.a[s];
+            const double damping = system->springD[s] / dt;
+            sum[0] += damping * (previous[n].x - previous[m].x);
+            sum[1] += damping * (previous[n].y - previous[m].y);
+            sum[2] += damping * (previous[n].z - previous[m].z);
+            if (isKinematic(system->kinematic, m))
+            {
+                const double weight = system->springK[s] + damping;
+                sum[0] += weight * p[m].x, sum[1] += weight * p[m].y, sum[2] += weight * p[m].z;
+            }
+        }
+
+        constant[r] = inertia * p[n].x + force[n].x + sum[0];
+        constant[rows + r] = inertia * p[n].y + force[n].y + sum[1];
+        constant[2 * rows + r] = inertia * p[n].z + force[n].z + sum[2];
+    }
+
+    std::vector<struct point> projection(springs.count());
+    std::vector<double> rhs(3 * rows);
+    for (int iteration = 0; iteration < PROJECTIVE_DYNAMICS_ITERATIONS && rows > 0; iteration++)
+    {
+        // local: the closest spring vector with the rest length, times the spring's stiffness
+        parallelFor(springs.count(), [&](int begin, int end) {
+            for (int s = begin; s < end; s++)
+            {
+                const struct point& a = p[springs.a[s]];
+                const struct point& b = p[springs.b[s]];
+                double dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+                double length = sqrt(dx * dx + dy * dy + dz * dz);
+                double scale = length > 1e-8 ? system->springK[s] * springs.rest[s] / length : 0.0;
+                projection[s].x = scale * dx, projection[s].y = scale * dy, projection[s].z = scale * dz;
+            }
+        });
+
+        // right-hand side, gathered per free particle so the particles can be done in parallel
+        parallelFor(rows, [&](int begin, int end) {
+            for (int r = begin; r < end; r++)
+            {
+                const int n = system->particle[r];
+                double sum[3] = {0.0, 0.0, 0.0};
+                for (int e = incidentStart[n]; e < incidentStart[n + 1]; e++)
+                {
+                    int s = incident[e] >= 0 ? incident[e] : -1 - incident[e];
+                    double sign = incident[e] >= 0 ? 1.0 : -1.0;
+                    sum[0] += sign * projection[s].x;
+                    sum[1] += sign * projection[s].y;
+                    sum[2] += sign * projection[s].z;
+                }
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    rhs[axis * rows + r] = constant[axis * rows + r] + sum[axis];
+                }
+            }
+        });
+
+        // global: one back-substitution per axis
+        parallelFor(3, [&](int begin, int end) {
+            for (int axis = begin; axis < end; axis++)
+            {
+                system->cholesky.solve(&rhs[axis * rows]);
+            }
+        });
+        for (int r = 0; r < rows; r++)
+        {
+            const int n = system->particle[r];
+            p[n].x = rhs[r];
+            p[n].y = rhs[rows + r];
+            p[n].z = rhs[2 * rows + r];
+        }
+    }
+
+    projectContacts(jello, p);
+
+    for (int n = 0; n < NUM_PARTICLES; n++)
+    {
+        v[n].x = (p[n].x - previous[n].x) / dt;
+        v[n].y = (p[n].y - previous[n].y) / dt;
+        v[n].z = (p[n].z - previous[n].z) / dt;
+    }
+
+    jello->time += dt;
+    applyKinematics(jello->kinematics, jello->time, p, v);
+}
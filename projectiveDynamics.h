@@ -0,0 +1,30 @@
+#ifndef _PROJECTIVE_DYNAMICS_H_
+#define _PROJECTIVE_DYNAMICS_H_
+
+#include "world.h"
+
+// Projective dynamics, selected with the integrator name "ProjectiveDynamics".
+//
+// An implicit solver: every step alternates PROJECTIVE_DYNAMICS_ITERATIONS times between
+//   local  - each spring projects its current end points onto its rest length (in parallel), and
+//   global - one linear solve A q = b for the new positions, the same matrix A for x, y and z.
+// With equal masses and one stiffness for all springs, A = mass / dt^2 * I + (kElastic + dElastic / dt) * L,
+// where L is the graph Laplacian of the springs; the dElastic term is implicit damping of the relative velocity
+// of the spring ends. With a material (material.h) the diagonal mass is each point's and every spring enters L with
+// its own kElastic + dElastic / dt. A depends only on the topology, masses, dt, spring constants and which points
+// are kinematic, so it is factored once (SparseCholesky, fill-reducing order) and a step costs the local
+// projections plus back-substitutions. Factorizations are cached by those parameters and shared by bodies that
+// use the same ones; a new one is only computed when a parameter changes. The stability guard's retries at
+// dt / 2, dt / 4, ... are cached separately, so they never evict the factorizations of the bodies' own dt.
+//
+// Force fields, externalForce and self-collision penalty forces are explicit external forces. Collision planes
+// and obstacles are hard constraints: the inertial prediction is moved out of them before the iterations, so
+// inertia never pulls the cube into a wall, and the final positions are moved out once more. Kinematic points
+// (kinematics.h) are not unknowns: A only has rows for the free points, and the kinematic ones, whose positions at
+// the end of the step are known from their path, enter the right-hand side of their free neighbours.
+
+#define PROJECTIVE_DYNAMICS_ITERATIONS 10
+
+void ProjectiveDynamics(struct world* jello);
+
+#endif // #ifndef _PROJECTIVE_DYNAMICS_H_
@@ -0,0 +1,48 @@
+#ifndef _RANDOM_H_
+#define _RANDOM_H_
+
+#include <stdint.h>
+
+// Counter-based random numbers (Philox4x32-10, Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+// Every output is a pure function of (key, counter), so any element of a generated array can be computed
+// independently and in any order: the result does not depend on the number of threads or on the traversal.
+
+struct philoxBlock
+{
+    uint32_t v[4];
+};
+
+// returns the 4 random 32-bit words for 'counter' under the 64-bit key 'seed'
+inline philoxBlock philox4x32(uint64_t seed, uint64_t counter)
+{
+    const uint32_t M0 = 0xD2511F53u, M1 = 0xCD9E8D57u;
+    const uint32_t W0 = 0x9E3779B9u, W1 = 0xBB67AE85u;
+
+    uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+    uint32_t c0 = (uint32_t)counter, c1 = (uint32_t)(counter >> 32), c2 = 0, c3 = 0;
+
+    for (int round = 0; round < 10; round++)
+    {
+        uint64_t p0 = (uint64_t)M0 * c0;
+        uint64_t p1 = (uint64_t)M1 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += W0;
+        k1 += W1;
+    }
+
+    philoxBlock block = {{c0, c1, c2, c3}};
+    return block;
+}
+
+// maps a random 32-bit word to a double in [-1, 1)
+inline double randomSigned(uint32_t word)
+{
+    return word * (2.0 / 4294967296.0) - 1.0;
+}
+
+#endif // #ifndef _RANDOM_H_
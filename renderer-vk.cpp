@@ -12,6 +12,8 @@
 #include <stdexcept>
 #include <unordered_map>
 
+#include "pic.h"
+#include "profiler.h"
 #include "utils.h"
 
 const std::vector<const char*> k_validationLayers = {"VK_LAYER_KHRONOS_validation"};
@@ -81,10 +83,12 @@ void Renderer_VK::init()
     createDescriptorSets();
     createCommandBuffers();
     createSyncObjects();
+    createCaptureBuffers();
 }
 
 void Renderer_VK::render()
 {
+    PROFILE_ZONE("render");
     VkResult result = VkResult::VK_SUCCESS;
 
     extern int g_ipause;
@@ -94,6 +98,9 @@ void Renderer_VK::render()
     {
         vkWaitForFences(m_device, 1, &m_inFlightFences[m_currentFrame], VK_TRUE, UINT64_MAX);
 
+        // The fence guarantees the copy recorded into this frame slot has finished, so the readback is free.
+        writeCapture(m_currentFrame);
+
         uint32_t imageIndex;
         result = vkAcquireNextImageKHR(m_device, m_swapChain, UINT64_MAX, m_imageAvailableSemaphores[m_currentFrame], VK_NULL_HANDLE, &imageIndex);
 
@@ -113,6 +120,13 @@ void Renderer_VK::render()
 
         vkResetCommandBuffer(m_commandBuffers[m_currentFrame],
                              /*VkCommandBufferResetFlagBits*/ 0);
+
+        if (m_captureSupported && !m_requestedCaptureFileName.empty())
+        {
+            m_captureFileNames[m_currentFrame] = m_requestedCaptureFileName;
+            m_requestedCaptureFileName.clear();
+        }
+
         recordCommandBuffer(m_currentFrame, imageIndex);
 
         VkSubmitInfo submitInfo{};
@@ -174,6 +188,9 @@ void Renderer_VK::cleanup()
 {
     vkDeviceWaitIdle(m_device);
 
+    flushCaptures();
+    destroyCaptureBuffers();
+
     cleanupSwapChain();
     destroyDepthBuffers();
 
@@ -332,6 +349,7 @@ void Renderer_VK::updateVertexCount(const std::vector<Vertex>& jelloVertices)
 
 void Renderer_VK::updateVertexData(const std::vector<Vertex>& jelloVertices)
 {
+    PROFILE_ZONE("updateVertexData");
     assert(m_jelloVertexBufferMemory != VK_NULL_HANDLE);
     assert(m_jelloVertexCount == jelloVertices.size());
     void* pData;
@@ -340,6 +358,17 @@ void Renderer_VK::updateVertexData(const std::vector<Vertex>& jelloVertices)
     vkUnmapMemory(m_device, m_jelloVertexBufferMemory);
 }
 
+void Renderer_VK::requestScreenshot(const char* fileName)
+{
+    if (!m_captureSupported)
+    {
+        printf("Error in Saving: swap chain images cannot be read back\n");
+        return;
+    }
+
+    m_requestedCaptureFileName = fileName;
+}
+
 void Renderer_VK::createInstance()
 {
     if (k_enableValidationLayers && !checkValidationLayerSupport())
@@ -687,6 +716,15 @@ void Renderer_VK::createSwapChain()
     createInfo.imageArrayLayers = 1;
     createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
+    // Screenshots copy straight out of the swap chain image, which needs TRANSFER_SRC and an 8-bit RGBA/BGRA format.
+    m_captureSupported = (swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) &&
+                         (surfaceFormat.format == VK_FORMAT_B8G8R8A8_UNORM || surfaceFormat.format == VK_FORMAT_B8G8R8A8_SRGB ||
+                          surfaceFormat.format == VK_FORMAT_R8G8B8A8_UNORM || surfaceFormat.format == VK_FORMAT_R8G8B8A8_SRGB);
+    if (m_captureSupported)
+    {
+        createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
+
     QueueFamilyIndices indices = findQueueFamilies(m_physicalDevice);
     uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
 
@@ -726,12 +764,17 @@ void Renderer_VK::recreateSwapChain()
 {
     vkDeviceWaitIdle(m_device);
 
+    // Readback buffers are sized to the swap chain extent; drain them before it changes.
+    flushCaptures();
+    destroyCaptureBuffers();
+
     cleanupSwapChain();
     destroyDepthBuffers();
     createSwapChain();
     createDepthBuffers();
     createImageViews();
     createFramebuffers();
+    createCaptureBuffers();
 }
 
 uint32_t Renderer_VK::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
@@ -1550,6 +1593,140 @@ void Renderer_VK::destroyDepthBuffers()
     }
 }
 
+void Renderer_VK::createCaptureBuffers()
+{
+    m_captureBuffers.assign(MAX_FRAMES_IN_FLIGHT, VK_NULL_HANDLE);
+    m_captureBuffersMemory.assign(MAX_FRAMES_IN_FLIGHT, VK_NULL_HANDLE);
+    m_captureBuffersMapped.assign(MAX_FRAMES_IN_FLIGHT, nullptr);
+    m_captureFileNames.assign(MAX_FRAMES_IN_FLIGHT, std::string());
+
+    if (!m_captureSupported)
+    {
+        return;
+    }
+
+    m_captureExtent = m_swapChainExtent;
+    VkDeviceSize bufferSize = (VkDeviceSize)m_captureExtent.width * m_captureExtent.height * 4;
+
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_captureBuffers[i], m_captureBuffersMemory[i]);
+
+        vkMapMemory(m_device, m_captureBuffersMemory[i], 0, bufferSize, 0, &m_captureBuffersMapped[i]);
+    }
+}
+
+void Renderer_VK::destroyCaptureBuffers()
+{
+    for (size_t i = 0; i < m_captureBuffers.size(); i++)
+    {
+        if (m_captureBuffers[i] != VK_NULL_HANDLE)
+        {
+            vkUnmapMemory(m_device, m_captureBuffersMemory[i]);
+            vkDestroyBuffer(m_device, m_captureBuffers[i], nullptr);
+            vkFreeMemory(m_device, m_captureBuffersMemory[i], nullptr);
+        }
+    }
+
+    m_captureBuffers.clear();
+    m_captureBuffersMemory.clear();
+    m_captureBuffersMapped.clear();
+    m_captureFileNames.clear();
+}
+
+void Renderer_VK::recordCapture(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+    VkImageMemoryBarrier toTransferSrc{};
+    toTransferSrc.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    toTransferSrc.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    toTransferSrc.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    toTransferSrc.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    toTransferSrc.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toTransferSrc.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransferSrc.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransferSrc.image = m_swapChainImages[imageIndex];
+    toTransferSrc.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    toTransferSrc.subresourceRange.baseMipLevel = 0;
+    toTransferSrc.subresourceRange.levelCount = 1;
+    toTransferSrc.subresourceRange.baseArrayLayer = 0;
+    toTransferSrc.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toTransferSrc);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0; // tightly packed
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {m_captureExtent.width, m_captureExtent.height, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, m_swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_captureBuffers[m_currentFrame], 1, &region);
+
+    VkImageMemoryBarrier toPresent = toTransferSrc;
+    toPresent.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    toPresent.dstAccessMask = 0;
+    toPresent.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toPresent.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkBufferMemoryBarrier hostReadBarrier{};
+    hostReadBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    hostReadBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostReadBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    hostReadBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostReadBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostReadBarrier.buffer = m_captureBuffers[m_currentFrame];
+    hostReadBarrier.offset = 0;
+    hostReadBarrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &toPresent);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &hostReadBarrier, 0, nullptr);
+}
+
+void Renderer_VK::writeCapture(uint32_t frame)
+{
+    if (frame >= m_captureFileNames.size() || m_captureFileNames[frame].empty())
+    {
+        return;
+    }
+
+    const bool isBgra = (m_swapChainImageFormat == VK_FORMAT_B8G8R8A8_UNORM) || (m_swapChainImageFormat == VK_FORMAT_B8G8R8A8_SRGB);
+    const uint8_t* src = static_cast<const uint8_t*>(m_captureBuffersMapped[frame]);
+
+    // Allocate a picture buffer
+    Pic* in = pic_alloc(m_captureExtent.width, m_captureExtent.height, 3, NULL);
+
+    printf("File to save to: %s\n", m_captureFileNames[frame].c_str());
+
+    // Vulkan images are stored top row first, which is already the PPM row order.
+    const size_t pixelCount = (size_t)m_captureExtent.width * m_captureExtent.height;
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        in->pix[i * 3 + 0] = src[i * 4 + (isBgra ? 2 : 0)];
+        in->pix[i * 3 + 1] = src[i * 4 + 1];
+        in->pix[i * 3 + 2] = src[i * 4 + (isBgra ? 0 : 2)];
+    }
+
+    if (ppm_write(m_captureFileNames[frame].data(), in))
+        printf("File saved Successfully\n");
+    else
+        printf("Error in Saving\n");
+
+    pic_free(in);
+
+    m_captureFileNames[frame].clear();
+}
+
+void Renderer_VK::flushCaptures()
+{
+    // Only called after vkDeviceWaitIdle, so every recorded copy has completed.
+    for (uint32_t i = 0; i < m_captureFileNames.size(); i++)
+    {
+        writeCapture(i);
+    }
+}
+
 void Renderer_VK::updateUniformBuffer(uint32_t currentImage)
 {
     UniformBufferObject ubo{};
@@ -1739,6 +1916,11 @@ void Renderer_VK::recordCommandBuffer(uint32_t m_currentFrame, uint32_t imageInd
 
     vkCmdEndRenderPass(commandBuffer);
 
+    if (!m_captureFileNames[m_currentFrame].empty())
+    {
+        recordCapture(commandBuffer, imageIndex);
+    }
+
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
     {
         throw std::runtime_error("failed to record command buffer!");
@@ -3,6 +3,7 @@
 
 #include <array>
 #include <optional>
+#include <string>
 #include <vector>
 
 #include <vulkan/vulkan.h>
@@ -93,6 +94,7 @@ public:
     void updateIndexData(const std::vector<uint16_t>& jelloIndices) override;
     void updateVertexCount(const std::vector<Vertex>& jelloVertices) override;
     void updateVertexData(const std::vector<Vertex>& jelloVertices) override;
+    void requestScreenshot(const char* fileName) override;
 
   private:
     void createInstance();
@@ -142,6 +144,12 @@ public:
     void cleanupSwapChain();
     void destroyDepthBuffers();
 
+    void createCaptureBuffers();
+    void destroyCaptureBuffers();
+    void recordCapture(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    void writeCapture(uint32_t frame);
+    void flushCaptures();
+
     void updateUniformBuffer(uint32_t currentImage);
     void recordCommandBuffer(uint32_t currentFrame, uint32_t imageIndex);
 
@@ -214,6 +222,16 @@ public:
     std::vector<VkSemaphore>        m_renderFinishedSemaphores;
     std::vector<VkFence>            m_inFlightFences;
 
+    // Screenshot readback: one persistently mapped host buffer per frame in flight. A capture recorded into frame
+    // N is only read on the CPU after m_inFlightFences[N] has signaled.
+    bool                            m_captureSupported = false;
+    VkExtent2D                      m_captureExtent = {};
+    std::vector<VkBuffer>           m_captureBuffers;
+    std::vector<VkDeviceMemory>     m_captureBuffersMemory;
+    std::vector<void*>              m_captureBuffersMapped;
+    std::vector<std::string>        m_captureFileNames; // empty if no capture is pending for that frame
+    std::string                     m_requestedCaptureFileName;
+
     uint32_t                        m_currentFrame = 0;
     bool                            m_framebufferResized = false;
 };
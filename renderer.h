@@ -48,6 +48,10 @@ public:
     virtual void updateIndexData(const std::vector<uint16_t>& jelloIndices) = 0;
     virtual void updateVertexCount(const std::vector<Vertex>& jelloVertices) = 0;
     virtual void updateVertexData(const std::vector<Vertex>& jelloVertices) = 0;
+
+    // Save the next rendered frame to a PPM file. The file is written once the frame has been read back,
+    // which may be a few frames later.
+    virtual void requestScreenshot(const char* fileName) = 0;
 };
 
 #endif // #ifndef _RENDERER_H_
\ No newline at end of file
@@ -0,0 +1,311 @@
+/*
+
+  runEnsemble: parameter sweeps over one world file
+
+  Simulates every combination of the parameter values in a grid file side by side (see ensemble.h) and prints
+  one summary line per variant; no window, no rendering.
+
+  Usage: runEnsemble <world file> <parameter grid file> [options]
+    -steps n       timesteps to simulate (default 1000)
+    -threads t     worker threads (default: all cores)
+    -o file        write the summaries to file instead of stdout
+    -compare       also run the first variants one by one with stepWorld, as separate simulations would, and
+                   report the speedup and the largest position difference
+    -counters      count cycles, instructions, cache and branch misses per ensemble block and, with -compare,
+                   per stepWorld region (Linux perf_event_open), see perfCounters.h
+    -trace file    write the profiler zones as Chrome trace JSON and print their summary (needs a JELLO_PROFILE
+                   build, e.g. make PROFILE=1)
+
+  Parameter grid file (text), one parameter per line followed by its values; '#' starts a comment:
+    kElastic 100 200 400
+    dElastic 0.25 0.5
+  Parameters that are not listed keep the world file's value. The variants are the cartesian product of the
+  lines (here 3 x 2 = 6), with the last line varying fastest.
+
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "ensemble.h"
+#include "parallel.h"
+#include "perfCounters.h"
+#include "physics.h"
+#include "profiler.h"
+#include "worldFile.h"
+
+static void usage()
+{
+    printf("usage: runEnsemble <world file> <parameter grid file> [-steps n] [-threads t] [-o file] [-compare] [-counters] [-trace file]\n");
+    exit(1);
+}
+
+// offset of each sweepable parameter in ensembleParameters
+static const struct
+{
+    const char* name;
+    double ensembleParameters::*field;
+} parameterNames[] = {{"kElastic", &ensembleParameters::kElastic},
+                      {"dElastic", &ensembleParameters::dElastic},
+                      {"kCollision", &ensembleParameters::kCollision},
+                      {"dCollision", &ensembleParameters::dCollision}};
+
+struct parameterAxis
+{
+    double ensembleParameters::*field;
+    std::vector<double> values;
+};
+
+static void readParameterGrid(const char* fileName, std::vector<parameterAxis>* axes)
+{
+    FILE* file = fopen(fileName, "r");
+    if (file == NULL)
+    {
+        printf("can't open file %s\n", fileName);
+        exit(1);
+    }
+
+    char line[4096];
+    int lineNumber = 0;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        lineNumber++;
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+        {
+            *comment = 0;
+        }
+
+        char* token = strtok(line, " \t\r\n");
+        if (token == NULL)
+        {
+            continue;
+        }
+
+        parameterAxis axis;
+        axis.field = NULL;
+        for (const auto& parameter : parameterNames)
+        {
+            if (strcmp(token, parameter.name) == 0)
+            {
+                axis.field = parameter.field;
+            }
+        }
+        if (axis.field == NULL)
+        {
+            printf("%s:%d: unknown parameter '%s' (expected kElastic, dElastic, kCollision or dCollision)\n",
+                   fileName, lineNumber, token);
+            exit(1);
+        }
+
+        while ((token = strtok(NULL, " \t\r\n")) != NULL)
+        {
+            char* end;
+            axis.values.push_back(strtod(token, &end));
+            if (*end != 0)
+            {
+                printf("%s:%d: '%s' is not a number\n", fileName, lineNumber, token);
+                exit(1);
+            }
+        }
+        if (axis.values.empty())
+        {
+            printf("%s:%d: no values\n", fileName, lineNumber);
+            exit(1);
+        }
+
+        axes->push_back(axis);
+    }
+
+    fclose(file);
+}
+
+// cartesian product of the axes; the last axis varies fastest
+static void expandGrid(const struct world* jello, const std::vector<parameterAxis>& axes,
+                       std::vector<ensembleParameters>* variants)
+{
+    ensembleParameters base = {jello->kElastic, jello->dElastic, jello->kCollision, jello->dCollision};
+    variants->assign(1, base);
+
+    for (const parameterAxis& axis : axes)
+    {
+        std::vector<ensembleParameters> expanded;
+        for (const ensembleParameters& variant : *variants)
+        {
+            for (double value : axis.values)
+            {
+                expanded.push_back(variant);
+                expanded.back().*axis.field = value;
+            }
+        }
+        variants->swap(expanded);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* worldFileName = NULL;
+    const char* gridFileName = NULL;
+    const char* outputFileName = NULL;
+    const char* traceFileName = NULL;
+    int steps = 1000;
+    int compare = 0;
+    int counters = 0;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        const char* option = argv[arg];
+        int remaining = argc - arg - 1;
+
+        if (strcmp(option, "-steps") == 0 && remaining >= 1)
+            steps = atoi(argv[++arg]);
+        else if (strcmp(option, "-threads") == 0 && remaining >= 1)
+            setParallelThreadCount(atoi(argv[++arg]));
+        else if (strcmp(option, "-o") == 0 && remaining >= 1)
+            outputFileName = argv[++arg];
+        else if (strcmp(option, "-compare") == 0)
+            compare = 1;
+        else if (strcmp(option, "-counters") == 0)
+            counters = 1;
+        else if (strcmp(option, "-trace") == 0 && remaining >= 1)
+            traceFileName = argv[++arg];
+        else if (option[0] == '-')
+            usage();
+        else if (worldFileName == NULL)
+            worldFileName = option;
+        else if (gridFileName == NULL)
+            gridFileName = option;
+        else
+            usage();
+    }
+    if (gridFileName == NULL || steps < 0)
+        usage();
+
+    struct world* jello = (struct world*)calloc(1, sizeof(struct world));
+    readWorld(worldFileName, jello);
+
+    std::vector<parameterAxis> axes;
+    std::vector<ensembleParameters> variants;
+    readParameterGrid(gridFileName, &axes);
+    expandGrid(jello, axes, &variants);
+
+    Ensemble ensemble(jello, variants);
+    if (counters)
+    {
+        counters = perfCountersEnable();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int step = 0; step < steps; step++)
+    {
+        ensemble.step();
+    }
+    double ensembleSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    FILE* output = stdout;
+    if (outputFileName != NULL && (output = fopen(outputFileName, "w")) == NULL)
+    {
+        printf("can't open file %s\n", outputFileName);
+        exit(1);
+    }
+
+    fprintf(output, "# variant kElastic dElastic kCollision dCollision comX comY comZ maxSpeed maxStrain stable\n");
+    int stableCount = 0;
+    for (int v = 0; v < ensemble.variantCount(); v++)
+    {
+        const ensembleParameters& parameters = ensemble.variant(v);
+        ensembleSummary summary = ensemble.summary(v);
+        stableCount += summary.stable;
+        fprintf(output, "%d %g %g %g %g %.6f %.6f %.6f %.6f %.6f %d\n", v, parameters.kElastic, parameters.dElastic,
+                parameters.kCollision, parameters.dCollision, summary.centerOfMass.x, summary.centerOfMass.y,
+                summary.centerOfMass.z, summary.maxSpeed, summary.maxStrain, summary.stable);
+    }
+    if (output != stdout)
+        fclose(output);
+
+    printf("# %d variants x %d steps (%s) in %.3f s on %d threads: %.0f variant-steps/s; %d stable\n",
+           ensemble.variantCount(), steps, jello->integrator, ensembleSeconds, parallelThreadCount(),
+           ensemble.variantCount() * (double)steps / ensembleSeconds, stableCount);
+
+    if (compare)
+    {
+        // one full world per variant, stepped with the regular physics on one thread, like one process each
+        int compareCount = ensemble.variantCount() < ENSEMBLE_LANES ? ensemble.variantCount() : ENSEMBLE_LANES;
+        double maxDifference = 0.0;
+        struct world* single = (struct world*)malloc(sizeof(struct world));
+        struct world* final = (struct world*)malloc(sizeof(struct world));
+
+        start = std::chrono::steady_clock::now();
+        for (int v = 0; v < compareCount; v++)
+        {
+            *single = *jello;
+            single->kElastic = variants[v].kElastic;
+            single->dElastic = variants[v].dElastic;
+            single->kCollision = variants[v].kCollision;
+            single->dCollision = variants[v].dCollision;
+
+            // the ensemble has no stability guard and never sleeps, so neither may the reference; each copy gets
+            // its own state, stepWorld would otherwise allocate it and the next copy would leak it
+            single->guard = (struct stabilityGuard*)calloc(1, sizeof(struct stabilityGuard));
+            single->sleep = (struct sleepState*)calloc(1, sizeof(struct sleepState));
+            single->adaptive = NULL;
+            if (jello->adaptive != NULL)
+            {
+                single->adaptive = (struct adaptiveStep*)calloc(1, sizeof(struct adaptiveStep));
+                single->adaptive->relativeTolerance = jello->adaptive->relativeTolerance;
+                single->adaptive->absoluteTolerance = jello->adaptive->absoluteTolerance;
+            }
+            single->energy = NULL;
+
+            for (int step = 0; step < steps; step++)
+            {
+                stepWorld(single);
+            }
+            free(single->guard);
+            free(single->sleep);
+            free(single->adaptive);
+
+            ensemble.getState(v, final);
+            for (int n = 0; n < JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS; n++)
+            {
+                const struct point& a = (&single->p[0][0][0])[n];
+                const struct point& b = (&final->p[0][0][0])[n];
+                maxDifference = fmax(maxDifference, fmax(fabs(a.x - b.x), fmax(fabs(a.y - b.y), fabs(a.z - b.z))));
+            }
+        }
+        double singleSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        double singleRate = compareCount * (double)steps / singleSeconds;
+        printf("# stepWorld, %d variants one by one: %.0f variant-steps/s; ensemble speedup %.1fx (%.1fx per thread); "
+               "max position difference %g\n",
+               compareCount, singleRate, ensemble.variantCount() * (double)steps / ensembleSeconds / singleRate,
+               ensemble.variantCount() * (double)steps / ensembleSeconds / singleRate / parallelThreadCount(),
+               maxDifference);
+
+        free(single);
+        free(final);
+    }
+
+    if (counters)
+    {
+        perfCountersPrint(stdout);
+    }
+
+    if (traceFileName != NULL)
+    {
+        if (!JELLO_PROFILE)
+        {
+            printf("-trace: this build has no profiler; rebuild with JELLO_PROFILE=1 (make PROFILE=1)\n");
+        }
+        else if (profilerWriteTrace(traceFileName))
+        {
+            profilerPrintSummary(stdout);
+        }
+    }
+
+    return 0;
+}
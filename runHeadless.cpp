@@ -0,0 +1,239 @@
+/*
+
+  runHeadless: simulates a world or scene file without a window
+
+  Steps the simulation exactly as the viewer would (stepWorld for a world file, Scene::step for a scene file),
+  without rendering, and reports the speed. Meant for benchmarks and for comparing physics changes.
+
+  Usage: runHeadless <world file | scene file> [options]
+    -steps n       timesteps to simulate (default 1000)
+    -threads t     worker threads (default: all cores)
+    -o file        write the final state as a world file (world files only)
+    -energy file   write the energy diagnostics of every step (see stepWorld) as a text time series, one line per
+                   body and step: step body time kinetic spring collision total px py pz; and print the energy drift
+    -counters      count cycles, instructions, cache and branch misses per physics region (Linux
+                   perf_event_open), see perfCounters.h
+    -trace file    write the profiler zones as Chrome trace JSON and print their summary (needs a JELLO_PROFILE
+                   build, e.g. make PROFILE=1)
+    -workprecision seconds
+                   instead of stepping, run every integrator over this much simulated time at a sweep of dt values
+                   and compare with a tight-tolerance DOPRI5 reference (world files only), see workPrecision.h
+    -accuracy e    error the work-precision benchmark looks for the cheapest run to reach (default 1e-3)
+
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "parallel.h"
+#include "perfCounters.h"
+#include "physics.h"
+#include "profiler.h"
+#include "scene.h"
+#include "workPrecision.h"
+#include "worldFile.h"
+
+static void usage()
+{
+    printf("usage: runHeadless <world file | scene file> [-steps n] [-threads t] [-o file] [-energy file] "
+           "[-counters] [-trace file]\n"
+           "       runHeadless <world file> -workprecision seconds [-accuracy e] [-threads t]\n");
+    exit(1);
+}
+
+static struct point centerOfMass(const struct world* jello)
+{
+    struct point center = {0.0, 0.0, 0.0};
+    const int count = JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS;
+    for (int n = 0; n < count; n++)
+    {
+        const struct point& p = (&jello->p[0][0][0])[n];
+        center.x += p.x / count;
+        center.y += p.y / count;
+        center.z += p.z / count;
+    }
+    return center;
+}
+
+int main(int argc, char** argv)
+{
+    const char* fileName = NULL;
+    const char* outputFileName = NULL;
+    const char* traceFileName = NULL;
+    const char* energyFileName = NULL;
+    int steps = 1000;
+    int counters = 0;
+    double workPrecisionDuration = 0.0;
+    double accuracy = 1e-3;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        const char* option = argv[arg];
+        int remaining = argc - arg - 1;
+
+        if (strcmp(option, "-steps") == 0 && remaining >= 1)
+            steps = atoi(argv[++arg]);
+        else if (strcmp(option, "-threads") == 0 && remaining >= 1)
+            setParallelThreadCount(atoi(argv[++arg]));
+        else if (strcmp(option, "-o") == 0 && remaining >= 1)
+            outputFileName = argv[++arg];
+        else if (strcmp(option, "-energy") == 0 && remaining >= 1)
+            energyFileName = argv[++arg];
+        else if (strcmp(option, "-counters") == 0)
+            counters = 1;
+        else if (strcmp(option, "-trace") == 0 && remaining >= 1)
+            traceFileName = argv[++arg];
+        else if (strcmp(option, "-workprecision") == 0 && remaining >= 1)
+            workPrecisionDuration = atof(argv[++arg]);
+        else if (strcmp(option, "-accuracy") == 0 && remaining >= 1)
+            accuracy = atof(argv[++arg]);
+        else if (option[0] == '-')
+            usage();
+        else if (fileName == NULL)
+            fileName = option;
+        else
+            usage();
+    }
+    if (fileName == NULL || steps < 0)
+        usage();
+
+    // a world file runs on its own, as in the viewer; a scene adds contacts between its bodies
+    Scene* scene = NULL;
+    struct world* jello = NULL;
+    if (isSceneFile(fileName))
+    {
+        scene = new Scene();
+        readScene(fileName, scene);
+    }
+    else
+    {
+        jello = (struct world*)calloc(1, sizeof(struct world));
+        readWorld(fileName, jello);
+    }
+    if (outputFileName != NULL && jello == NULL)
+    {
+        printf("-o: only a world file can be written back\n");
+        exit(1);
+    }
+
+    if (workPrecisionDuration > 0.0)
+    {
+        if (jello == NULL)
+        {
+            printf("-workprecision: needs a world file\n");
+            exit(1);
+        }
+        runWorkPrecision(jello, workPrecisionDuration, accuracy, stdout);
+        return 0;
+    }
+
+    int bodyCount = scene != NULL ? scene->bodyCount() : 1;
+
+    // energy diagnostics: switched on per body; the drift is tracked from the first sample on
+    FILE* energyFile = NULL;
+    std::vector<double> firstEnergy(bodyCount), maxDrift(bodyCount, 0.0);
+    if (energyFileName != NULL)
+    {
+        if ((energyFile = fopen(energyFileName, "w")) == NULL)
+        {
+            printf("can't open file %s\n", energyFileName);
+            exit(1);
+        }
+        fprintf(energyFile, "# step body time kinetic spring collision total px py pz\n");
+        for (int b = 0; b < bodyCount; b++)
+        {
+            struct world* body = scene != NULL ? scene->body(b) : jello;
+            body->energy = (struct energySample*)calloc(1, sizeof(struct energySample));
+        }
+    }
+
+    if (counters)
+    {
+        counters = perfCountersEnable();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int step = 0; step < steps; step++)
+    {
+        if (scene != NULL)
+            scene->step();
+        else
+            stepWorld(jello);
+
+        for (int b = 0; energyFile != NULL && b < bodyCount; b++)
+        {
+            const struct energySample* e = (scene != NULL ? scene->body(b) : jello)->energy;
+            double total = e->kinetic + e->spring + e->collision;
+            fprintf(energyFile, "%d %d %.6f %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", step, b, e->time, e->kinetic,
+                    e->spring, e->collision, total, e->momentum.x, e->momentum.y, e->momentum.z);
+            if (step == 0)
+                firstEnergy[b] = total;
+            else
+                maxDrift[b] = fmax(maxDrift[b], fabs(total - firstEnergy[b]));
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("# %s: %d bod%s x %d steps in %.3f s on %d threads: %.0f steps/s, %.1f us per body-step\n", fileName,
+           bodyCount, bodyCount == 1 ? "y" : "ies", steps, seconds, parallelThreadCount(), steps / seconds,
+           1e6 * seconds / ((double)steps * bodyCount));
+    for (int b = 0; b < bodyCount; b++)
+    {
+        struct world* body = scene != NULL ? scene->body(b) : jello;
+        struct point center = centerOfMass(body);
+        printf("body %d (%s): t = %g, center of mass %.6f %.6f %.6f\n", b, body->integrator, body->time, center.x,
+               center.y, center.z);
+        printIntegratorStatistics(body);
+        if (energyFile != NULL)
+        {
+            // relative to the first sample; a force field or damping changes the energy on purpose
+            printf("body %d energy: first %.9g, max drift %.3g (%.3g%% of the first)\n", b, firstEnergy[b],
+                   maxDrift[b], firstEnergy[b] != 0.0 ? 100.0 * maxDrift[b] / fabs(firstEnergy[b]) : 0.0);
+        }
+    }
+    if (energyFile != NULL)
+    {
+        fclose(energyFile);
+    }
+
+    if (counters)
+    {
+        perfCountersPrint(stdout);
+    }
+
+    if (traceFileName != NULL)
+    {
+        if (!JELLO_PROFILE)
+        {
+            printf("-trace: this build has no profiler; rebuild with JELLO_PROFILE=1 (make PROFILE=1)\n");
+        }
+        else if (profilerWriteTrace(traceFileName))
+        {
+            profilerPrintSummary(stdout);
+        }
+    }
+
+    if (outputFileName != NULL)
+    {
+        writeWorld(outputFileName, jello);
+    }
+
+    // the energy samples belong to this program, everything else to readWorld
+    for (int b = 0; b < bodyCount; b++)
+    {
+        struct world* body = scene != NULL ? scene->body(b) : jello;
+        free(body->energy);
+        body->energy = NULL;
+    }
+    delete scene;
+    if (jello != NULL)
+    {
+        freeWorld(jello);
+        free(jello);
+    }
+    return 0;
+}
@@ -0,0 +1,486 @@
+/*
+
+  runTests: behaviour checks of the simulator
+
+  Runs every check, prints one line per check and exits with 1 if any failed; "make test" builds and runs it.
+  The checks build small worlds in memory, write them with the world-file writers and read them back, so the
+  temporary files runTests.*.w are left in the current directory only when a check fails.
+
+  Usage: runTests [name]
+    name           run only the checks whose name contains it, e.g. "world"
+
+*/
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "physics.h"
+#include "scene.h"
+#include "worldFile.h"
+
+static int checks = 0;
+static int failures = 0;
+
+// prints the outcome of one check; returns the condition
+static bool check(bool condition, const char* test, const char* what)
+{
+    checks++;
+    if (!condition)
+    {
+        failures++;
+        printf("FAILED: %s: %s\n", test, what);
+    }
+    return condition;
+}
+
+// the cube of createWorld's defaults at rest at the origin, no force field and no extension lines
+static void defaultWorld(struct world* jello)
+{
+    memset(jello, 0, sizeof(*jello));
+    strcpy(jello->integrator, "RK4");
+    jello->dt = 0.0005;
+    jello->n = 1;
+    jello->kElastic = 200.0;
+    jello->dElastic = 0.25;
+    jello->kCollision = 400.0;
+    jello->dCollision = 0.25;
+    jello->mass = 1.0 / 512;
+
+    for (int i = 0; i <= JELLO_SUBDIVISIONS; i++)
+        for (int j = 0; j <= JELLO_SUBDIVISIONS; j++)
+            for (int k = 0; k <= JELLO_SUBDIVISIONS; k++)
+            {
+                jello->p[i][j][k].x = 1.0 * i / JELLO_SUBDIVISIONS;
+                jello->p[i][j][k].y = 1.0 * j / JELLO_SUBDIVISIONS;
+                jello->p[i][j][k].z = 1.0 * k / JELLO_SUBDIVISIONS;
+            }
+}
+
+// writes jello followed by the given extension lines to fileName and reads it back into result
+static void readWithExtensions(const char* fileName, struct world* jello, const char* extensions,
+                               struct world* result)
+{
+    writeWorld(fileName, jello);
+    FILE* file = fopen(fileName, "a");
+    if (file == NULL)
+    {
+        printf("can't open file\n");
+        exit(1);
+    }
+    fputs(extensions, file);
+    fclose(file);
+
+    readWorld(fileName, result);
+}
+
+// the largest coordinate of any control point, infinite if one is not finite
+static double extent(const struct world* jello)
+{
+    const struct point* p = &jello->p[0][0][0];
+    double largest = 0.0;
+    for (int n = 0; n < JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS; n++)
+    {
+        const double c[3] = {p[n].x, p[n].y, p[n].z};
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (!std::isfinite(c[axis]))
+            {
+                return INFINITY;
+            }
+            largest = fmax(largest, fabs(c[axis]));
+        }
+    }
+    return largest;
+}
+
+static std::string readFile(const char* fileName)
+{
+    std::string content;
+    FILE* file = fopen(fileName, "rb");
+    if (file != NULL)
+    {
+        char buffer[4096];
+        size_t size;
+        while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            content.append(buffer, size);
+        fclose(file);
+    }
+    return content;
+}
+
+/* ------------------------------ world files ------------------------------ */
+
+// every extension line survives a text and a binary round trip unchanged, and the binary format is exact
+static void testWorldRoundTrip()
+{
+    const char* test = "world round trip";
+    const char* extensions = "forcefield wind 1 0 0 2 0.5 1\n"
+                             "forcefield sparse 4 2 1\n"
+                             "0 0 0\n"
+                             "0 0 -1\n0 0 -1\n0 0 -1\n0 0 -1\n0 0 -1\n0 0 -1\n0 0 -1\n0 0 -1\n"
+                             "plane 0 0 1 1\n"
+                             "sphere 0.5 0.5 -1 0.5\n"
+                             "selfcollision 0.5\n"
+                             "stiffness 0 0 4 7 7 7 800 0\n"
+                             "mass 0 0 0 7 7 3 0.005\n"
+                             "pin 0 0 0 7 0 0\n"
+                             "drive 0 7 0 7 7 0 0.1 0 0 2\n"
+                             "tolerance 1e-05 1e-06\n"
+                             "guard 500.123456789 3.1\n"
+                             "sleep 0.0212345678 1.23456789e-05 100\n";
+
+    struct world jello, original, text, binary;
+    defaultWorld(&jello);
+    readWithExtensions("runTests.original.w", &jello, extensions, &original);
+    check(original.field != NULL && original.obstacles != NULL && original.selfCollision != NULL &&
+              original.material != NULL && original.kinematics != NULL && original.adaptive != NULL &&
+              original.guard != NULL && original.sleep != NULL,
+          test, "an extension line was not read");
+
+    writeWorld("runTests.text1.w", &original);
+    readWorld("runTests.text1.w", &text);
+    writeWorld("runTests.text2.w", &text);
+    std::string text1 = readFile("runTests.text1.w");
+    bool textOk = check(text1.size() > 0 && text1 == readFile("runTests.text2.w"), test,
+                        "the text file changes when read and written again");
+    textOk = check(text.guard->maxSpeed == original.guard->maxSpeed &&
+                       text.guard->maxStretch == original.guard->maxStretch,
+                   test, "the text file rounds the guard limits") && textOk;
+    textOk = check(text.sleep->maxSpeed == original.sleep->maxSpeed &&
+                       text.sleep->maxKineticEnergy == original.sleep->maxKineticEnergy,
+                   test, "the text file rounds the sleep thresholds") && textOk;
+    textOk = check(text1.find("selfcollision") != std::string::npos && text1.find("drive") != std::string::npos &&
+                       text1.find("forcefield sparse") != std::string::npos,
+                   test, "extension lines are missing from the text file") && textOk;
+
+    writeWorldBinary("runTests.binary1.w", &original);
+    readWorld("runTests.binary1.w", &binary);
+    writeWorldBinary("runTests.binary2.w", &binary);
+    std::string binary1 = readFile("runTests.binary1.w");
+    bool binaryOk = check(binary1.size() > 0 && binary1 == readFile("runTests.binary2.w"), test,
+                          "the binary file changes when read and written again");
+    binaryOk = check(memcmp(original.p, binary.p, sizeof(original.p)) == 0 &&
+                         memcmp(original.v, binary.v, sizeof(original.v)) == 0 && original.dt == binary.dt &&
+                         original.mass == binary.mass,
+                     test, "the binary file does not restore the world exactly") && binaryOk;
+
+    if (textOk && binaryOk)
+    {
+        remove("runTests.original.w");
+        remove("runTests.text1.w");
+        remove("runTests.text2.w");
+        remove("runTests.binary1.w");
+        remove("runTests.binary2.w");
+    }
+}
+
+/* ----------------------------- stability guard ---------------------------- */
+
+// a step that diverges is rolled back and redone in smaller steps, and the guard changes nothing while every step
+// is stable
+static void testGuard()
+{
+    const char* test = "guard";
+    struct world jello, guarded, unguarded;
+    defaultWorld(&jello);
+    jello.p[JELLO_SUBDIVISIONS][JELLO_SUBDIVISIONS][JELLO_SUBDIVISIONS].x += 0.2;
+
+    // RK4 at dt = 0.0007 is past its stability limit for these springs, dt / 4 is well inside it
+    jello.kElastic = 20000.0;
+    jello.dt = 0.0007;
+    readWithExtensions("runTests.guard.w", &jello, "guard 10000 5\nsleep off\n", &guarded);
+    readWithExtensions("runTests.guard.w", &jello, "guard off\nsleep off\n", &unguarded);
+    for (int step = 0; step < 200; step++)
+    {
+        stepWorld(&guarded);
+        stepWorld(&unguarded);
+    }
+    check(guarded.guard->rollbacks > 0, test, "a diverging step was not rolled back");
+    check(extent(&guarded) < 10.0, test, "the guarded cube diverged");
+    check(!(extent(&unguarded) < 10.0), test, "the unguarded cube did not diverge, the check proves nothing");
+    check(fabs(guarded.time - 200 * jello.dt) < 1e-9, test, "the retries changed the simulated time");
+
+    // the default springs are stable at the default dt: the guard must not touch a single bit
+    defaultWorld(&jello);
+    jello.p[JELLO_SUBDIVISIONS][JELLO_SUBDIVISIONS][JELLO_SUBDIVISIONS].x += 0.2;
+    readWithExtensions("runTests.guard.w", &jello, "guard 10000 5\nsleep off\n", &guarded);
+    readWithExtensions("runTests.guard.w", &jello, "guard off\nsleep off\n", &unguarded);
+    for (int step = 0; step < 200; step++)
+    {
+        stepWorld(&guarded);
+        stepWorld(&unguarded);
+    }
+    check(guarded.guard->rollbacks == 0, test, "a stable step was rolled back");
+    check(memcmp(guarded.p, unguarded.p, sizeof(guarded.p)) == 0 &&
+              memcmp(guarded.v, unguarded.v, sizeof(guarded.v)) == 0,
+          test, "the guard changed a stable simulation");
+
+    remove("runTests.guard.w");
+}
+
+/* --------------------------------- sleep --------------------------------- */
+
+// steps a calm cube with the given extension lines past its sleep threshold; returns whether it fell asleep
+static bool fallsAsleep(const char* extensions, struct world* jello)
+{
+    struct world base;
+    defaultWorld(&base);
+    std::string lines = std::string("sleep 0.01 1e-06 20\nguard off\n") + extensions;
+    readWithExtensions("runTests.sleep.w", &base, lines.c_str(), jello);
+    for (int step = 0; step < 40; step++)
+    {
+        stepWorld(jello);
+    }
+    return isAsleep(jello);
+}
+
+// a calm cube falls asleep unless something keeps changing the forces on it, and wakes when the forces change
+static void testSleep()
+{
+    const char* test = "sleep";
+    struct world jello;
+
+    check(fallsAsleep("", &jello), test, "a cube at rest did not fall asleep");
+    check(fabs(jello.time - 40 * jello.dt) < 1e-12, test, "the time stopped while asleep");
+    check(fallsAsleep("pin 0 0 0 7 7 0\n", &jello), test, "a pinned cube at rest did not fall asleep");
+    check(fallsAsleep("forcefield wind 1 0 0 1e-9 0 0\n", &jello), test,
+          "a cube under a faint steady wind did not fall asleep");
+
+    // as calm as the ones above, but the forces change with time
+    check(!fallsAsleep("forcefield wind 1 0 0 1e-9 0.5 1\n", &jello), test,
+          "a cube under a faint gusting wind fell asleep");
+    check(!fallsAsleep("drive 0 0 0 0 0 0 1e-9 0 0 1\n", &jello), test,
+          "a cube with a driven control point fell asleep");
+
+    // a change of the forces from outside, e.g. another body of a scene, wakes it
+    fallsAsleep("", &jello);
+    struct point* externalForce = (struct point*)calloc(JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS,
+                                                        sizeof(struct point));
+    externalForce[0].z = 1.0;
+    jello.externalForce = externalForce;
+    stepWorld(&jello);
+    check(!isAsleep(&jello) && jello.v[0][0][0].z > 0.0, test, "a new external force did not wake the cube");
+    jello.externalForce = NULL;
+    free(externalForce);
+
+    remove("runTests.sleep.w");
+}
+
+/* -------------------------------- material ------------------------------- */
+
+// the largest difference of any position or velocity between two worlds
+static double difference(const struct world* a, const struct world* b)
+{
+    const struct point* p[2] = {&a->p[0][0][0], &b->p[0][0][0]};
+    const struct point* v[2] = {&a->v[0][0][0], &b->v[0][0][0]};
+    double largest = 0.0;
+    for (int n = 0; n < JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS; n++)
+    {
+        largest = fmax(largest, fmax(fabs(p[0][n].x - p[1][n].x), fabs(v[0][n].x - v[1][n].x)));
+        largest = fmax(largest, fmax(fabs(p[0][n].y - p[1][n].y), fabs(v[0][n].y - v[1][n].y)));
+        largest = fmax(largest, fmax(fabs(p[0][n].z - p[1][n].z), fabs(v[0][n].z - v[1][n].z)));
+    }
+    return largest;
+}
+
+// every integrator honours the material: the same constants given per spring and per point behave like the
+// uniform ones, and under gravity heavy and light points fall alike
+static void testMaterial()
+{
+    const char* test = "material";
+    const char* integrators[] = {"RK4", "XPBD", "ProjectiveDynamics"};
+
+    for (const char* integrator : integrators)
+    {
+        std::string what = std::string(integrator) + ": ";
+
+        // the stiffness and mass lines override the world's constants everywhere
+        struct world jello, uniform, material;
+        defaultWorld(&jello);
+        strcpy(jello.integrator, integrator);
+        jello.p[JELLO_SUBDIVISIONS][JELLO_SUBDIVISIONS][JELLO_SUBDIVISIONS].x += 0.2;
+        jello.kElastic = 500.0;
+        jello.dElastic = 0.5;
+        jello.mass = 0.004;
+        readWithExtensions("runTests.material.w", &jello, "sleep off\n", &uniform);
+        jello.kElastic = 200.0;
+        jello.dElastic = 0.25;
+        jello.mass = 1.0 / 512;
+        readWithExtensions("runTests.material.w", &jello, "stiffness 0 0 0 7 7 7 500 0.5\nmass 0 0 0 7 7 7 0.004\n"
+                           "sleep off\n", &material);
+        for (int step = 0; step < 100; step++)
+        {
+            stepWorld(&uniform);
+            stepWorld(&material);
+        }
+        check(difference(&uniform, &material) < 1e-9, test,
+              (what + "a material with the same constants everywhere differs from the uniform world").c_str());
+
+        // half of the points 10 times heavier, gravity only: the cube falls without deforming, but for the small
+        // stretch of the rounded positions in the text file; a force of the uniform mass * g leaves the heavy half
+        // behind by about 0.4 in velocity
+        defaultWorld(&jello);
+        strcpy(jello.integrator, integrator);
+        readWithExtensions("runTests.material.w", &jello, "mass 0 0 0 7 7 3 0.02\nforcefield gravity 0 0 -10\n"
+                           "sleep off\n", &material);
+        for (int step = 0; step < 100; step++)
+        {
+            stepWorld(&material);
+        }
+        double spread = fabs(material.v[0][0][0].z - material.v[0][0][JELLO_SUBDIVISIONS].z) +
+                        fabs(material.p[0][0][JELLO_SUBDIVISIONS].z - material.p[0][0][0].z - 1.0);
+        check(material.v[0][0][0].z < -0.4 && spread < 1e-3, test,
+              (what + "heavy and light points do not fall alike under gravity").c_str());
+    }
+
+    remove("runTests.material.w");
+}
+
+/* ------------------------------- kinematics ------------------------------ */
+
+// every integrator keeps pinned points in place and driven ones on their path, and the collision passes leave the
+// kinematic points out: a pinned layer sunk into a plane adds no collision energy
+static void testKinematics()
+{
+    const char* test = "kinematics";
+    const char* integrators[] = {"RK4", "XPBD", "ProjectiveDynamics"};
+    const int N = JELLO_SUBPOINTS;
+
+    for (const char* integrator : integrators)
+    {
+        std::string what = std::string(integrator) + ": ";
+
+        // the bottom layer pinned 0.01 below the floor, one top corner driven, the opposite one pulled
+        struct world jello, pinned, start;
+        defaultWorld(&jello);
+        strcpy(jello.integrator, integrator);
+        jello.p[0][0][JELLO_SUBDIVISIONS].x -= 0.1;
+        readWithExtensions("runTests.kinematics.w", &jello, "plane 0 0 1 -0.01\npin 0 0 0 7 7 0\n"
+                           "drive 7 7 7 7 7 7 0.05 0 0 2\nsleep off\n", &pinned);
+        struct energySample sample;
+        memset(&sample, 0, sizeof(sample));
+        pinned.energy = &sample;
+        start = pinned;
+        for (int step = 0; step < 100; step++)
+        {
+            stepWorld(&pinned);
+        }
+
+        bool inPlace = true;
+        for (int i = 0; i < N; i++)
+            for (int j = 0; j < N; j++)
+            {
+                inPlace = inPlace && memcmp(&pinned.p[i][j][0], &start.p[i][j][0], sizeof(struct point)) == 0 &&
+                          pinned.v[i][j][0].x == 0.0 && pinned.v[i][j][0].y == 0.0 && pinned.v[i][j][0].z == 0.0;
+            }
+        check(inPlace, test, (what + "a pinned point moved").c_str());
+
+        const struct point& driven = pinned.p[JELLO_SUBDIVISIONS][JELLO_SUBDIVISIONS][JELLO_SUBDIVISIONS];
+        double path = start.p[JELLO_SUBDIVISIONS][JELLO_SUBDIVISIONS][JELLO_SUBDIVISIONS].x +
+                      0.05 * sin(2.0 * PI * 2.0 * pinned.time);
+        check(fabs(driven.x - path) < 1e-12, test, (what + "the driven point left its path").c_str());
+
+        check(fabs(pinned.v[0][0][JELLO_SUBDIVISIONS].x) > 1e-3, test, (what + "the free points did not move").c_str());
+        check(sample.collision == 0.0, test,
+              (what + "the pinned points sunk into the floor count as contacts").c_str());
+    }
+
+    remove("runTests.kinematics.w");
+}
+
+/* --------------------------------- scenes -------------------------------- */
+
+// a body placed with an offset in a scene keeps its pinned points at the offset position, and moves exactly like
+// the same body placed without one
+static void testScene()
+{
+    const char* test = "scene";
+    const int N = JELLO_SUBPOINTS;
+    const double offset = -1.5; // clear of the other body and of the bounding box
+
+    struct world jello;
+    defaultWorld(&jello);
+    jello.p[0][0][JELLO_SUBDIVISIONS].x -= 0.1;
+    readWithExtensions("runTests.scene.w", &jello, "pin 0 0 0 7 7 0\nsleep off\nguard off\n", &jello);
+
+    FILE* file = fopen("runTests.scene", "w");
+    if (file == NULL)
+    {
+        printf("can't open file runTests.scene\n");
+        exit(1);
+    }
+    fprintf(file, "scene\nbody runTests.scene.w 0 0 0\nbody runTests.scene.w %g 0 0\n", offset);
+    fclose(file);
+
+    Scene* scene = new Scene();
+    readScene("runTests.scene", scene);
+    for (int step = 0; step < 100; step++)
+    {
+        scene->step();
+    }
+
+    const struct world* a = scene->body(0);
+    const struct world* b = scene->body(1);
+    bool inPlace = true;
+    for (int i = 0; i < N; i++)
+        for (int j = 0; j < N; j++)
+        {
+            inPlace = inPlace && b->p[i][j][0].x == jello.p[i][j][0].x + offset &&
+                      b->p[i][j][0].y == jello.p[i][j][0].y && b->p[i][j][0].z == jello.p[i][j][0].z;
+        }
+    check(inPlace, test, "a pinned point of the offset body left its offset position");
+
+    double ax = 0.0, bx = 0.0;
+    for (int n = 0; n < N * N * N; n++)
+    {
+        ax += (&a->p[0][0][0])[n].x;
+        bx += (&b->p[0][0][0])[n].x;
+    }
+    check(fabs((bx - ax) / (N * N * N) - offset) < 1e-9, test,
+          "the centres of mass are not the offset apart");
+    check(fabs(a->v[0][0][JELLO_SUBDIVISIONS].x) > 1e-3, test, "the free points did not move");
+
+    delete scene;
+    freeWorld(&jello);
+    remove("runTests.scene.w");
+    remove("runTests.scene");
+}
+
+/* --------------------------------- driver -------------------------------- */
+
+struct testCase
+{
+    const char* name;
+    void (*run)();
+};
+
+static const testCase tests[] = {
+    {"world round trip", testWorldRoundTrip},
+    {"guard", testGuard},
+    {"sleep", testSleep},
+    {"material", testMaterial},
+    {"kinematics", testKinematics},
+    {"scene", testScene},
+};
+
+int main(int argc, char** argv)
+{
+    const char* filter = argc > 1 ? argv[1] : "";
+
+    for (const testCase& test : tests)
+    {
+        if (strstr(test.name, filter) == NULL)
+        {
+            continue;
+        }
+        int failed = failures;
+        test.run();
+        printf("%-24s %s\n", test.name, failures == failed ? "ok" : "FAILED");
+    }
+
+    printf("%d checks, %d failed\n", checks, failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,284 @@
+#include "scene.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "kinematics.h"
+#include "parallel.h"
+#include "physics.h"
+#include "selfCollision.h"
+#include "worldFile.h"
+
+#define NUM_PARTICLES (JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS)
+
+// contact distance between bodies, as a fraction of the rest spacing (same as "selfcollision 0.5")
+#define CONTACT_THICKNESS 0.5
+
+Scene::~Scene()
+{
+    for (struct world* body : m_bodies)
+    {
+        freeWorld(body);
+        free(body);
+    }
+    for (SelfCollision* surface : m_surfaces)
+    {
+        delete surface;
+    }
+    for (struct point* contactForce : m_contactForces)
+    {
+        free(contactForce);
+    }
+}
+
+void Scene::add(struct world* body)
+{
+    body->externalForce = (struct point*)calloc(NUM_PARTICLES, sizeof(struct point));
+
+    m_sweepOrder.push_back((int)m_bodies.size());
+    m_bodies.push_back(body);
+    m_surfaces.push_back(new SelfCollision(CONTACT_THICKNESS));
+    m_contactForces.push_back(body->externalForce);
+    m_bounds.push_back(bounds());
+}
+
+void Scene::updateBounds()
+{
+    const double margin = CONTACT_THICKNESS / JELLO_SUBDIVISIONS;
+
+    parallelFor(bodyCount(), [&](int begin, int end) {
+        for (int b = begin; b < end; b++)
+        {
+            const struct point* p = &m_bodies[b]->p[0][0][0];
+            bounds& box = m_bounds[b];
+            box.lo[0] = box.hi[0] = p[0].x;
+            box.lo[1] = box.hi[1] = p[0].y;
+            box.lo[2] = box.hi[2] = p[0].z;
+            for (int n = 1; n < NUM_PARTICLES; n++)
+            {
+                box.lo[0] = fmin(box.lo[0], p[n].x), box.hi[0] = fmax(box.hi[0], p[n].x);
+                box.lo[1] = fmin(box.lo[1], p[n].y), box.hi[1] = fmax(box.hi[1], p[n].y);
+                box.lo[2] = fmin(box.lo[2], p[n].z), box.hi[2] = fmax(box.hi[2], p[n].z);
+            }
+            for (int d = 0; d < 3; d++)
+            {
+                box.lo[d] -= margin;
+                box.hi[d] += margin;
+            }
+        }
+    });
+}
+
+void Scene::findPairs(std::vector<std::pair<int, int>>* pairs)
+{
+    // insertion sort by lower x bound; nearly sorted from the last step, so close to linear
+    for (int s = 1; s < (int)m_sweepOrder.size(); s++)
+    {
+        int b = m_sweepOrder[s];
+        int t = s - 1;
+        while (t >= 0 && m_bounds[m_sweepOrder[t]].lo[0] > m_bounds[b].lo[0])
+        {
+            m_sweepOrder[t + 1] = m_sweepOrder[t];
+            t--;
+        }
+        m_sweepOrder[t + 1] = b;
+    }
+
+    // sweep: each box is tested only against boxes that start before it ends on x
+    pairs->clear();
+    for (int s = 0; s < (int)m_sweepOrder.size(); s++)
+    {
+        const bounds& a = m_bounds[m_sweepOrder[s]];
+        for (int t = s + 1; t < (int)m_sweepOrder.size(); t++)
+        {
+            const bounds& b = m_bounds[m_sweepOrder[t]];
+            if (b.lo[0] > a.hi[0])
+            {
+                break;
+            }
+            if (a.lo[1] <= b.hi[1] && b.lo[1] <= a.hi[1] && a.lo[2] <= b.hi[2] && b.lo[2] <= a.hi[2])
+            {
+                pairs->push_back(std::make_pair(m_sweepOrder[s], m_sweepOrder[t]));
+            }
+        }
+    }
+}
+
+bool Scene::asleep() const
+{
+    for (const struct world* body : m_bodies)
+    {
+        if (!isAsleep(body))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Scene::wake()
+{
+    for (struct world* body : m_bodies)
+    {
+        wakeWorld(body);
+    }
+}
+
+void Scene::step()
+{
+    std::vector<std::pair<int, int>> pairs;
+
+    // nothing moves, so the contact forces are the ones the bodies fell asleep with
+    if (asleep())
+    {
+        for (struct world* body : m_bodies)
+        {
+            stepWorld(body);
+        }
+        return;
+    }
+
+    updateBounds();
+    findPairs(&pairs);
+
+    // only bodies that touch something need their surface hash
+    std::vector<int> touching(bodyCount(), 0);
+    for (const std::pair<int, int>& pair : pairs)
+    {
+        touching[pair.first] = touching[pair.second] = 1;
+    }
+
+    parallelFor(bodyCount(), [&](int begin, int end) {
+        for (int b = begin; b < end; b++)
+        {
+            memset(m_contactForces[b], 0, NUM_PARTICLES * sizeof(struct point));
+            if (touching[b])
+            {
+                m_surfaces[b]->updateHash(&m_bodies[b]->p[0][0][0]);
+            }
+        }
+    });
+
+    // narrow phase; serial because a contact writes forces to both bodies of the pair
+    m_pairCount = (int)pairs.size();
+    m_contactCount = 0;
+    for (const std::pair<int, int>& pair : pairs)
+    {
+        struct world* a = m_bodies[pair.first];
+        struct world* b = m_bodies[pair.second];
+        double kCollision = 0.5 * (a->kCollision + b->kCollision);
+        double dCollision = 0.5 * (a->dCollision + b->dCollision);
+
+        // particles of b against the surface of a, then the other way round
+        m_surfaces[pair.first]->addContactForces(&a->p[0][0][0], &a->v[0][0][0], m_contactForces[pair.first],
+                                                 &b->p[0][0][0], &b->v[0][0][0], m_contactForces[pair.second],
+                                                 kCollision, dCollision);
+        m_contactCount += m_surfaces[pair.first]->contactCount();
+        m_surfaces[pair.second]->addContactForces(&b->p[0][0][0], &b->v[0][0][0], m_contactForces[pair.second],
+                                                  &a->p[0][0][0], &a->v[0][0][0], m_contactForces[pair.first],
+                                                  kCollision, dCollision);
+        m_contactCount += m_surfaces[pair.second]->contactCount();
+    }
+
+    // the bodies are independent now; contact forces stay fixed over the step
+    parallelFor(bodyCount(), [&](int begin, int end) {
+        for (int b = begin; b < end; b++)
+        {
+            stepWorld(m_bodies[b]);
+        }
+    });
+}
+
+bool isSceneFile(const char* fileName)
+{
+    char keyword[32];
+    FILE* file = fopen(fileName, "r");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    bool scene = fscanf(file, "%31s", keyword) == 1 && strcmp(keyword, "scene") == 0;
+    fclose(file);
+    return scene;
+}
+
+void readScene(const char* fileName, Scene* scene)
+{
+    FILE* file = fopen(fileName, "r");
+    if (file == NULL)
+    {
+        printf("can't open file %s\n", fileName);
+        exit(1);
+    }
+
+    std::string directory = fileName;
+    size_t separator = directory.find_last_of("/\\");
+    directory.erase(separator == std::string::npos ? 0 : separator + 1);
+
+    char keyword[32];
+    if (fscanf(file, "%31s", keyword) != 1 || strcmp(keyword, "scene") != 0)
+    {
+        printf("%s is not a scene file\n", fileName);
+        exit(1);
+    }
+
+    while (fscanf(file, "%31s", keyword) == 1)
+    {
+        char worldFileName[4096];
+        struct point offset;
+        if (strcmp(keyword, "body") != 0 ||
+            fscanf(file, "%4095s %lf %lf %lf", worldFileName, &offset.x, &offset.y, &offset.z) != 4)
+        {
+            printf("scene: expected 'body <world file> dx dy dz'\n");
+            exit(1);
+        }
+
+        // relative names are relative to the scene file, not to the working directory
+        bool absolute = worldFileName[0] == '/' || worldFileName[0] == '\\' ||
+                        (worldFileName[0] != 0 && worldFileName[1] == ':');
+        std::string path = absolute ? std::string(worldFileName) : directory + worldFileName;
+        struct world* body = (struct world*)calloc(1, sizeof(struct world));
+        readWorld(path.c_str(), body);
+
+        for (int i = 0; i <= JELLO_SUBDIVISIONS; i++)
+            for (int j = 0; j <= JELLO_SUBDIVISIONS; j++)
+                for (int k = 0; k <= JELLO_SUBDIVISIONS; k++)
+                {
+                    body->p[i][j][k].x += offset.x;
+                    body->p[i][j][k].y += offset.y;
+                    body->p[i][j][k].z += offset.z;
+                }
+        // the kinematic points follow paths about where the world file put them; those move with the cube
+        if (body->kinematics != NULL)
+        {
+            for (int n : body->kinematics->points)
+            {
+                body->kinematics->anchor[n].x += offset.x;
+                body->kinematics->anchor[n].y += offset.y;
+                body->kinematics->anchor[n].z += offset.z;
+            }
+        }
+
+        if (scene->bodyCount() > 0 && body->dt != scene->body(0)->dt)
+        {
+            printf("scene: %s has timestep %lf, the first body has %lf; all bodies must use the same one\n",
+                   worldFileName, body->dt, scene->body(0)->dt);
+            exit(1);
+        }
+
+        scene->add(body);
+    }
+
+    fclose(file);
+
+    if (scene->bodyCount() == 0)
+    {
+        printf("scene: %s has no bodies\n", fileName);
+        exit(1);
+    }
+}
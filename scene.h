@@ -0,0 +1,77 @@
+#ifndef _SCENE_H_
+#define _SCENE_H_
+
+#include <vector>
+
+#include "world.h"
+
+class SelfCollision;
+
+// Several jello cubes simulated together. Each body is a complete world (its own particles, springs, force field
+// and colliders); bodies interact through penalty contacts between one body's surface particles and another's
+// surface triangles.
+//
+// Scene file (text):
+//   scene
+//   body <world file> dx dy dz      one line per body; the cube, with the paths of its pinned and driven points,
+//                                   is translated by (dx, dy, dz) after loading (so the side of its inclined
+//                                   plane is decided at the untranslated position);
+//                                   a relative file name is relative to the scene file's directory
+//
+// Every step: the body bounding boxes are sorted along x and swept (sweep and prune; the order changes little
+// between steps, so an insertion sort keeps it sorted in near-linear time), overlapping pairs get particle-vs-
+// surface contacts, and the contact forces are held fixed while every body advances one step of its own
+// integrator in parallel. Once every body has come to rest the contacts can't change, so a scene of sleeping
+// bodies costs next to nothing per step.
+class Scene
+{
+public:
+    ~Scene();
+
+    int bodyCount() const { return (int)m_bodies.size(); }
+    struct world* body(int b) { return m_bodies[b]; }
+
+    // adds a body, allocated with calloc and read with readWorld; the scene takes ownership and frees it with
+    // freeWorld and free. All bodies must use the same timestep.
+    void add(struct world* body);
+
+    // advances every body by one timestep
+    void step();
+
+    // true if every body is asleep (see stepWorld); step() then skips the contacts and only advances the clocks
+    bool asleep() const;
+
+    // wakes every body, e.g. after user interaction
+    void wake();
+
+    // body pairs whose boxes overlapped, and particle-triangle contacts, in the last step
+    int pairCount() const { return m_pairCount; }
+    int contactCount() const { return m_contactCount; }
+
+private:
+    struct bounds
+    {
+        double lo[3];
+        double hi[3];
+    };
+
+    void updateBounds();
+    void findPairs(std::vector<std::pair<int, int>>* pairs);
+
+    std::vector<struct world*> m_bodies;
+    std::vector<SelfCollision*> m_surfaces;     // per body, surface hash used for contacts with the other bodies
+    std::vector<struct point*> m_contactForces; // per body, JELLO_SUBPOINTS^3 forces; the body's externalForce
+    std::vector<bounds> m_bounds;
+    std::vector<int> m_sweepOrder; // bodies sorted by m_bounds[].lo[0]
+
+    int m_pairCount = 0;
+    int m_contactCount = 0;
+};
+
+// true if the file starts with the "scene" keyword
+bool isSceneFile(const char* fileName);
+
+// reads a scene file and the world files it references; aborts the program if a file can't be read
+void readScene(const char* fileName, Scene* scene);
+
+#endif // #ifndef _SCENE_H_
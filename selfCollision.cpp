@@ -0,0 +1,349 @@
+#include "selfCollision.h"
+
+#include <math.h>
+
+#define N JELLO_SUBPOINTS
+
+// cells a single triangle may span per axis before it is considered degenerate (exploded) and left out
+#define MAX_TRIANGLE_CELLS 8
+
+static inline int particleIndex(int i, int j, int k)
+{
+    return (i * N + j) * N + k;
+}
+
+// closest point to p on triangle (a, b, c), returned as barycentric weights of a, b, c (Ericson, RTCD 5.1.5)
+static void closestPointOnTriangle(const struct point& p, const struct point& a, const struct point& b,
+                                   const struct point& c, double weight[3])
+{
+    double abx = b.x - a.x, aby = b.y - a.y, abz = b.z - a.z;
+    double acx = c.x - a.x, acy = c.y - a.y, acz = c.z - a.z;
+    double apx = p.x - a.x, apy = p.y - a.y, apz = p.z - a.z;
+
+    double d1 = abx * apx + aby * apy + abz * apz;
+    double d2 = acx * apx + acy * apy + acz * apz;
+    if (d1 <= 0.0 && d2 <= 0.0)
+    {
+        weight[0] = 1.0, weight[1] = 0.0, weight[2] = 0.0;
+        return;
+    }
+
+    double bpx = p.x - b.x, bpy = p.y - b.y, bpz = p.z - b.z;
+    double d3 = abx * bpx + aby * bpy + abz * bpz;
+    double d4 = acx * bpx + acy * bpy + acz * bpz;
+    if (d3 >= 0.0 && d4 <= d3)
+    {
+        weight[0] = 0.0, weight[1] = 1.0, weight[2] = 0.0;
+        return;
+    }
+
+    double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+    {
+        double t = d1 / (d1 - d3);
+        weight[0] = 1.0 - t, weight[1] = t, weight[2] = 0.0;
+        return;
+    }
+
+    double cpx = p.x - c.x, cpy = p.y - c.y, cpz = p.z - c.z;
+    double d5 = abx * cpx + aby * cpy + abz * cpz;
+    double d6 = acx * cpx + acy * cpy + acz * cpz;
+    if (d6 >= 0.0 && d5 <= d6)
+    {
+        weight[0] = 0.0, weight[1] = 0.0, weight[2] = 1.0;
+        return;
+    }
+
+    double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+    {
+        double t = d2 / (d2 - d6);
+        weight[0] = 1.0 - t, weight[1] = 0.0, weight[2] = t;
+        return;
+    }
+
+    double va = d3 * d6 - d5 * d4;
+    if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0)
+    {
+        double t = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        weight[0] = 0.0, weight[1] = 1.0 - t, weight[2] = t;
+        return;
+    }
+
+    double denominator = 1.0 / (va + vb + vc);
+    double v = vb * denominator;
+    double w = vc * denominator;
+    weight[0] = 1.0 - v - w, weight[1] = v, weight[2] = w;
+}
+
+SelfCollision::SelfCollision(double thickness)
+    : m_thickness(thickness), m_cellSize(1.0 / JELLO_SUBDIVISIONS), m_contactDistance(thickness / JELLO_SUBDIVISIONS),
+      m_stamp(0), m_contactCount(0), m_contactEnergy(0.0)
+{
+    for (int i = 0; i < N; i++)
+        for (int j = 0; j < N; j++)
+            for (int k = 0; k < N; k++)
+            {
+                if (i == 0 || j == 0 || k == 0 || i == N - 1 || j == N - 1 || k == N - 1)
+                {
+                    m_surfaceParticles.push_back(particleIndex(i, j, k));
+                }
+            }
+
+    // two triangles per surface quad; 'axis' is the face normal axis, 'side' 0 (min) or 1 (max)
+    for (int axis = 0; axis < 3; axis++)
+        for (int side = 0; side < 2; side++)
+            for (int u = 0; u < N - 1; u++)
+                for (int w = 0; w < N - 1; w++)
+                {
+                    int corner[4];
+                    const int du[4] = {0, 1, 1, 0};
+                    const int dw[4] = {0, 0, 1, 1};
+                    for (int c = 0; c < 4; c++)
+                    {
+                        int g[3];
+                        g[axis] = side * (N - 1);
+                        g[(axis + 1) % 3] = u + du[c];
+                        g[(axis + 2) % 3] = w + dw[c];
+                        corner[c] = particleIndex(g[0], g[1], g[2]);
+                    }
+
+                    // (axis+1, axis+2, axis) is right-handed, so this order faces +axis; flip for the min side
+                    triangle t0 = {{corner[0], corner[1], corner[2]}, {1, 0, 0}, {0, 0, 0}};
+                    triangle t1 = {{corner[0], corner[2], corner[3]}, {1, 0, 0}, {0, 0, 0}};
+                    if (side == 0)
+                    {
+                        t0.vertex[1] = corner[2], t0.vertex[2] = corner[1];
+                        t1.vertex[1] = corner[3], t1.vertex[2] = corner[2];
+                    }
+                    m_triangles.push_back(t0);
+                    m_triangles.push_back(t1);
+                }
+
+    // about 4 buckets per triangle keeps the chains short
+    unsigned int bucketCount = 1;
+    while (bucketCount < 4 * m_triangles.size())
+    {
+        bucketCount <<= 1;
+    }
+    m_buckets.resize(bucketCount);
+    m_bucketMask = bucketCount - 1;
+    m_visited.assign(m_triangles.size(), 0);
+}
+
+unsigned int SelfCollision::bucketOf(int cx, int cy, int cz) const
+{
+    return ((unsigned int)cx * 73856093u ^ (unsigned int)cy * 19349663u ^ (unsigned int)cz * 83492791u) & m_bucketMask;
+}
+
+void SelfCollision::updateTriangle(int t, const struct point* p)
+{
+    triangle& tri = m_triangles[t];
+    const struct point& a = p[tri.vertex[0]];
+    const struct point& b = p[tri.vertex[1]];
+    const struct point& c = p[tri.vertex[2]];
+
+    double lo[3] = {fmin(a.x, fmin(b.x, c.x)), fmin(a.y, fmin(b.y, c.y)), fmin(a.z, fmin(b.z, c.z))};
+    double hi[3] = {fmax(a.x, fmax(b.x, c.x)), fmax(a.y, fmax(b.y, c.y)), fmax(a.z, fmax(b.z, c.z))};
+
+    int cellMin[3], cellMax[3];
+    bool valid = true;
+    for (int d = 0; d < 3; d++)
+    {
+        double l = floor((lo[d] - m_contactDistance) / m_cellSize);
+        double h = floor((hi[d] + m_contactDistance) / m_cellSize);
+        // also rejects NaN positions
+        if (!(h - l < MAX_TRIANGLE_CELLS) || fabs(l) > 1e8 || fabs(h) > 1e8)
+        {
+            valid = false;
+            break;
+        }
+        cellMin[d] = (int)l;
+        cellMax[d] = (int)h;
+    }
+    if (!valid)
+    {
+        cellMin[0] = 1, cellMax[0] = 0;
+        cellMin[1] = cellMin[2] = cellMax[1] = cellMax[2] = 0;
+    }
+
+    if (cellMin[0] == tri.cellMin[0] && cellMin[1] == tri.cellMin[1] && cellMin[2] == tri.cellMin[2] &&
+        cellMax[0] == tri.cellMax[0] && cellMax[1] == tri.cellMax[1] && cellMax[2] == tri.cellMax[2])
+    {
+        return;
+    }
+
+    // remove from the old cells (one entry was added per cell, even if several cells share a bucket)
+    for (int cx = tri.cellMin[0]; cx <= tri.cellMax[0]; cx++)
+        for (int cy = tri.cellMin[1]; cy <= tri.cellMax[1]; cy++)
+            for (int cz = tri.cellMin[2]; cz <= tri.cellMax[2]; cz++)
+            {
+                std::vector<int>& bucket = m_buckets[bucketOf(cx, cy, cz)];
+                for (size_t e = 0; e < bucket.size(); e++)
+                {
+                    if (bucket[e] == t)
+                    {
+                        bucket[e] = bucket.back();
+                        bucket.pop_back();
+                        break;
+                    }
+                }
+            }
+
+    for (int cx = cellMin[0]; cx <= cellMax[0]; cx++)
+        for (int cy = cellMin[1]; cy <= cellMax[1]; cy++)
+            for (int cz = cellMin[2]; cz <= cellMax[2]; cz++)
+            {
+                m_buckets[bucketOf(cx, cy, cz)].push_back(t);
+            }
+
+    for (int d = 0; d < 3; d++)
+    {
+        tri.cellMin[d] = cellMin[d];
+        tri.cellMax[d] = cellMax[d];
+    }
+}
+
+void SelfCollision::updateHash(const struct point* p)
+{
+    for (int t = 0; t < (int)m_triangles.size(); t++)
+    {
+        updateTriangle(t, p);
+    }
+}
+
+void SelfCollision::addForces(const struct point* p, const struct point* v, double kCollision, double dCollision,
+                              struct point* force, const unsigned char* kinematic)
+{
+    updateHash(p);
+
+    m_contactCount = 0;
+    m_contactEnergy = 0.0;
+    for (int particle : m_surfaceParticles)
+    {
+        // a kinematic particle only has to be tested against triangles with a free vertex
+        const unsigned char* mask = kinematic != NULL && kinematic[particle] ? kinematic : NULL;
+        m_contactCount += collideParticle(particle, p, v, force, true, p, v, force, kCollision, dCollision, mask);
+    }
+}
+
+void SelfCollision::addContactForces(const struct point* p, const struct point* v, struct point* force,
+                                     const struct point* otherP, const struct point* otherV, struct point* otherForce,
+                                     double kCollision, double dCollision)
+{
+    m_contactCount = 0;
+    m_contactEnergy = 0.0;
+    for (int particle : m_surfaceParticles)
+    {
+        m_contactCount += collideParticle(particle, otherP, otherV, otherForce, false, p, v, force, kCollision,
+                                          dCollision, NULL);
+    }
+}
+
+int SelfCollision::collideParticle(int particle, const struct point* xp, const struct point* xv,
+                                   struct point* xForce, bool sameBody, const struct point* p, const struct point* v,
+                                   struct point* force, double kCollision, double dCollision,
+                                   const unsigned char* kinematic)
+{
+    int contacts = 0;
+    const struct point& x = xp[particle];
+    if (!(fabs(x.x) < 1e8 && fabs(x.y) < 1e8 && fabs(x.z) < 1e8))
+    {
+        return 0;
+    }
+
+    m_stamp++;
+    int pi = particle / (N * N), pj = (particle / N) % N, pk = particle % N;
+    const std::vector<int>& bucket = m_buckets[bucketOf((int)floor(x.x / m_cellSize), (int)floor(x.y / m_cellSize),
+                                                        (int)floor(x.z / m_cellSize))];
+    for (int t : bucket)
+    {
+        // a triangle can be in a bucket more than once when two of its cells hash to the same bucket
+        if (m_visited[t] == m_stamp)
+        {
+            continue;
+        }
+        m_visited[t] = m_stamp;
+
+        const triangle& tri = m_triangles[t];
+        if (kinematic != NULL && kinematic[tri.vertex[0]] && kinematic[tri.vertex[1]] && kinematic[tri.vertex[2]])
+        {
+            continue;
+        }
+
+        // on the same body, skip the particle's own triangles and those of its grid neighbours
+        bool neighbour = false;
+        for (int c = 0; sameBody && c < 3; c++)
+        {
+            int vi = tri.vertex[c] / (N * N), vj = (tri.vertex[c] / N) % N, vk = tri.vertex[c] % N;
+            if (abs(vi - pi) <= 1 && abs(vj - pj) <= 1 && abs(vk - pk) <= 1)
+            {
+                neighbour = true;
+                break;
+            }
+        }
+        if (neighbour)
+        {
+            continue;
+        }
+
+        const struct point& a = p[tri.vertex[0]];
+        const struct point& b = p[tri.vertex[1]];
+        const struct point& c = p[tri.vertex[2]];
+
+        double weight[3];
+        closestPointOnTriangle(x, a, b, c, weight);
+        struct point q = {weight[0] * a.x + weight[1] * b.x + weight[2] * c.x,
+                          weight[0] * a.y + weight[1] * b.y + weight[2] * c.y,
+                          weight[0] * a.z + weight[1] * b.z + weight[2] * c.z};
+        double dx = x.x - q.x, dy = x.y - q.y, dz = x.z - q.z;
+        if (dx * dx + dy * dy + dz * dz >= m_contactDistance * m_contactDistance)
+        {
+            continue;
+        }
+
+        // outward normal of the triangle; only particles in front of it are in contact (one-sided), so surface
+        // particles that come close from inside the body, e.g. near a crushed edge, are not pushed out through it
+        double nx = (b.y - a.y) * (c.z - a.z) - (b.z - a.z) * (c.y - a.y);
+        double ny = (b.z - a.z) * (c.x - a.x) - (b.x - a.x) * (c.z - a.z);
+        double nz = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        double length = sqrt(nx * nx + ny * ny + nz * nz);
+        if (length < 1e-12)
+        {
+            continue;
+        }
+        nx /= length, ny /= length, nz /= length;
+
+        double separation = nx * dx + ny * dy + nz * dz;
+        if (separation < 0.0)
+        {
+            continue;
+        }
+        double depth = m_contactDistance - separation;
+
+        // relative normal velocity against the contact point on the triangle
+        const struct point& va = v[tri.vertex[0]];
+        const struct point& vb = v[tri.vertex[1]];
+        const struct point& vc = v[tri.vertex[2]];
+        double vn = nx * (xv[particle].x - (weight[0] * va.x + weight[1] * vb.x + weight[2] * vc.x)) +
+                    ny * (xv[particle].y - (weight[0] * va.y + weight[1] * vb.y + weight[2] * vc.y)) +
+                    nz * (xv[particle].z - (weight[0] * va.z + weight[1] * vb.z + weight[2] * vc.z));
+
+        double magnitude = kCollision * depth - dCollision * (vn < 0.0 ? vn : 0.0);
+        m_contactEnergy += 0.5 * kCollision * depth * depth;
+
+        xForce[particle].x += magnitude * nx;
+        xForce[particle].y += magnitude * ny;
+        xForce[particle].z += magnitude * nz;
+        for (int m = 0; m < 3; m++)
+        {
+            force[tri.vertex[m]].x -= weight[m] * magnitude * nx;
+            force[tri.vertex[m]].y -= weight[m] * magnitude * ny;
+            force[tri.vertex[m]].z -= weight[m] * magnitude * nz;
+        }
+
+        contacts++;
+    }
+
+    return contacts;
+}
@@ -0,0 +1,81 @@
+#ifndef _SELF_COLLISION_H_
+#define _SELF_COLLISION_H_
+
+#include <cstddef>
+
+#include <vector>
+
+#include "world.h"
+
+// Contacts between the cube's surface particles and its own surface triangles, so the jello can't fold
+// through itself. Enabled with the "selfcollision" world-file line.
+//
+// Surface triangles are kept in a uniform spatial hash whose cells are the rest spacing 1/JELLO_SUBDIVISIONS.
+// Each triangle is registered in every cell its bounding box (grown by the contact thickness) touches, so a
+// particle only has to look in its own cell. The hash is updated incrementally: a triangle is only moved when
+// its cell range changes, which is rare between steps. Triangles with a vertex that is a grid neighbour of the
+// particle (or the particle itself) are skipped, since they are always within contact distance at rest.
+// The cost is linear in the number of surface particles and triangles.
+class SelfCollision
+{
+public:
+    // thickness = contact distance as a fraction of the rest spacing
+    explicit SelfCollision(double thickness = 0.5);
+
+    // adds the contact forces (penalty springs with kCollision, dCollision) to force[], indexed like p[]
+    // kinematic = per particle, 1 for the kinematic points (kinematics.h); contacts between kinematic points only
+    // are skipped, as they move nothing, and left out of contactCount and contactEnergy
+    void addForces(const struct point* p, const struct point* v, double kCollision, double dCollision,
+                   struct point* force, const unsigned char* kinematic = NULL);
+
+    // registers the surface triangles at positions p in the hash; addForces does this itself
+    void updateHash(const struct point* p);
+
+    // contacts of another body's surface particles (otherP, otherV) against this body's surface (p, v), for
+    // multi-body scenes; the hash must be up to date with p. Forces are added to otherForce and force.
+    void addContactForces(const struct point* p, const struct point* v, struct point* force,
+                          const struct point* otherP, const struct point* otherV, struct point* otherForce,
+                          double kCollision, double dCollision);
+
+    double thickness() const { return m_thickness; }
+
+    // number of particle-triangle pairs found in contact by the last addForces / addContactForces
+    int contactCount() const { return m_contactCount; }
+
+    // potential of those contacts' penalty springs, sum of kCollision / 2 * depth^2
+    double contactEnergy() const { return m_contactEnergy; }
+
+private:
+    struct triangle
+    {
+        int vertex[3];    // flat particle indices, counter-clockwise seen from outside
+        int cellMin[3];   // cell range the triangle is currently registered in; cellMin[0] > cellMax[0] = none
+        int cellMax[3];
+    };
+
+    unsigned int bucketOf(int cx, int cy, int cz) const;
+    void updateTriangle(int t, const struct point* p);
+
+    // tests surface particle 'particle' of (xp, xv) against the triangles of (p, v); returns the number of contacts
+    // sameBody = the particle belongs to this body, so topological neighbours are skipped
+    // kinematic = NULL, or the mask of addForces for a kinematic particle of this body
+    int collideParticle(int particle, const struct point* xp, const struct point* xv, struct point* xForce,
+                        bool sameBody, const struct point* p, const struct point* v, struct point* force,
+                        double kCollision, double dCollision, const unsigned char* kinematic);
+
+    double m_thickness;
+    double m_cellSize;
+    double m_contactDistance;
+
+    std::vector<int> m_surfaceParticles;
+    std::vector<triangle> m_triangles;
+    std::vector<std::vector<int>> m_buckets; // triangle ids per hash bucket; size is a power of 2
+    unsigned int m_bucketMask;
+    std::vector<unsigned int> m_visited; // per triangle, the query stamp that last tested it
+    unsigned int m_stamp;
+
+    int m_contactCount;
+    double m_contactEnergy;
+};
+
+#endif // #ifndef _SELF_COLLISION_H_
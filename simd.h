@@ -0,0 +1,20 @@
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+// Picks the widest double-precision SIMD path the compiler is allowed to emit.
+// AVX needs /arch:AVX (MSVC) or -mavx (g++); SSE2 is always available on x64 and on x86 with /arch:SSE2.
+// Kernels that use these must keep a scalar fallback for other targets (e.g. ARM Macs).
+#if defined(__AVX__)
+#define JELLO_SIMD_AVX 1
+#define JELLO_SIMD_SSE2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JELLO_SIMD_AVX 0
+#define JELLO_SIMD_SSE2 1
+#include <emmintrin.h>
+#else
+#define JELLO_SIMD_AVX 0
+#define JELLO_SIMD_SSE2 0
+#endif
+
+#endif // #ifndef _SIMD_H_
@@ -0,0 +1,181 @@
+#include "sparseCholesky.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <iterator>
+
+bool SparseCholesky::factor(int n, const std::vector<int>& columnStart, const std::vector<int>& rowIndex,
+                            const std::vector<double>& values)
+{
+    m_permutation.clear();
+    m_columnStart.clear();
+    m_rowIndex.clear();
+    m_values.clear();
+
+    // graph of A without the diagonal
+    std::vector<std::vector<int>> neighbours(n);
+    for (int j = 0; j < n; j++)
+    {
+        for (int e = columnStart[j]; e < columnStart[j + 1]; e++)
+        {
+            if (rowIndex[e] != j)
+            {
+                neighbours[j].push_back(rowIndex[e]);
+            }
+        }
+        std::sort(neighbours[j].begin(), neighbours[j].end());
+        neighbours[j].erase(std::unique(neighbours[j].begin(), neighbours[j].end()), neighbours[j].end());
+    }
+
+    // Minimum degree ordering. Eliminating an unknown connects all its remaining neighbours to each other; those
+    // neighbours are exactly the rows below the diagonal in its column of L.
+    std::vector<int> order(n), inverse(n);
+    std::vector<std::vector<int>> pattern(n); // per original unknown, the original indices of its column's rows
+    std::vector<char> eliminated(n, 0);
+    std::vector<int> merged;
+    for (int step = 0; step < n; step++)
+    {
+        int best = -1;
+        for (int v = 0; v < n; v++)
+        {
+            if (!eliminated[v] && (best < 0 || neighbours[v].size() < neighbours[best].size()))
+            {
+                best = v;
+            }
+        }
+
+        order[step] = best;
+        inverse[best] = step;
+        eliminated[best] = 1;
+        pattern[best] = neighbours[best];
+
+        for (int u : pattern[best])
+        {
+            // neighbours[u] = (neighbours[u] + pattern[best]) - {u, best}
+            merged.clear();
+            std::set_union(neighbours[u].begin(), neighbours[u].end(), pattern[best].begin(), pattern[best].end(),
+                           std::back_inserter(merged));
+            neighbours[u].clear();
+            for (int w : merged)
+            {
+                if (w != u && w != best)
+                {
+                    neighbours[u].push_back(w);
+                }
+            }
+        }
+        neighbours[best].clear();
+    }
+
+    // pattern of L in the new order; rows sorted, diagonal first
+    m_columnStart.assign(n + 1, 0);
+    for (int k = 0; k < n; k++)
+    {
+        m_columnStart[k + 1] = m_columnStart[k] + 1 + (int)pattern[order[k]].size();
+    }
+    m_rowIndex.resize(m_columnStart[n]);
+    m_values.assign(m_columnStart[n], 0.0);
+    for (int k = 0; k < n; k++)
+    {
+        int* rows = &m_rowIndex[m_columnStart[k]];
+        rows[0] = k;
+        for (size_t r = 0; r < pattern[order[k]].size(); r++)
+        {
+            rows[1 + r] = inverse[pattern[order[k]][r]];
+        }
+        std::sort(rows + 1, rows + 1 + pattern[order[k]].size());
+    }
+
+    // for every row j, the columns k < j with L[j][k] != 0 and where that entry is stored
+    std::vector<std::vector<std::pair<int, int>>> rowEntries(n);
+    for (int k = 0; k < n; k++)
+    {
+        for (int e = m_columnStart[k] + 1; e < m_columnStart[k + 1]; e++)
+        {
+            rowEntries[m_rowIndex[e]].push_back(std::make_pair(k, e));
+        }
+    }
+
+    // left-looking numeric factorization with a dense work column
+    std::vector<double> work(n, 0.0);
+    for (int j = 0; j < n; j++)
+    {
+        int original = order[j];
+        for (int e = columnStart[original]; e < columnStart[original + 1]; e++)
+        {
+            int i = inverse[rowIndex[e]];
+            if (i >= j)
+            {
+                work[i] += values[e];
+            }
+        }
+
+        // column j -= L[j][k] * (column k below row j), for every earlier column k that reaches row j
+        for (const std::pair<int, int>& entry : rowEntries[j])
+        {
+            double ljk = m_values[entry.second];
+            for (int e = entry.second; e < m_columnStart[entry.first + 1]; e++)
+            {
+                work[m_rowIndex[e]] -= ljk * m_values[e];
+            }
+        }
+
+        double diagonal = work[j];
+        if (!(diagonal > 0.0))
+        {
+            m_permutation.clear();
+            m_columnStart.clear();
+            m_rowIndex.clear();
+            m_values.clear();
+            return false;
+        }
+        diagonal = sqrt(diagonal);
+
+        m_values[m_columnStart[j]] = diagonal;
+        work[j] = 0.0;
+        for (int e = m_columnStart[j] + 1; e < m_columnStart[j + 1]; e++)
+        {
+            m_values[e] = work[m_rowIndex[e]] / diagonal;
+            work[m_rowIndex[e]] = 0.0;
+        }
+    }
+
+    m_permutation = order;
+    return true;
+}
+
+void SparseCholesky::solve(double* x) const
+{
+    const int n = size();
+    std::vector<double> y(n);
+    for (int k = 0; k < n; k++)
+    {
+        y[k] = x[m_permutation[k]];
+    }
+
+    // L y = b
+    for (int j = 0; j < n; j++)
+    {
+        y[j] /= m_values[m_columnStart[j]];
+        for (int e = m_columnStart[j] + 1; e < m_columnStart[j + 1]; e++)
+        {
+            y[m_rowIndex[e]] -= m_values[e] * y[j];
+        }
+    }
+
+    // L^T x = y
+    for (int j = n - 1; j >= 0; j--)
+    {
+        for (int e = m_columnStart[j] + 1; e < m_columnStart[j + 1]; e++)
+        {
+            y[j] -= m_values[e] * y[m_rowIndex[e]];
+        }
+        y[j] /= m_values[m_columnStart[j]];
+    }
+
+    for (int k = 0; k < n; k++)
+    {
+        x[m_permutation[k]] = y[k];
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef _SPARSE_CHOLESKY_H_
+#define _SPARSE_CHOLESKY_H_
+
+#include <vector>
+
+// Sparse Cholesky factorization A = L L^T of a symmetric positive definite matrix, for systems that are solved
+// many times with the same matrix.
+//
+// factor() orders the unknowns by minimum degree (eliminating the unknown with the fewest remaining neighbours
+// first keeps the fill-in of L small), computes the pattern of L from that same elimination, and then the values
+// column by column (left-looking). solve() is a permutation and two sparse triangular substitutions.
+class SparseCholesky
+{
+public:
+    // A is n x n, given as a full symmetric matrix in compressed columns: column j holds the values
+    // values[columnStart[j] .. columnStart[j + 1]) at rows rowIndex[...]
+    // returns false (and leaves the factorization empty) if A is not positive definite
+    bool factor(int n, const std::vector<int>& columnStart, const std::vector<int>& rowIndex,
+                const std::vector<double>& values);
+
+    // overwrites x = b with A^-1 b; x has n entries
+    void solve(double* x) const;
+
+    int size() const { return (int)m_permutation.size(); }
+
+    // non-zeros of L, including the diagonal
+    int nonZeros() const { return (int)m_values.size(); }
+
+private:
+    std::vector<int> m_permutation; // m_permutation[new index] = original index
+    std::vector<int> m_columnStart; // L in compressed columns, the diagonal first in every column
+    std::vector<int> m_rowIndex;
+    std::vector<double> m_values;
+};
+
+#endif // #ifndef _SPARSE_CHOLESKY_H_
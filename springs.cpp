@@ -0,0 +1,294 @@
+#include "springs.h"
+
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "parallel.h"
+
+#define N JELLO_SUBPOINTS
+
+// the springs of an n^3 cube with rest spacing 'spacing'; particle (i, j, k) is slot[(i * n + j) * n + k], or
+// (i * n + j) * n + k itself if slot is NULL
+static void buildCubeSprings(struct springList* springs, int n, double spacing, const int* slot)
+{
+    // one direction of every spring type; the opposite direction is the same spring seen from the other end
+    const int offsets[][3] = {
+        // structural
+        {1, 0, 0}, {0, 1, 0}, {0, 0, 1},
+        // shear, face diagonals
+        {1, 1, 0}, {1, -1, 0}, {1, 0, 1}, {1, 0, -1}, {0, 1, 1}, {0, 1, -1},
+        // shear, body diagonals
+        {1, 1, 1}, {1, 1, -1}, {1, -1, 1}, {1, -1, -1},
+        // bend
+        {2, 0, 0}, {0, 2, 0}, {0, 0, 2}};
+    const int offsetCount = sizeof(offsets) / sizeof(offsets[0]);
+
+    springs->a.clear();
+    springs->b.clear();
+    springs->rest.clear();
+
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++)
+            for (int k = 0; k < n; k++)
+                for (int o = 0; o < offsetCount; o++)
+                {
+                    int ni = i + offsets[o][0], nj = j + offsets[o][1], nk = k + offsets[o][2];
+                    if (ni < 0 || ni >= n || nj < 0 || nj >= n || nk < 0 || nk >= n)
+                    {
+                        continue;
+                    }
+
+                    int a = (i * n + j) * n + k, b = (ni * n + nj) * n + nk;
+                    springs->a.push_back(slot != NULL ? slot[a] : a);
+                    springs->b.push_back(slot != NULL ? slot[b] : b);
+                    springs->rest.push_back(
+                        sqrt((double)(offsets[o][0] * offsets[o][0] + offsets[o][1] * offsets[o][1] +
+                                      offsets[o][2] * offsets[o][2])) *
+                        spacing);
+                }
+}
+
+void buildSpringList(struct springList* springs)
+{
+    buildCubeSprings(springs, N, 1.0 / JELLO_SUBDIVISIONS, NULL);
+}
+
+// spreads the low 10 bits of x to every third bit
+static uint64_t spreadBits(uint64_t x)
+{
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x30000ff;
+    x = (x | (x << 8)) & 0x300f00f;
+    x = (x | (x << 4)) & 0x30c30c3;
+    x = (x | (x << 2)) & 0x9249249;
+    return x;
+}
+
+void buildLattice(struct lattice* cube, int n, latticeOrder order)
+{
+    const int count = n * n * n;
+    cube->n = n;
+    cube->order = order;
+    cube->slot.resize(count);
+
+    if (order == LATTICE_MORTON)
+    {
+        // particles sorted by their interleaved coordinates; for n not a power of two the codes have gaps, so
+        // the slot is the rank of the code rather than the code itself
+        std::vector<std::pair<uint64_t, int>> codes(count);
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < n; j++)
+                for (int k = 0; k < n; k++)
+                {
+                    int particle = (i * n + j) * n + k;
+                    codes[particle] = std::make_pair((spreadBits(i) << 2) | (spreadBits(j) << 1) | spreadBits(k),
+                                                     particle);
+                }
+        std::sort(codes.begin(), codes.end());
+        for (int s = 0; s < count; s++)
+        {
+            cube->slot[codes[s].second] = s;
+        }
+    }
+    else
+    {
+        for (int particle = 0; particle < count; particle++)
+        {
+            cube->slot[particle] = particle;
+        }
+    }
+
+    buildCubeSprings(&cube->springs, n, 1.0 / (n - 1), cube->slot.data());
+
+    // counting sort by the lower endpoint, keeping the build order among the springs of one particle; row-major
+    // lists are in this order already
+    struct springList& springs = cube->springs;
+    std::vector<int> start(count + 1, 0);
+    for (int s = 0; s < springs.count(); s++)
+    {
+        start[std::min(springs.a[s], springs.b[s]) + 1]++;
+    }
+    for (int particle = 0; particle < count; particle++)
+    {
+        start[particle + 1] += start[particle];
+    }
+
+    struct springList sorted;
+    sorted.a.resize(springs.count());
+    sorted.b.resize(springs.count());
+    sorted.rest.resize(springs.count());
+    for (int s = 0; s < springs.count(); s++)
+    {
+        int t = start[std::min(springs.a[s], springs.b[s])]++;
+        sorted.a[t] = springs.a[s];
+        sorted.b[t] = springs.b[s];
+        sorted.rest[t] = springs.rest[s];
+    }
+    springs = sorted;
+}
+
+int colourSpringList(struct springList* springs, std::vector<int>* colourStart)
+{
+    const int count = springs->count();
+
+    // every spring takes the lowest colour neither of its particles has yet; a particle has at most 32 springs,
+    // so greedy colouring needs at most 2 * 32 - 1 colours and one bit mask per particle is enough
+    int particleCount = 0;
+    for (int s = 0; s < count; s++)
+    {
+        particleCount = std::max(particleCount, std::max(springs->a[s], springs->b[s]) + 1);
+    }
+    std::vector<uint64_t> used(particleCount, 0);
+    std::vector<int> colour(count);
+    int colourCount = 0;
+    for (int s = 0; s < count; s++)
+    {
+        uint64_t taken = used[springs->a[s]] | used[springs->b[s]];
+        int c = 0;
+        while (taken & ((uint64_t)1 << c))
+        {
+            c++;
+        }
+        colour[s] = c;
+        used[springs->a[s]] |= (uint64_t)1 << c;
+        used[springs->b[s]] |= (uint64_t)1 << c;
+        colourCount = c + 1 > colourCount ? c + 1 : colourCount;
+    }
+
+    // counting sort by colour, keeping the original order within a colour
+    colourStart->assign(colourCount + 1, 0);
+    for (int s = 0; s < count; s++)
+    {
+        (*colourStart)[colour[s] + 1]++;
+    }
+    for (int c = 0; c < colourCount; c++)
+    {
+        (*colourStart)[c + 1] += (*colourStart)[c];
+    }
+
+    struct springList sorted;
+    sorted.a.resize(count);
+    sorted.b.resize(count);
+    sorted.rest.resize(count);
+    std::vector<int> next(colourStart->begin(), colourStart->end() - 1);
+    for (int s = 0; s < count; s++)
+    {
+        int t = next[colour[s]]++;
+        sorted.a[t] = springs->a[s];
+        sorted.b[t] = springs->b[s];
+        sorted.rest[t] = springs->rest[s];
+    }
+    *springs = sorted;
+
+    return colourCount;
+}
+
+// the force of spring s, added to its first particle and subtracted from its second; see computeStencilForces
+// for the precisions
+template <typename Compute, typename State>
+static inline void addSpringForce(const struct springList* springs, int s, const State* p, const State* v,
+                                  Compute kHook, Compute kDamp, State* force)
+{
+    const int a = springs->a[s], b = springs->b[s];
+    const State& p1 = p[a];
+    const State& p2 = p[b];
+    Compute lx = (Compute)(p1.x - p2.x), ly = (Compute)(p1.y - p2.y), lz = (Compute)(p1.z - p2.z);
+    Compute length = sqrt(lx * lx + ly * ly + lz * lz);
+    if (length < (Compute)1e-8)
+    {
+        return;
+    }
+
+    // Hooke's law along the spring plus damping of the relative velocity along it, as computeSpringForce
+    const State& v1 = v[a];
+    const State& v2 = v[b];
+    Compute inverseLength = (Compute)1 / length;
+    Compute dot = ((Compute)(v1.x - v2.x) * lx + (Compute)(v1.y - v2.y) * ly + (Compute)(v1.z - v2.z) * lz) *
+                  inverseLength;
+    Compute magnitude = (-kHook * (length - (Compute)springs->rest[s]) - kDamp * dot) * inverseLength;
+
+    Compute fx = magnitude * lx, fy = magnitude * ly, fz = magnitude * lz;
+    force[a].x += fx;
+    force[a].y += fy;
+    force[a].z += fz;
+    force[b].x -= fx;
+    force[b].y -= fy;
+    force[b].z -= fz;
+}
+
+template <typename Compute, typename State>
+void addSpringForces(const struct springList* springs, const State* p, const State* v, double kHook, double kDamp,
+                     State* force)
+{
+    const int count = springs->count();
+    for (int s = 0; s < count; s++)
+    {
+        addSpringForce(springs, s, p, v, (Compute)kHook, (Compute)kDamp, force);
+    }
+}
+
+template void addSpringForces<double, struct point>(const struct springList* springs, const struct point* p,
+                                                    const struct point* v, double kHook, double kDamp,
+                                                    struct point* force);
+template void addSpringForces<float, struct pointf>(const struct springList* springs, const struct pointf* p,
+                                                    const struct pointf* v, double kHook, double kDamp,
+                                                    struct pointf* force);
+template void addSpringForces<float, struct point>(const struct springList* springs, const struct point* p,
+                                                   const struct point* v, double kHook, double kDamp,
+                                                   struct point* force);
+
+void addSpringForcesColoured(const struct springList* springs, const std::vector<int>& colourStart,
+                             const struct point* p, const struct point* v, double kHook, double kDamp,
+                             struct point* force)
+{
+    // the springs of one colour touch every particle at most once, so their threads never write the same force
+    for (size_t c = 0; c + 1 < colourStart.size(); c++)
+    {
+        parallelFor(colourStart[c + 1] - colourStart[c], [&](int begin, int end) {
+            for (int s = colourStart[c] + begin; s < colourStart[c] + end; s++)
+            {
+                addSpringForce(springs, s, p, v, kHook, kDamp, force);
+            }
+        });
+    }
+}
+
+void addSpringForcesReduced(const struct springList* springs, const struct point* p, const struct point* v,
+                            double kHook, double kDamp, struct point* force,
+                            std::vector<std::vector<struct point>>* accumulators, int particleCount)
+{
+    const int threads = parallelThreadCount();
+    accumulators->resize(threads);
+
+    // chunk t of the springs into accumulator t; parallelFor hands out one chunk per thread
+    parallelFor(threads, [&](int begin, int end) {
+        for (int t = begin; t < end; t++)
+        {
+            std::vector<struct point>& accumulator = (*accumulators)[t];
+            accumulator.assign(particleCount, point{0.0, 0.0, 0.0});
+            int first = (int)((long long)springs->count() * t / threads);
+            int last = (int)((long long)springs->count() * (t + 1) / threads);
+            for (int s = first; s < last; s++)
+            {
+                addSpringForce(springs, s, p, v, kHook, kDamp, accumulator.data());
+            }
+        }
+    });
+
+    // then every thread sums one range of particles over all accumulators
+    parallelFor(particleCount, [&](int begin, int end) {
+        for (int t = 0; t < threads; t++)
+        {
+            const struct point* accumulator = (*accumulators)[t].data();
+            for (int particle = begin; particle < end; particle++)
+            {
+                force[particle].x += accumulator[particle].x;
+                force[particle].y += accumulator[particle].y;
+                force[particle].z += accumulator[particle].z;
+            }
+        }
+    });
+}
@@ -0,0 +1,73 @@
+#ifndef _SPRINGS_H_
+#define _SPRINGS_H_
+
+#include <vector>
+
+#include "world.h"
+
+// The structural, shear and bend springs of the cube as a flat list, each spring stored once.
+// Particles are numbered (i * JELLO_SUBPOINTS + j) * JELLO_SUBPOINTS + k, which is also their order in
+// world::p and world::v, so &jello->p[0][0][0] can be indexed directly.
+// Structure of arrays, so a kernel walking the list streams through three plain arrays.
+struct springList
+{
+    std::vector<int> a;       // first particle
+    std::vector<int> b;       // second particle
+    std::vector<double> rest; // rest length
+
+    int count() const { return (int)a.size(); }
+};
+
+// builds the springs of a JELLO_SUBPOINTS^3 cube with rest spacing 1 / JELLO_SUBDIVISIONS
+void buildSpringList(struct springList* springs);
+
+// how the particles of a lattice are laid out in memory
+enum latticeOrder
+{
+    LATTICE_ROW_MAJOR, // (i * n + j) * n + k, as in world::p; neighbours along i are n^2 particles apart
+    LATTICE_MORTON     // along a Z-order curve: particles close in the cube are mostly close in memory as well
+};
+
+// A unit cube of n^3 particles of any size with the springs of the jello cube, for kernels and benchmarks on
+// cubes larger than struct world holds. Particle (i, j, k) is stored at slot[(i * n + j) * n + k]; the spring
+// endpoints are slots, remapped when the lattice is built, and the springs are sorted by their lower endpoint so
+// the list walks the particle arrays in storage order.
+struct lattice
+{
+    int n;
+    latticeOrder order;
+    std::vector<int> slot;
+    struct springList springs;
+};
+
+// n at most 1024
+void buildLattice(struct lattice* cube, int n, latticeOrder order);
+
+// Adds the spring and damping forces of every spring to both of its particles: each spring is evaluated once and
+// applied with opposite signs. p, v and force are indexed by the springs' particle numbers.
+// Instantiated for the precisions of computeStencilForces: <double, point>, <float, pointf> and mixed
+// <float, point>.
+template <typename Compute = double, typename State>
+void addSpringForces(const struct springList* springs, const State* p, const State* v, double kHook, double kDamp,
+                     State* force);
+
+// Greedy edge colouring: reorders the springs so that no two springs of the same colour share a particle, and
+// each colour is a contiguous range [colourStart[c], colourStart[c + 1]). Springs of one colour can then be
+// processed in parallel without write conflicts. Within a colour the springs keep their order. Returns the number
+// of colours (at most 64; a cube needs about 40).
+int colourSpringList(struct springList* springs, std::vector<int>* colourStart);
+
+// addSpringForces in parallel, colour after colour: the threads split the springs of one colour and add to the forces
+// with plain stores, no atomics or locks. The springs must have been coloured with colourSpringList.
+void addSpringForcesColoured(const struct springList* springs, const std::vector<int>& colourStart,
+                             const struct point* p, const struct point* v, double kHook, double kDamp,
+                             struct point* force);
+
+// addSpringForces in parallel without colouring: every thread adds one range of the springs to an accumulator of its own
+// (particleCount points, kept in 'accumulators' between calls), then the accumulators are summed into force.
+// Needs threads x particleCount points of extra memory and traffic, but no colour barriers.
+void addSpringForcesReduced(const struct springList* springs, const struct point* p, const struct point* v,
+                            double kHook, double kDamp, struct point* force,
+                            std::vector<std::vector<struct point>>* accumulators, int particleCount);
+
+#endif // #ifndef _SPRINGS_H_
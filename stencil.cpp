@@ -0,0 +1,135 @@
+#include "stencil.h"
+
+#include <math.h>
+
+#include "parallel.h"
+
+struct stencilNeighbour
+{
+    int di, dj, dk;
+    double rest; // in units of the spacing
+};
+
+static const stencilNeighbour neighbours[STENCIL_NEIGHBOURS] = {
+    // structural
+    {1, 0, 0, 1.0}, {-1, 0, 0, 1.0}, {0, 1, 0, 1.0}, {0, -1, 0, 1.0}, {0, 0, 1, 1.0}, {0, 0, -1, 1.0},
+    // shear, face diagonals
+    {1, 1, 0, 1.4142135623730951}, {1, -1, 0, 1.4142135623730951}, {-1, 1, 0, 1.4142135623730951}, {-1, -1, 0, 1.4142135623730951},
+    {1, 0, 1, 1.4142135623730951}, {1, 0, -1, 1.4142135623730951}, {-1, 0, 1, 1.4142135623730951}, {-1, 0, -1, 1.4142135623730951},
+    {0, 1, 1, 1.4142135623730951}, {0, 1, -1, 1.4142135623730951}, {0, -1, 1, 1.4142135623730951}, {0, -1, -1, 1.4142135623730951},
+    // shear, body diagonals
+    {1, 1, 1, 1.7320508075688772}, {1, 1, -1, 1.7320508075688772}, {1, -1, 1, 1.7320508075688772},
+    {1, -1, -1, 1.7320508075688772}, {-1, 1, 1, 1.7320508075688772}, {-1, 1, -1, 1.7320508075688772},
+    {-1, -1, 1, 1.7320508075688772}, {-1, -1, -1, 1.7320508075688772},
+    // bend
+    {2, 0, 0, 2.0}, {-2, 0, 0, 2.0}, {0, 2, 0, 2.0}, {0, -2, 0, 2.0}, {0, 0, 2, 2.0}, {0, 0, -2, 2.0}};
+
+// the force of one spring on particle 1, added to (fx, fy, fz); the positions and velocities are subtracted in the
+// precision they are stored in and the rest is computed in Compute, so a mixed run loses no accuracy to cancellation
+template <typename Compute, typename State>
+static inline void addSpring(const State& p1, const State& p2, const State& v1, const State& v2, Compute rest,
+                             Compute kHook, Compute kDamp, Compute& fx, Compute& fy, Compute& fz)
+{
+    Compute lx = (Compute)(p1.x - p2.x), ly = (Compute)(p1.y - p2.y), lz = (Compute)(p1.z - p2.z);
+    Compute length = sqrt(lx * lx + ly * ly + lz * lz);
+
+    // no branch, so the loops over a row vectorize; coincident particles get no force, as in computeSpringForce
+    Compute inverseLength = length < (Compute)1e-8 ? (Compute)0 : (Compute)1 / length;
+    Compute dot = ((Compute)(v1.x - v2.x) * lx + (Compute)(v1.y - v2.y) * ly + (Compute)(v1.z - v2.z) * lz) *
+                  inverseLength;
+    Compute magnitude = (-kHook * (length - rest) - kDamp * dot) * inverseLength;
+    fx += magnitude * lx;
+    fy += magnitude * ly;
+    fz += magnitude * lz;
+}
+
+template <typename Compute, typename State>
+void computeStencilForces(int n, double spacing, const State* p, const State* v, double kHook, double kDamp,
+                          State* force, int tile)
+{
+    // the neighbours as index offsets and absolute rest lengths, the same for every particle
+    int offset[STENCIL_NEIGHBOURS];
+    Compute rest[STENCIL_NEIGHBOURS];
+    for (int s = 0; s < STENCIL_NEIGHBOURS; s++)
+    {
+        offset[s] = (neighbours[s].di * n + neighbours[s].dj) * n + neighbours[s].dk;
+        rest[s] = (Compute)(neighbours[s].rest * spacing);
+    }
+
+    const Compute stiffness = (Compute)kHook, damping = (Compute)kDamp;
+    tile = tile > 0 && tile <= STENCIL_MAX_TILE ? tile : STENCIL_DEFAULT_TILE;
+    const int tilesPerEdge = (n + tile - 1) / tile;
+
+    parallelFor(tilesPerEdge * tilesPerEdge * tilesPerEdge, [&](int begin, int end) {
+        for (int t = begin; t < end; t++)
+        {
+            const int i0 = t / (tilesPerEdge * tilesPerEdge) * tile;
+            const int j0 = t / tilesPerEdge % tilesPerEdge * tile;
+            const int k0 = t % tilesPerEdge * tile;
+            const int i1 = i0 + tile < n ? i0 + tile : n;
+            const int j1 = j0 + tile < n ? j0 + tile : n;
+            const int k1 = k0 + tile < n ? k0 + tile : n;
+
+            // the forces of one row of the block, gathered neighbour by neighbour
+            Compute fx[STENCIL_MAX_TILE], fy[STENCIL_MAX_TILE], fz[STENCIL_MAX_TILE];
+
+            for (int i = i0; i < i1; i++)
+                for (int j = j0; j < j1; j++)
+                {
+                    const int row = (i * n + j) * n;
+                    for (int k = k0; k < k1; k++)
+                    {
+                        fx[k - k0] = fy[k - k0] = fz[k - k0] = 0;
+                    }
+
+                    // the particles of this row at least two layers inside every face need no checks: for them,
+                    // every neighbour is a contiguous run of the row next to it
+                    bool rowInside = i >= 2 && i < n - 2 && j >= 2 && j < n - 2;
+                    int kInside0 = rowInside ? (k0 > 2 ? k0 : 2) : k1;
+                    int kInside1 = rowInside ? (k1 < n - 2 ? k1 : n - 2) : k1;
+                    for (int s = 0; s < STENCIL_NEIGHBOURS; s++)
+                    {
+                        for (int k = kInside0; k < kInside1; k++)
+                        {
+                            addSpring(p[row + k], p[row + k + offset[s]], v[row + k], v[row + k + offset[s]], rest[s],
+                                      stiffness, damping, fx[k - k0], fy[k - k0], fz[k - k0]);
+                        }
+                    }
+
+                    for (int k = k0; k < k1; k++)
+                    {
+                        if (k >= kInside0 && k < kInside1)
+                        {
+                            continue;
+                        }
+                        for (int s = 0; s < STENCIL_NEIGHBOURS; s++)
+                        {
+                            int ni = i + neighbours[s].di, nj = j + neighbours[s].dj, nk = k + neighbours[s].dk;
+                            if (ni >= 0 && ni < n && nj >= 0 && nj < n && nk >= 0 && nk < n)
+                            {
+                                addSpring(p[row + k], p[row + k + offset[s]], v[row + k], v[row + k + offset[s]],
+                                          rest[s], stiffness, damping, fx[k - k0], fy[k - k0], fz[k - k0]);
+                            }
+                        }
+                    }
+
+                    for (int k = k0; k < k1; k++)
+                    {
+                        force[row + k].x = fx[k - k0];
+                        force[row + k].y = fy[k - k0];
+                        force[row + k].z = fz[k - k0];
+                    }
+                }
+        }
+    });
+}
+
+template void computeStencilForces<double, struct point>(int n, double spacing, const struct point* p,
+                                                         const struct point* v, double kHook, double kDamp,
+                                                         struct point* force, int tile);
+template void computeStencilForces<float, struct pointf>(int n, double spacing, const struct pointf* p,
+                                                         const struct pointf* v, double kHook, double kDamp,
+                                                         struct pointf* force, int tile);
+template void computeStencilForces<float, struct point>(int n, double spacing, const struct point* p,
+                                                        const struct point* v, double kHook, double kDamp,
+                                                        struct point* force, int tile);
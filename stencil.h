@@ -0,0 +1,34 @@
+#ifndef _STENCIL_H_
+#define _STENCIL_H_
+
+#include "world.h"
+
+// The springs of the jello cube as a fixed stencil on the lattice: every particle has up to 6 structural,
+// 20 shear (12 face and 8 body diagonals) and 6 bend neighbours at the same offsets, so a row-major n^3 cube needs
+// no spring list at all.
+//
+// The cube is cut into tile^3 blocks, so the planes of neighbours a block reads stay in cache while it works. A
+// block reads its own particles plus a halo of two layers (the reach of the bend springs) from the blocks around
+// it. Particles whose halo lies inside the cube run a kernel without any bounds checks, with the neighbours at
+// fixed index offsets; only blocks on the faces of the cube check, and only for their particles within two layers
+// of a face.
+// Every particle gathers the forces of its own springs and writes its force once: each spring is evaluated from
+// both ends, twice the arithmetic of a spring list, but no particle is written by two blocks, so the blocks run in
+// parallel (parallelFor) without conflicts.
+#define STENCIL_NEIGHBOURS 32
+#define STENCIL_DEFAULT_TILE 16
+#define STENCIL_MAX_TILE 256
+
+// Sets force (row-major, n^3) to the spring and damping forces on every particle of the cube with particle
+// spacing 'spacing'. n at least 3; tile at most STENCIL_MAX_TILE.
+// State is the precision p, v and force are stored in, Compute the one the springs are computed in:
+//   <double, point>   double throughout (the default)
+//   <float, pointf>   single precision: half the memory traffic and twice the values per SIMD register
+//   <float, point>    mixed: double positions and velocities, spring forces in float; the differences between
+//                     neighbours are taken in double, so large coordinates lose nothing to cancellation
+// benchLattice measures the speed and the error against double of each.
+template <typename Compute = double, typename State>
+void computeStencilForces(int n, double spacing, const State* p, const State* v, double kHook, double kDamp,
+                          State* force, int tile = STENCIL_DEFAULT_TILE);
+
+#endif // #ifndef _STENCIL_H_
@@ -22,17 +22,7 @@
 #include "openGL-headers.h"
 #endif // #if VULKAN_BUILD
 
-#define JELLO_SUBPOINTS 8
-#define JELLO_SUBDIVISIONS (JELLO_SUBPOINTS - 1)
-
-#define PI 3.141592653589793238462643383279
-
-struct point
-{
-    double x;
-    double y;
-    double z;
-};
+#include "world.h"
 
 // these variables control what is displayed on the screen
 extern int g_ishear;
@@ -44,29 +34,6 @@ extern int g_isaveScreenToFile;
 
 extern int g_istep; // render number of frames and stop
 extern int g_iphysics; // do physics
-
-struct world
-{
-    char integrator[10]; // "RK4" or "Euler"
-    double dt;           // timestep, e.g.. 0.001
-    int n;               // display only every nth timepoint
-    double kElastic;     // Hook's elasticity coefficient for all springs except collision springs
-    double dElastic;     // Damping coefficient for all springs except collision springs
-    double kCollision;   // Hook's elasticity coefficient for collision springs
-    double dCollision;   // Damping coefficient collision springs
-    double mass; // mass of each of the (JELLO_SUBPOINTS^3) control points, mass assumed to be equal
-                 // for every control point
-    int incPlanePresent; // Is the inclined plane present? 1 = YES, 0 = NO (always NO in this
-                         // assignment)
-    double a, b, c, d; // inclined plane has equation a * x + b * y + c * z + d = 0; if no inclined
-                       // plane, these four fields are not used
-    int resolution;    // resolution for the 3d grid specifying the external force field; value of 0
-                       // means that there is no force field
-    struct point* forceField; // pointer to the array of values of the force field
-    struct point p[JELLO_SUBPOINTS][JELLO_SUBPOINTS]
-                  [JELLO_SUBPOINTS]; // position of the JELLO_SUBPOINTS^3 control points
-    struct point v[JELLO_SUBPOINTS][JELLO_SUBPOINTS]
-                  [JELLO_SUBPOINTS]; // velocities of the JELLO_SUBPOINTS^3 control points
-};
+extern int g_iwake; // wake sleeping bodies on the next frame
 
 #endif
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include "workPrecision.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "physics.h"
+
+#define NUM_PARTICLES (JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS)
+
+#define REFERENCE_RELATIVE_TOLERANCE 1e-9
+#define REFERENCE_ABSOLUTE_TOLERANCE 1e-11
+
+// positions farther out than this mean the run has blown up
+#define DIVERGED_DISTANCE 1e3
+
+struct workPrecisionRun
+{
+    const char* integrator;
+    double dt;
+    double tolerance; // DOPRI5 only, 0 otherwise
+    long long steps;
+    long long forceEvaluations;
+    double seconds;
+    double error; // largest distance from the reference at a checkpoint
+    bool diverged;
+};
+
+// a copy of jello for one run: its own state and integrator settings, the force field and colliders shared
+static struct world* copyWorld(const struct world* jello, const char* integrator, double dt, double tolerance)
+{
+    struct world* copy = (struct world*)malloc(sizeof(struct world));
+    *copy = *jello;
+    strcpy(copy->integrator, integrator);
+    copy->dt = dt;
+    copy->energy = NULL;
+
+    copy->adaptive = NULL;
+    if (tolerance > 0.0)
+    {
+        copy->adaptive = (struct adaptiveStep*)calloc(1, sizeof(struct adaptiveStep));
+        copy->adaptive->relativeTolerance = tolerance;
+        copy->adaptive->absoluteTolerance = 0.01 * tolerance;
+    }
+
+    // the integrators on their own: no rollbacks, no sleeping
+    copy->guard = (struct stabilityGuard*)calloc(1, sizeof(struct stabilityGuard));
+    copy->sleep = (struct sleepState*)calloc(1, sizeof(struct sleepState));
+    return copy;
+}
+
+static void freeWorld(struct world* copy)
+{
+    free(copy->adaptive);
+    free(copy->guard);
+    free(copy->sleep);
+    free(copy);
+}
+
+/* steps 'copy' through the checkpoints; with reference == NULL stores its positions there, otherwise measures
+   the largest distance from them */
+static void runToCheckpoints(struct world* copy, long long stepsPerCheckpoint, std::vector<struct point>* positions,
+                             bool reference, struct workPrecisionRun* run)
+{
+    run->steps = 0;
+    run->error = 0.0;
+    run->diverged = false;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int checkpoint = 0; checkpoint < WORK_PRECISION_CHECKPOINTS && !run->diverged; checkpoint++)
+    {
+        for (long long step = 0; step < stepsPerCheckpoint; step++)
+        {
+            stepWorld(copy);
+        }
+        run->steps += stepsPerCheckpoint;
+
+        const struct point* p = &copy->p[0][0][0];
+        struct point* r = &(*positions)[(size_t)checkpoint * NUM_PARTICLES];
+        for (int n = 0; n < NUM_PARTICLES; n++)
+        {
+            if (!(fabs(p[n].x) < DIVERGED_DISTANCE && fabs(p[n].y) < DIVERGED_DISTANCE &&
+                  fabs(p[n].z) < DIVERGED_DISTANCE))
+            {
+                run->diverged = true;
+                break;
+            }
+
+            if (reference)
+            {
+                r[n] = p[n];
+            }
+            else
+            {
+                double dx = p[n].x - r[n].x, dy = p[n].y - r[n].y, dz = p[n].z - r[n].z;
+                run->error = fmax(run->error, sqrt(dx * dx + dy * dy + dz * dz));
+            }
+        }
+    }
+    run->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (copy->adaptive != NULL && strcmp(copy->integrator, "DOPRI5") == 0)
+    {
+        // six new stages per tried substep, plus the first stage of every world step
+        run->forceEvaluations = 6 * (copy->adaptive->accepted + copy->adaptive->rejected) + run->steps;
+    }
+    else
+    {
+        run->forceEvaluations = run->steps * findIntegrator(copy->integrator)->forceEvaluations;
+    }
+}
+
+void runWorkPrecision(const struct world* jello, double duration, double accuracy, FILE* output)
+{
+    const double dtFactors[] = {4.0, 2.0, 1.0, 0.5, 0.25, 0.125};
+    const double tolerances[] = {1e-3, 1e-4, 1e-5, 1e-6, 1e-7, 1e-8};
+    const int sweepCount = sizeof(dtFactors) / sizeof(dtFactors[0]);
+
+    // checkpoints a whole number of the largest dt apart, so every dt of the sweep lands on them exactly
+    const double coarsest = dtFactors[0] * jello->dt;
+    long long coarseStepsPerCheckpoint = (long long)floor(duration / (WORK_PRECISION_CHECKPOINTS * coarsest) + 0.5);
+    coarseStepsPerCheckpoint = coarseStepsPerCheckpoint > 0 ? coarseStepsPerCheckpoint : 1;
+    const double interval = coarseStepsPerCheckpoint * coarsest;
+
+    std::vector<struct point> reference((size_t)WORK_PRECISION_CHECKPOINTS * NUM_PARTICLES);
+    struct workPrecisionRun referenceRun = {"DOPRI5", jello->dt, REFERENCE_RELATIVE_TOLERANCE, 0, 0, 0.0, 0.0,
+                                            false};
+    struct world* copy = copyWorld(jello, "DOPRI5", jello->dt, REFERENCE_RELATIVE_TOLERANCE);
+    copy->adaptive->absoluteTolerance = REFERENCE_ABSOLUTE_TOLERANCE;
+    runToCheckpoints(copy, (long long)floor(interval / jello->dt + 0.5), &reference, true, &referenceRun);
+    freeWorld(copy);
+
+    fprintf(output, "# work-precision: %g s simulated, error = largest control point distance from the reference at "
+                    "%d checkpoints %g s apart\n",
+            WORK_PRECISION_CHECKPOINTS * interval, WORK_PRECISION_CHECKPOINTS, interval);
+    fprintf(output, "# reference: DOPRI5, relative tolerance %g, absolute %g: %lld force evaluations, %.3f s%s\n",
+            REFERENCE_RELATIVE_TOLERANCE, REFERENCE_ABSOLUTE_TOLERANCE, referenceRun.forceEvaluations,
+            referenceRun.seconds, referenceRun.diverged ? ", DIVERGED (errors below are meaningless)" : "");
+    fprintf(output, "# %-20s %12s %10s %12s %12s %12s\n", "integrator", "dt / rtol", "steps", "force evals",
+            "seconds", "max error");
+
+    std::vector<workPrecisionRun> runs;
+    for (const struct integrator* entry = integrators; entry->name != NULL; entry++)
+    {
+        bool adaptive = strcmp(entry->name, "DOPRI5") == 0;
+        for (int s = 0; s < sweepCount; s++)
+        {
+            struct workPrecisionRun run = {entry->name, adaptive ? jello->dt : dtFactors[s] * jello->dt,
+                                           adaptive ? tolerances[s] : 0.0, 0, 0, 0.0, 0.0, false};
+            copy = copyWorld(jello, entry->name, run.dt, run.tolerance);
+            runToCheckpoints(copy, (long long)floor(interval / run.dt + 0.5), &reference, false, &run);
+            freeWorld(copy);
+            runs.push_back(run);
+
+            char setting[32];
+            if (adaptive)
+                sprintf(setting, "rtol %g", run.tolerance);
+            else
+                sprintf(setting, "%g", run.dt);
+            if (run.diverged)
+                fprintf(output, "  %-20s %12s %10lld %12lld %12.3f %12s\n", run.integrator, setting, run.steps,
+                        run.forceEvaluations, run.seconds, "diverged");
+            else
+                fprintf(output, "  %-20s %12s %10lld %12lld %12.3f %12.3e\n", run.integrator, setting, run.steps,
+                        run.forceEvaluations, run.seconds, run.error);
+            fflush(output);
+        }
+    }
+
+    const workPrecisionRun* cheapest = NULL;
+    for (const workPrecisionRun& run : runs)
+    {
+        if (!run.diverged && run.error <= accuracy && (cheapest == NULL || run.seconds < cheapest->seconds))
+        {
+            cheapest = &run;
+        }
+    }
+    if (cheapest == NULL)
+    {
+        fprintf(output, "# no run reached an error of %g\n", accuracy);
+    }
+    else if (cheapest->tolerance > 0.0)
+    {
+        fprintf(output, "# cheapest with error <= %g: %s with relative tolerance %g (%.3f s, error %.3e)\n", accuracy,
+                cheapest->integrator, cheapest->tolerance, cheapest->seconds, cheapest->error);
+    }
+    else
+    {
+        fprintf(output, "# cheapest with error <= %g: %s at dt %g (%.3f s, error %.3e)\n", accuracy,
+                cheapest->integrator, cheapest->dt, cheapest->seconds, cheapest->error);
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef _WORK_PRECISION_H_
+#define _WORK_PRECISION_H_
+
+#include <stdio.h>
+
+#include "world.h"
+
+// Work-precision benchmark: which integrator and dt reach a given accuracy for the least time.
+//
+// A reference trajectory of the world is computed with DOPRI5 at tight tolerances (relative 1e-9, absolute
+// 1e-11). Then every registered integrator runs the same world at dt = world dt * 4, 2, 1, 1/2, 1/4 and 1/8.
+// DOPRI5 chooses its own substeps, so it runs at the world dt with relative tolerances 1e-3 .. 1e-8 instead.
+// WORK_PRECISION_CHECKPOINTS times along the way, the positions are compared with the reference. The error of a
+// run is the largest distance of a control point from its reference position at any checkpoint. Runs that blow
+// up count as diverged. The stability guard and sleeping are off for all runs, so the numbers show the
+// integrators themselves.
+//
+// Prints one table row per run: integrator, dt (or tolerance), steps, force evaluations, wall-clock time and
+// error, then the cheapest run (by time) whose error is at most 'accuracy'. XPBD and ProjectiveDynamics never call
+// computeAcceleration and show 0 force evaluations; compare them on time.
+// The world itself is not changed; the runs step copies that share its force field and colliders.
+#define WORK_PRECISION_CHECKPOINTS 10
+
+void runWorkPrecision(const struct world* jello, double duration, double accuracy, FILE* output);
+
+#endif // #ifndef _WORK_PRECISION_H_
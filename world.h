@@ -0,0 +1,120 @@
+#ifndef _WORLD_H_
+#define _WORLD_H_
+
+// Simulation state shared by the viewers, the physics and the command-line tools.
+// Kept free of any windowing/graphics headers so tools such as createWorld can use it on their own.
+
+#define JELLO_SUBPOINTS 8
+#define JELLO_SUBDIVISIONS (JELLO_SUBPOINTS - 1)
+
+#define PI 3.141592653589793238462643383279
+
+struct point
+{
+    double x;
+    double y;
+    double z;
+};
+
+// a point in single precision, for the float modes of the lattice kernels (springs.h, stencil.h)
+struct pointf
+{
+    float x;
+    float y;
+    float z;
+};
+
+// error control and statistics of the adaptive integrator (DOPRI5), set by the "tolerance" world-file line
+struct adaptiveStep
+{
+    double relativeTolerance;
+    double absoluteTolerance;
+    double step;        // substep the next world step starts with; 0 = start with dt
+    long long accepted; // substeps taken
+    long long rejected; // substeps whose error was too large and were retried with a smaller size
+};
+
+// limits and telemetry of the stability guard in stepWorld, set by the "guard" world-file line
+struct stabilityGuard
+{
+    int enabled;
+    double maxSpeed;      // fastest allowed control point
+    double maxStretch;    // longest allowed structural spring, in rest lengths
+    long long steps;      // guarded steps
+    long long rollbacks;  // steps that failed the check and were redone in halves
+    long long substeps;   // reduced-dt substeps taken by the retries
+    long long giveUps;    // steps still unstable at the smallest dt; rolled back with the velocities zeroed
+    int deepestHalving;   // smallest dt used so far is dt / 2^deepestHalving
+    int halving;          // while a retry steps: its depth (the step runs at dt / 2^halving); 0 otherwise
+};
+
+// rest detection of stepWorld, set by the "sleep" world-file line
+struct sleepState
+{
+    int enabled;
+    double maxSpeed;         // the body is calm while no control point is faster than this
+    double maxKineticEnergy; // and its total kinetic energy is below this
+    int stepsToSleep;        // consecutive calm steps before it falls asleep
+    int calmSteps;           // calm steps so far
+    int asleep;              // 1 = stepWorld only advances the time
+    long long steps;         // steps, awake or asleep
+    long long sleptSteps;    // steps skipped while asleep
+    struct point externalForce[JELLO_SUBPOINTS][JELLO_SUBPOINTS]
+                              [JELLO_SUBPOINTS]; // world::externalForce when the body fell asleep; a change wakes it
+};
+
+// energy and momentum of the cube at the start of a step, folded into that step's force evaluation; see stepWorld
+struct energySample
+{
+    int requested;         // set by stepWorld; the next computeAcceleration fills in the sample and clears it
+    double time;
+    double kinetic;        // sum of m v^2 / 2
+    double spring;         // elastic potential of the structural, shear and bend springs
+    double collision;      // potential of the penalty springs of planes, obstacles and self-contacts
+    struct point momentum; // sum of m v
+};
+
+class ForceField;
+class CollisionPlanes;
+class Obstacles;
+class SelfCollision;
+struct material;
+struct kinematics;
+
+struct world
+{
+    char integrator[32]; // "RK4", "Euler", "SymplecticEuler", "Verlet", "DOPRI5", "XPBD" or "ProjectiveDynamics", see integrators[] in physics.cpp
+    double dt;           // timestep, e.g.. 0.001; for DOPRI5 the interval it advances per step, in adaptive substeps
+    int n;               // display only every nth timepoint
+    double time;         // simulation time, advanced by the integrators
+    double kElastic;     // Hook's elasticity coefficient for all springs except collision springs
+    double dElastic;     // Damping coefficient for all springs except collision springs
+    double kCollision;   // Hook's elasticity coefficient for collision springs
+    double dCollision;   // Damping coefficient collision springs
+    double mass; // mass of each of the (JELLO_SUBPOINTS^3) control points, mass assumed to be equal
+                 // for every control point
+    int incPlanePresent; // Is the inclined plane present? 1 = YES, 0 = NO (always NO in this
+                         // assignment)
+    double a, b, c, d; // inclined plane has equation a * x + b * y + c * z + d = 0; if no inclined
+                       // plane, these four fields are not used
+    int resolution;    // resolution for the 3d grid specifying the external force field; value of 0
+                       // means that there is no force field
+    struct point* forceField; // pointer to the array of values of the force field
+    ForceField* field;        // force-field backend(s) sampled by the physics, built by readWorld; NULL if none
+    CollisionPlanes* planes;  // box walls, inclined plane and "plane" lines, built by readWorld; NULL = no collisions
+    Obstacles* obstacles;     // sphere/capsule/sdf obstacles from the world file; NULL if none
+    SelfCollision* selfCollision; // surface self-contacts, NULL unless the world file has "selfcollision"
+    struct point* externalForce;  // JELLO_SUBPOINTS^3 extra forces, e.g. contacts from other bodies; NULL if none
+    struct adaptiveStep* adaptive; // DOPRI5 tolerances and statistics; NULL = default tolerances until the first step
+    struct stabilityGuard* guard;  // blow-up detection and rollback; NULL = default limits from the first step on
+    struct sleepState* sleep;      // rest detection; NULL = default thresholds from the first step on
+    struct energySample* energy;   // energy diagnostics of the last step; NULL (the default) = not computed
+    struct material* material;     // per-spring stiffness and damping, per-point mass; NULL = uniform, see material.h
+    struct kinematics* kinematics; // pinned and driven control points; NULL = all free, see kinematics.h
+    struct point p[JELLO_SUBPOINTS][JELLO_SUBPOINTS]
+                  [JELLO_SUBPOINTS]; // position of the JELLO_SUBPOINTS^3 control points
+    struct point v[JELLO_SUBPOINTS][JELLO_SUBPOINTS]
+                  [JELLO_SUBPOINTS]; // velocities of the JELLO_SUBPOINTS^3 control points
+};
+
+#endif // #ifndef _WORLD_H_
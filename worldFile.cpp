@@ -0,0 +1,611 @@
+/*
+
+  USC/Viterbi/Computer Science
+  "Jello Cube" Assignment 1 starter code
+
+  Reading and writing of world files (text and binary)
+
+*/
+
+#include "worldFile.h"
+#include "collision.h"
+#include "forceField.h"
+#include "kinematics.h"
+#include "material.h"
+#include "obstacle.h"
+#include "selfCollision.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// size of the integrator name in the binary format; must not be shorter than world::integrator
+#define WORLD_BINARY_INTEGRATOR_LENGTH 32
+
+static_assert(sizeof(struct point) == 3 * sizeof(double), "binary world files store points as 3 packed doubles");
+
+/* reads the base part of a text world file, up to and including the velocities */
+static void readWorldText(FILE* file, struct world* jello)
+{
+    int i, j, k;
+
+    /*
+
+      File should first contain a line specifying the integrator (Euler, RK4, SymplecticEuler, Verlet, DOPRI5, XPBD
+      or ProjectiveDynamics).
+      Example: Euler
+
+      Then, follows one line specifying the size of the timestep for the integrator, and
+      an integer parameter n specifying  that every nth timestep will actually be drawn
+      (the other steps will only be used for internal calculation)
+
+      Example: 0.001 5
+      Now, timestep equals 0.001. Every fifth time point will actually be drawn,
+      i.e. frame1 <--> t = 0
+      frame2 <--> t = 0.005
+      frame3 <--> t = 0.010
+      frame4 <--> t = 0.015
+      ...
+
+      Then, there should be two lines for physical parameters and external acceleration.
+      Format is:
+        kElastic dElastic kCollision dCollision
+        mass
+      Here
+        kElastic = elastic coefficient of the spring (same for all springs except collision springs)
+        dElastic = damping coefficient of the spring (same for all springs except collision springs)
+        kCollision = elastic coefficient of collision springs (same for all collision springs)
+        dCollision = damping coefficient of collision springs (same for all collision springs)
+        mass = mass in kilograms for each of the (JELLO_SUBPOINTS^3) mass points
+        (mass assumed to be the same for all the points; total mass of the jello cube =
+      (JELLO_SUBPOINTS^3) * mass)
+
+      Example:
+        10000 25 10000 15
+        0.002
+
+      Then, there should be one or two lines for the inclined plane, with the obvious syntax.
+      If there is no inclined plane, there should be only one line with a 0 value. There
+      is no line for the coefficient. Otherwise, there are two lines, first one containing 1,
+      and the second one containing the coefficients.
+      The inclined plane is a collision plane; the cube is kept on the side where it starts.
+      Example:
+        1
+        0.31 -0.78 0.5 5.39
+
+      Next is the forceField block, first with the resolution and then the data, one point per row.
+      Example:
+        30
+        <here 30 * 30 * 30 = 27 000 lines follow, each containing 3 real numbers>
+
+      After this, there should be 1024 lines, each containing three floating-point numbers.
+      The first (JELLO_SUBPOINTS^3) lines correspond to initial point locations.
+      The last (JELLO_SUBPOINTS^3) lines correspond to initial point velocities.
+
+      There should no blank lines anywhere in the file.
+
+      Optionally, extension lines follow, each starting with a keyword:
+        forcefield <type> ...   additional force field, see readForceField() in forceField.cpp
+        plane a b c d           additional collision plane; particles are kept where a*x + b*y + c*z + d >= 0
+        sphere|capsule|sdf ...  static obstacle, see readObstacle() in obstacle.h
+        selfcollision t         contacts between the cube's own surface particles and faces, with contact
+                                distance t * (1 / JELLO_SUBDIVISIONS), e.g. 0.5
+        tolerance rtol atol     error tolerances of the DOPRI5 integrator (relative, absolute), e.g. 1e-4 1e-5
+        guard speed stretch     stability guard limits: fastest control point, longest structural spring in rest
+                                lengths (default 10000 5); "guard off" disables the guard
+        sleep speed energy steps
+                                the cube sleeps (is no longer integrated) after 'steps' consecutive steps with no
+                                control point faster than 'speed' and a kinetic energy below 'energy'
+                                (default 0.01 1e-6 200); "sleep off" keeps it always awake
+
+    */
+
+    /* read integrator algorithm */
+    fscanf(file, "%31s\n", jello->integrator);
+
+    /* read timestep size and render */
+    fscanf(file, "%lf %d\n", &jello->dt, &jello->n);
+
+    /* read physical parameters */
+    fscanf(file, "%lf %lf %lf %lf\n", &jello->kElastic, &jello->dElastic, &jello->kCollision,
+           &jello->dCollision);
+
+    /* read mass of each of the (JELLO_SUBPOINTS^3) points */
+    fscanf(file, "%lf\n", &jello->mass);
+
+    /* read info about the plane */
+    fscanf(file, "%d\n", &jello->incPlanePresent);
+    if (jello->incPlanePresent == 1)
+        fscanf(file, "%lf %lf %lf %lf\n", &jello->a, &jello->b, &jello->c, &jello->d);
+
+    /* read info about the force field */
+    fscanf(file, "%d\n", &jello->resolution);
+    jello->forceField = (struct point*)malloc(jello->resolution * jello->resolution *
+                                              jello->resolution * sizeof(struct point));
+    if (jello->resolution != 0)
+        for (i = 0; i <= jello->resolution - 1; i++)
+            for (j = 0; j <= jello->resolution - 1; j++)
+                for (k = 0; k <= jello->resolution - 1; k++)
+                    fscanf(file, "%lf %lf %lf\n",
+                           &jello
+                                ->forceField[i * jello->resolution * jello->resolution +
+                                             j * jello->resolution + k]
+                                .x,
+                           &jello
+                                ->forceField[i * jello->resolution * jello->resolution +
+                                             j * jello->resolution + k]
+                                .y,
+                           &jello
+                                ->forceField[i * jello->resolution * jello->resolution +
+                                             j * jello->resolution + k]
+                                .z);
+
+    jello->field = createDenseForceField(jello);
+
+    /* read initial point positions */
+    for (i = 0; i <= JELLO_SUBDIVISIONS; i++)
+    {
+        for (j = 0; j <= JELLO_SUBDIVISIONS; j++)
+        {
+            for (k = 0; k <= JELLO_SUBDIVISIONS; k++)
+                fscanf(file, "%lf %lf %lf\n", &jello->p[i][j][k].x, &jello->p[i][j][k].y,
+                       &jello->p[i][j][k].z);
+        }
+    }
+
+    /* read initial point velocities */
+    for (i = 0; i <= JELLO_SUBDIVISIONS; i++)
+    {
+        for (j = 0; j <= JELLO_SUBDIVISIONS; j++)
+        {
+            for (k = 0; k <= JELLO_SUBDIVISIONS; k++)
+                fscanf(file, "%lf %lf %lf\n", &jello->v[i][j][k].x, &jello->v[i][j][k].y,
+                       &jello->v[i][j][k].z);
+        }
+    }
+
+    return;
+}
+
+/* reads 'size' bytes, aborting on a truncated file */
+static void readBytes(FILE* file, void* data, size_t size)
+{
+    if (fread(data, 1, size, file) != size)
+    {
+        printf("truncated world file\n");
+        exit(1);
+    }
+}
+
+/* reads the base part of a binary world file (the magic has been consumed)
+   layout, all values in native (little-endian) byte order:
+     char integrator[32]
+     double dt, int32 n
+     double kElastic, dElastic, kCollision, dCollision, mass
+     int32 incPlanePresent, double a, b, c, d
+     int32 resolution, int32 subpoints (must equal JELLO_SUBPOINTS)
+     resolution^3 force-field points, then subpoints^3 positions, then subpoints^3 velocities (3 doubles each) */
+static void readWorldBinary(FILE* file, struct world* jello)
+{
+    char integrator[WORLD_BINARY_INTEGRATOR_LENGTH];
+    int subpoints;
+
+    readBytes(file, integrator, sizeof(integrator));
+    integrator[sizeof(integrator) - 1] = 0;
+    strncpy(jello->integrator, integrator, sizeof(jello->integrator) - 1);
+    jello->integrator[sizeof(jello->integrator) - 1] = 0;
+
+    readBytes(file, &jello->dt, sizeof(double));
+    readBytes(file, &jello->n, sizeof(int));
+    readBytes(file, &jello->kElastic, sizeof(double));
+    readBytes(file, &jello->dElastic, sizeof(double));
+    readBytes(file, &jello->kCollision, sizeof(double));
+    readBytes(file, &jello->dCollision, sizeof(double));
+    readBytes(file, &jello->mass, sizeof(double));
+    readBytes(file, &jello->incPlanePresent, sizeof(int));
+    readBytes(file, &jello->a, sizeof(double));
+    readBytes(file, &jello->b, sizeof(double));
+    readBytes(file, &jello->c, sizeof(double));
+    readBytes(file, &jello->d, sizeof(double));
+    readBytes(file, &jello->resolution, sizeof(int));
+    readBytes(file, &subpoints, sizeof(int));
+
+    if ((jello->resolution < 0) || (subpoints != JELLO_SUBPOINTS))
+    {
+        printf("binary world file has resolution %d and %d subpoints; expected %d subpoints\n",
+               jello->resolution, subpoints, JELLO_SUBPOINTS);
+        exit(1);
+    }
+
+    size_t fieldSize = (size_t)jello->resolution * jello->resolution * jello->resolution;
+    jello->forceField = (struct point*)malloc(fieldSize * sizeof(struct point));
+    readBytes(file, jello->forceField, fieldSize * sizeof(struct point));
+
+    jello->field = createDenseForceField(jello);
+
+    readBytes(file, jello->p, sizeof(jello->p));
+    readBytes(file, jello->v, sizeof(jello->v));
+}
+
+/* reads the optional extension lines that may follow either flavour; directory is the world file's directory
+   with a trailing separator, for the files the lines name */
+static void readWorldExtensions(FILE* file, struct world* jello, const char* directory)
+{
+    char keyword[32];
+    while (fscanf(file, "%31s", keyword) == 1)
+    {
+        if (strcmp(keyword, "forcefield") == 0)
+        {
+            ForceField* field = readForceField(file, jello);
+            if (field == NULL)
+            {
+                exit(1);
+            }
+            jello->field = sumForceFields(jello->field, field);
+        }
+        else if (strcmp(keyword, "plane") == 0)
+        {
+            if (!readCollisionPlane(file, jello->planes))
+            {
+                exit(1);
+            }
+        }
+        else if (isObstacleKeyword(keyword))
+        {
+            Obstacle* obstacle = readObstacle(keyword, file, directory);
+            if (obstacle == NULL)
+            {
+                exit(1);
+            }
+            if (jello->obstacles == NULL)
+            {
+                jello->obstacles = new Obstacles();
+            }
+            jello->obstacles->add(obstacle);
+        }
+        else if (isMaterialKeyword(keyword))
+        {
+            if (!readMaterialLine(keyword, file, jello))
+            {
+                exit(1);
+            }
+        }
+        else if (isKinematicKeyword(keyword))
+        {
+            if (!readKinematicLine(keyword, file, jello))
+            {
+                exit(1);
+            }
+        }
+        else if (strcmp(keyword, "selfcollision") == 0)
+        {
+            double thickness;
+            if (fscanf(file, "%lf", &thickness) != 1 || thickness <= 0.0 || thickness >= 1.0)
+            {
+                printf("selfcollision: expected a thickness between 0 and 1 (fraction of the rest spacing)\n");
+                exit(1);
+            }
+            delete jello->selfCollision;
+            jello->selfCollision = new SelfCollision(thickness);
+        }
+        else if (strcmp(keyword, "guard") == 0)
+        {
+            char value[32];
+            free(jello->guard);
+            jello->guard = (struct stabilityGuard*)calloc(1, sizeof(struct stabilityGuard));
+            bool read = fscanf(file, "%31s", value) == 1;
+            if (read && strcmp(value, "off") == 0)
+            {
+                jello->guard->enabled = 0;
+            }
+            else if (read && (jello->guard->maxSpeed = atof(value)) > 0.0 &&
+                     fscanf(file, "%lf", &jello->guard->maxStretch) == 1 && jello->guard->maxStretch > 1.0)
+            {
+                jello->guard->enabled = 1;
+            }
+            else
+            {
+                printf("guard: expected 'guard off' or 'guard <max speed> <max stretch>' (stretch > 1)\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(keyword, "sleep") == 0)
+        {
+            char value[32];
+            free(jello->sleep);
+            jello->sleep = (struct sleepState*)calloc(1, sizeof(struct sleepState));
+            bool read = fscanf(file, "%31s", value) == 1;
+            if (read && strcmp(value, "off") == 0)
+            {
+                jello->sleep->enabled = 0;
+            }
+            else if (read && (jello->sleep->maxSpeed = atof(value)) > 0.0 &&
+                     fscanf(file, "%lf %d", &jello->sleep->maxKineticEnergy, &jello->sleep->stepsToSleep) == 2 &&
+                     jello->sleep->maxKineticEnergy > 0.0 && jello->sleep->stepsToSleep > 0)
+            {
+                jello->sleep->enabled = 1;
+            }
+            else
+            {
+                printf("sleep: expected 'sleep off' or 'sleep <max speed> <max kinetic energy> <steps>'\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(keyword, "tolerance") == 0)
+        {
+            double relativeTolerance, absoluteTolerance;
+            if (fscanf(file, "%lf %lf", &relativeTolerance, &absoluteTolerance) != 2 || relativeTolerance <= 0.0 ||
+                absoluteTolerance <= 0.0)
+            {
+                printf("tolerance: expected a positive relative and absolute tolerance\n");
+                exit(1);
+            }
+            free(jello->adaptive);
+            jello->adaptive = (struct adaptiveStep*)calloc(1, sizeof(struct adaptiveStep));
+            jello->adaptive->relativeTolerance = relativeTolerance;
+            jello->adaptive->absoluteTolerance = absoluteTolerance;
+        }
+        else
+        {
+            printf("unknown world file keyword '%s'\n", keyword);
+            exit(1);
+        }
+    }
+
+}
+
+/* reads the world parameters from a world file */
+/* fileName = string containing the name of the world file, ex: jello1.w */
+/* function fills the structure 'jello' with parameters read from file */
+/* structure 'jello' will typically be declared (probably statically, not on the heap)
+   by the caller function */
+/* function aborts the program if can't access the file */
+void readWorld(const char* fileName, struct world* jello)
+{
+    FILE* file;
+    char magic[WORLD_BINARY_MAGIC_LENGTH];
+
+    file = fopen(fileName, "rb");
+    if (file == NULL)
+    {
+        printf("can't open file\n");
+        exit(1);
+    }
+
+    if ((fread(magic, 1, sizeof(magic), file) == sizeof(magic)) &&
+        (memcmp(magic, WORLD_BINARY_MAGIC, sizeof(magic)) == 0))
+    {
+        readWorldBinary(file, jello);
+    }
+    else
+    {
+        /* reopen in text mode so line endings are translated */
+        fclose(file);
+        file = fopen(fileName, "r");
+        if (file == NULL)
+        {
+            printf("can't open file\n");
+            exit(1);
+        }
+        readWorldText(file, jello);
+    }
+
+    jello->time = 0.0;
+    jello->planes = createCollisionPlanes(jello);
+    jello->obstacles = NULL;
+    jello->selfCollision = NULL;
+    jello->externalForce = NULL;
+    jello->adaptive = NULL;
+    jello->guard = NULL;
+    jello->sleep = NULL;
+    jello->energy = NULL;
+    jello->material = NULL;
+    jello->kinematics = NULL;
+
+    std::string directory = fileName;
+    size_t separator = directory.find_last_of("/\\");
+    directory.erase(separator == std::string::npos ? 0 : separator + 1);
+    readWorldExtensions(file, jello, directory.c_str());
+    if (jello->material != NULL && jello->kinematics != NULL)
+        dropSprings(jello->material, jello->kinematics->mask.data());
+    if (jello->material != NULL && jello->field != NULL)
+        jello->field->setPointMasses(jello->material->mass.data());
+
+    fclose(file);
+
+    return;
+}
+
+void freeWorld(struct world* jello)
+{
+    free(jello->forceField);
+    delete jello->field;
+    delete jello->planes;
+    delete jello->obstacles;
+    delete jello->selfCollision;
+    free(jello->adaptive);
+    free(jello->guard);
+    free(jello->sleep);
+    delete jello->material;
+    delete jello->kinematics;
+
+    jello->forceField = NULL;
+    jello->field = NULL;
+    jello->planes = NULL;
+    jello->obstacles = NULL;
+    jello->selfCollision = NULL;
+    jello->adaptive = NULL;
+    jello->guard = NULL;
+    jello->sleep = NULL;
+    jello->material = NULL;
+    jello->kinematics = NULL;
+}
+
+/* writes the optional extension lines that follow either flavour, see readWorldExtensions() */
+static void writeWorldExtensions(FILE* file, const struct world* jello)
+{
+    if (jello->field != NULL)
+        jello->field->write(file);
+    if (jello->planes != NULL)
+        jello->planes->write(file);
+    if (jello->obstacles != NULL)
+        jello->obstacles->write(file);
+    if (jello->selfCollision != NULL)
+        fprintf(file, "selfcollision %lf\n", jello->selfCollision->thickness());
+    if (jello->material != NULL)
+        writeMaterial(file, jello->material);
+    if (jello->kinematics != NULL)
+        writeKinematics(file, jello->kinematics);
+    if (jello->adaptive != NULL)
+        fprintf(file, "tolerance %g %g\n", jello->adaptive->relativeTolerance, jello->adaptive->absoluteTolerance);
+    if (jello->guard != NULL && !jello->guard->enabled)
+        fprintf(file, "guard off\n");
+    else if (jello->guard != NULL)
+        fprintf(file, "guard %.17g %.17g\n", jello->guard->maxSpeed, jello->guard->maxStretch);
+    if (jello->sleep != NULL && !jello->sleep->enabled)
+        fprintf(file, "sleep off\n");
+    else if (jello->sleep != NULL)
+        fprintf(file, "sleep %.17g %.17g %d\n", jello->sleep->maxSpeed, jello->sleep->maxKineticEnergy,
+                jello->sleep->stepsToSleep);
+}
+
+/* writes the world parameters to a world file on disk*/
+/* fileName = string containing the name of the output world file, ex: jello1.w */
+/* function creates the output world file and then fills it corresponding to the contents
+   of structure 'jello' */
+/* function aborts the program if can't access the file */
+void writeWorld(const char* fileName, struct world* jello)
+{
+    int i, j, k;
+    FILE* file;
+
+    file = fopen(fileName, "w");
+    if (file == NULL)
+    {
+        printf("can't open file\n");
+        exit(1);
+    }
+
+    /* write integrator algorithm */
+    fprintf(file, "%s\n", jello->integrator);
+
+    /* write timestep */
+    fprintf(file, "%lf %d\n", jello->dt, jello->n);
+
+    /* write physical parameters */
+    fprintf(file, "%lf %lf %lf %lf\n", jello->kElastic, jello->dElastic, jello->kCollision,
+            jello->dCollision);
+
+    /* write mass */
+    fprintf(file, "%lf\n", jello->mass);
+
+    /* write info about the plane */
+    fprintf(file, "%d\n", jello->incPlanePresent);
+    if (jello->incPlanePresent == 1)
+        fprintf(file, "%lf %lf %lf %lf\n", jello->a, jello->b, jello->c, jello->d);
+
+    /* write info about the force field */
+    fprintf(file, "%d\n", jello->resolution);
+    if (jello->resolution != 0)
+        for (i = 0; i <= jello->resolution - 1; i++)
+            for (j = 0; j <= jello->resolution - 1; j++)
+                for (k = 0; k <= jello->resolution - 1; k++)
+                    fprintf(file, "%lf %lf %lf\n",
+                            jello
+                                ->forceField[i * jello->resolution * jello->resolution +
+                                             j * jello->resolution + k]
+                                .x,
+                            jello
+                                ->forceField[i * jello->resolution * jello->resolution +
+                                             j * jello->resolution + k]
+                                .y,
+                            jello
+                                ->forceField[i * jello->resolution * jello->resolution +
+                                             j * jello->resolution + k]
+                                .z);
+
+    /* write initial point positions */
+    for (i = 0; i <= JELLO_SUBDIVISIONS; i++)
+    {
+        for (j = 0; j <= JELLO_SUBDIVISIONS; j++)
+        {
+            for (k = 0; k <= JELLO_SUBDIVISIONS; k++)
+                fprintf(file, "%lf %lf %lf\n", jello->p[i][j][k].x, jello->p[i][j][k].y,
+                        jello->p[i][j][k].z);
+        }
+    }
+
+    /* write initial point velocities */
+    for (i = 0; i <= JELLO_SUBDIVISIONS; i++)
+    {
+        for (j = 0; j <= JELLO_SUBDIVISIONS; j++)
+        {
+            for (k = 0; k <= JELLO_SUBDIVISIONS; k++)
+                fprintf(file, "%lf %lf %lf\n", jello->v[i][j][k].x, jello->v[i][j][k].y,
+                        jello->v[i][j][k].z);
+        }
+    }
+
+    writeWorldExtensions(file, jello);
+
+    fclose(file);
+
+    return;
+}
+
+/* writes 'size' bytes, aborting if the disk is full */
+static void writeBytes(FILE* file, const void* data, size_t size)
+{
+    if (fwrite(data, 1, size, file) != size)
+    {
+        printf("can't write file\n");
+        exit(1);
+    }
+}
+
+/* writes the world in the binary format, see readWorldBinary() for the layout */
+/* function aborts the program if can't access the file */
+void writeWorldBinary(const char* fileName, struct world* jello)
+{
+    FILE* file;
+    char integrator[WORLD_BINARY_INTEGRATOR_LENGTH];
+    int subpoints = JELLO_SUBPOINTS;
+
+    file = fopen(fileName, "wb");
+    if (file == NULL)
+    {
+        printf("can't open file\n");
+        exit(1);
+    }
+
+    memset(integrator, 0, sizeof(integrator));
+    size_t length = strnlen(jello->integrator, sizeof(integrator) - 1);
+    memcpy(integrator, jello->integrator, length);
+
+    writeBytes(file, WORLD_BINARY_MAGIC, WORLD_BINARY_MAGIC_LENGTH);
+    writeBytes(file, integrator, sizeof(integrator));
+    writeBytes(file, &jello->dt, sizeof(double));
+    writeBytes(file, &jello->n, sizeof(int));
+    writeBytes(file, &jello->kElastic, sizeof(double));
+    writeBytes(file, &jello->dElastic, sizeof(double));
+    writeBytes(file, &jello->kCollision, sizeof(double));
+    writeBytes(file, &jello->dCollision, sizeof(double));
+    writeBytes(file, &jello->mass, sizeof(double));
+    writeBytes(file, &jello->incPlanePresent, sizeof(int));
+    writeBytes(file, &jello->a, sizeof(double));
+    writeBytes(file, &jello->b, sizeof(double));
+    writeBytes(file, &jello->c, sizeof(double));
+    writeBytes(file, &jello->d, sizeof(double));
+    writeBytes(file, &jello->resolution, sizeof(int));
+    writeBytes(file, &subpoints, sizeof(int));
+    writeBytes(file, jello->forceField,
+               (size_t)jello->resolution * jello->resolution * jello->resolution * sizeof(struct point));
+    writeBytes(file, jello->p, sizeof(jello->p));
+    writeBytes(file, jello->v, sizeof(jello->v));
+
+    writeWorldExtensions(file, jello);
+
+    fclose(file);
+
+    return;
+}
@@ -0,0 +1,26 @@
+#ifndef _WORLD_FILE_H_
+#define _WORLD_FILE_H_
+
+#include "world.h"
+
+// World files come in two flavours with the same content:
+//   text   - the original assignment format, see readWorld() in worldFile.cpp
+//   binary - starts with WORLD_BINARY_MAGIC, stores the same fields as raw little-endian values; much faster to
+//            read and write for large force-field grids
+// Both may be followed by the same optional text extension lines (e.g. "forcefield ...").
+// readWorld detects the flavour from the first bytes of the file.
+
+#define WORLD_BINARY_MAGIC "JELLOWB1"
+#define WORLD_BINARY_MAGIC_LENGTH 8
+
+// read/write world files; both abort the program if the file can't be accessed
+void readWorld(const char* fileName, struct world* jello);
+void writeWorld(const char* fileName, struct world* jello);
+void writeWorldBinary(const char* fileName, struct world* jello);
+
+// frees everything readWorld and stepWorld allocated for jello (force field, colliders, material, kinematics and
+// the integrator, guard and sleep state) and sets the pointers to NULL; not externalForce or energy, which belong
+// to the caller, nor jello itself
+void freeWorld(struct world* jello);
+
+#endif // #ifndef _WORLD_FILE_H_
@@ -0,0 +1,218 @@
+#include "xpbd.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+#include "collision.h"
+#include "forceField.h"
+#include "kinematics.h"
+#include "material.h"
+#include "obstacle.h"
+#include "parallel.h"
+#include "selfCollision.h"
+#include "springs.h"
+
+#define NUM_PARTICLES (JELLO_SUBPOINTS * JELLO_SUBPOINTS * JELLO_SUBPOINTS)
+
+// the spring constraints, grouped by colour; the same for every world, built on first use
+struct xpbdTopology
+{
+    springList springs;
+    std::vector<int> colourStart;
+    int colourCount;
+
+    xpbdTopology()
+    {
+        buildSpringList(&springs);
+        colourCount = colourSpringList(&springs, &colourStart);
+    }
+};
+
+static const xpbdTopology& topology()
+{
+    static const xpbdTopology topology;
+    return topology;
+}
+
+// one contact constraint, C = n.p + d >= 0 with compliance alpha; lambda is its accumulated multiplier
+static inline void projectContact(struct point* p, double inverseMass, double nx, double ny, double nz, double c,
+                                  double alpha, double* lambda)
+{
+    if (c >= 0.0)
+    {
+        return;
+    }
+
+    double deltaLambda = (-c - alpha * *lambda) / (inverseMass + alpha);
+    *lambda += deltaLambda;
+    p->x += inverseMass * deltaLambda * nx;
+    p->y += inverseMass * deltaLambda * ny;
+    p->z += inverseMass * deltaLambda * nz;
+}
+
+void XPBD(struct world* jello)
+{
+    const xpbdTopology& t = topology();
+    const struct material* material = jello->material;
+    const springList& springs = material != NULL ? material->springs : t.springs;
+    const std::vector<int>& colourStart = material != NULL ? material->colourStart : t.colourStart;
+    const int colourCount = (int)colourStart.size() - 1;
+    const double dt = jello->dt;
+    const double inverseMass = 1.0 / jello->mass;
+    const double contactAlpha = 1.0 / (jello->kCollision * dt * dt);
+
+    // the spring constants, per spring with a material and read with a stride of 0 otherwise
+    const double* kElastic = material != NULL ? material->kElastic.data() : &jello->kElastic;
+    const double* dElastic = material != NULL ? material->dElastic.data() : &jello->dElastic;
+    const int springStride = material != NULL ? 1 : 0;
+
+    struct point* p = &jello->p[0][0][0];
+    struct point* v = &jello->v[0][0][0];
+
+    // kinematic points have inverse mass 0: the constraints never move them. Without any, the material's or the
+    // uniform inverse mass is read directly, the uniform one with a stride of 0.
+    const int* freeList;
+    const int freeCount = freePoints(jello, &freeList);
+    std::vector<double> weights;
+    const double* w = material != NULL ? material->inverseMass.data() : &inverseMass;
+    int stride = material != NULL ? 1 : 0;
+    if (jello->kinematics != NULL)
+    {
+        if (material != NULL)
+            weights = material->inverseMass;
+        else
+            weights.assign(NUM_PARTICLES, inverseMass);
+        for (int n : jello->kinematics->points)
+        {
+            weights[n] = 0.0;
+        }
+        w = weights.data();
+        stride = 1;
+    }
+
+    // external forces, then the predicted positions; the kinematic points go to their path at the end of the step
+    std::vector<struct point> force(NUM_PARTICLES, {0.0, 0.0, 0.0});
+    if (jello->field != NULL)
+    {
+        for (int f = 0; f < freeCount; f++)
+        {
+            int n = freeList[f];
+            jello->field->addForce(n, p[n], jello->time, &force[n]);
+        }
+    }
+    if (jello->externalForce != NULL)
+    {
+        for (int f = 0; f < freeCount; f++)
+        {
+            int n = freeList[f];
+            force[n].x += jello->externalForce[n].x;
+            force[n].y += jello->externalForce[n].y;
+            force[n].z += jello->externalForce[n].z;
+        }
+    }
+    if (jello->selfCollision != NULL)
+    {
+        jello->selfCollision->addForces(p, v, jello->kCollision, jello->dCollision, force.data(), kinematicMask(jello));
+    }
+
+    std::vector<struct point> previous(p, p + NUM_PARTICLES);
+    for (int f = 0; f < freeCount; f++)
+    {
+        int n = freeList[f];
+        v[n].x += dt * w[n * stride] * force[n].x;
+        v[n].y += dt * w[n * stride] * force[n].y;
+        v[n].z += dt * w[n * stride] * force[n].z;
+        p[n].x += dt * v[n].x;
+        p[n].y += dt * v[n].y;
+        p[n].z += dt * v[n].z;
+    }
+    applyKinematics(jello->kinematics, jello->time + dt, p, v);
+
+    const int planeCount = jello->planes != NULL ? jello->planes->count() : 0;
+    const int obstacleCount = jello->obstacles != NULL ? jello->obstacles->count() : 0;
+    const int contactsPerParticle = planeCount + obstacleCount;
+    std::vector<double> springLambda(springs.count(), 0.0);
+    std::vector<double> contactLambda((size_t)NUM_PARTICLES * contactsPerParticle, 0.0);
+
+    for (int iteration = 0; iteration < XPBD_ITERATIONS; iteration++)
+    {
+        for (int c = 0; c < colourCount; c++)
+        {
+            parallelFor(colourStart[c + 1] - colourStart[c], [&](int begin, int end) {
+                for (int s = colourStart[c] + begin; s < colourStart[c] + end; s++)
+                {
+                    const double wa = w[springs.a[s] * stride], wb = w[springs.b[s] * stride];
+                    const double k = kElastic[s * springStride];
+                    if (wa + wb == 0.0 || k == 0.0)
+                    {
+                        continue; // both ends kinematic, or no stiffness and so no constraint
+                    }
+                    struct point& a = p[springs.a[s]];
+                    struct point& b = p[springs.b[s]];
+                    double dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+                    double length = sqrt(dx * dx + dy * dy + dz * dz);
+                    if (length < 1e-8)
+                    {
+                        continue;
+                    }
+                    double nx = dx / length, ny = dy / length, nz = dz / length;
+
+                    // grad C . (x - x_previous), the relative motion along the spring this step
+                    const struct point& pa = previous[springs.a[s]];
+                    const struct point& pb = previous[springs.b[s]];
+                    double motion = nx * ((a.x - pa.x) - (b.x - pb.x)) + ny * ((a.y - pa.y) - (b.y - pb.y)) +
+                                    nz * ((a.z - pa.z) - (b.z - pb.z));
+
+                    // compliance scaled by dt^2 (alpha~ in the XPBD paper), and the damping term gamma = alpha~ beta dt
+                    const double springAlpha = 1.0 / (k * dt * dt);
+                    const double springGamma = springAlpha * dElastic[s * springStride] * dt;
+                    double constraint = length - springs.rest[s];
+                    double deltaLambda = (-constraint - springAlpha * springLambda[s] - springGamma * motion) /
+                                         ((1.0 + springGamma) * (wa + wb) + springAlpha);
+                    springLambda[s] += deltaLambda;
+
+                    double stepA = wa * deltaLambda, stepB = wb * deltaLambda;
+                    a.x += stepA * nx, a.y += stepA * ny, a.z += stepA * nz;
+                    b.x -= stepB * nx, b.y -= stepB * ny, b.z -= stepB * nz;
+                }
+            });
+        }
+
+        if (contactsPerParticle > 0)
+        {
+            parallelFor(freeCount, [&](int begin, int end) {
+                for (int f = begin; f < end; f++)
+                {
+                    const int n = freeList[f];
+                    double* lambda = &contactLambda[(size_t)n * contactsPerParticle];
+                    for (int plane = 0; plane < planeCount; plane++)
+                    {
+                        double nx, ny, nz, d;
+                        jello->planes->get(plane, &nx, &ny, &nz, &d);
+                        projectContact(&p[n], w[n * stride], nx, ny, nz, nx * p[n].x + ny * p[n].y + nz * p[n].z + d,
+                                       contactAlpha, &lambda[plane]);
+                    }
+                    for (int o = 0; o < obstacleCount; o++)
+                    {
+                        struct point gradient;
+                        double d = jello->obstacles->get(o)->distance(p[n], &gradient);
+                        projectContact(&p[n], w[n * stride], gradient.x, gradient.y, gradient.z, d, contactAlpha,
+                                       &lambda[planeCount + o]);
+                    }
+                }
+            });
+        }
+    }
+
+    for (int f = 0; f < freeCount; f++)
+    {
+        int n = freeList[f];
+        v[n].x = (p[n].x - previous[n].x) / dt;
+        v[n].y = (p[n].y - previous[n].y) / dt;
+        v[n].z = (p[n].z - previous[n].z) / dt;
+    }
+
+    jello->time += dt;
+}
@@ -0,0 +1,24 @@
+#ifndef _XPBD_H_
+#define _XPBD_H_
+
+#include "world.h"
+
+// Extended position-based dynamics (XPBD), selected with the integrator name "XPBD".
+//
+// Every structural, shear and bend spring is a distance constraint with compliance 1 / kElastic and damping
+// dElastic, each spring's own with a material (material.h), whose per-point masses weight the corrections; the
+// collision planes and obstacles are one-sided contact constraints with compliance 1 / kCollision.
+// A step predicts positions from the velocities and the external forces (force field, externalForce and the
+// self-collision penalty forces), then runs XPBD_ITERATIONS Gauss-Seidel sweeps over the constraints and derives
+// the new velocities from the change in position. The springs are edge-coloured once, so the springs of one
+// colour share no particle and are projected in parallel; contacts only touch one particle each and run in
+// parallel as well. Kinematic points (kinematics.h) have inverse mass 0, so no constraint moves them.
+//
+// Unlike the force-based integrators it stays stable at frame-rate timesteps (dt = 1/60) for any stiffness;
+// stiff springs simply converge to their rest length more slowly with few iterations.
+
+#define XPBD_ITERATIONS 10
+
+void XPBD(struct world* jello);
+
+#endif // #ifndef _XPBD_H_